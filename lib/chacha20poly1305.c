@@ -0,0 +1,518 @@
+#include "chacha20poly1305.h"
+
+#include <string.h>
+
+static inline uint32_t
+load32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16
+        | (uint32_t)p[3] << 24;
+}
+
+static inline void
+store32(uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static inline uint32_t
+rotl32(uint32_t v, int n)
+{
+    return v << n | v >> (32 - n);
+}
+
+#define QUARTERROUND(a, b, c, d)                                               \
+    a += b;                                                                    \
+    d = rotl32(d ^ a, 16);                                                     \
+    c += d;                                                                    \
+    b = rotl32(b ^ c, 12);                                                     \
+    a += b;                                                                    \
+    d = rotl32(d ^ a, 8);                                                      \
+    c += d;                                                                    \
+    b = rotl32(b ^ c, 7)
+
+static void
+chacha20_block(const uint32_t in[16], uint8_t out[64])
+{
+    uint32_t x[16];
+    memcpy(x, in, sizeof(x));
+    for (int i = 0; i < 10; i++)
+    {
+        QUARTERROUND(x[0], x[4], x[8], x[12]);
+        QUARTERROUND(x[1], x[5], x[9], x[13]);
+        QUARTERROUND(x[2], x[6], x[10], x[14]);
+        QUARTERROUND(x[3], x[7], x[11], x[15]);
+        QUARTERROUND(x[0], x[5], x[10], x[15]);
+        QUARTERROUND(x[1], x[6], x[11], x[12]);
+        QUARTERROUND(x[2], x[7], x[8], x[13]);
+        QUARTERROUND(x[3], x[4], x[9], x[14]);
+    }
+    for (int i = 0; i < 16; i++)
+    {
+        store32(&out[4 * i], x[i] + in[i]);
+    }
+}
+
+/*
+ * Blocks of independent states side by side, one per SIMD lane: the rounds
+ * are the same as above, on vectors, and need no shuffles.
+ */
+#if defined(__SSE2__) || defined(__ARM_NEON)
+#define CHACHA20_LANES 4
+typedef uint32_t chacha20_lanes_t __attribute__((vector_size(16)));
+
+#define ROTL_LANES(v, n) ((v) << (n) | (v) >> (32 - (n)))
+#define QUARTERROUND_LANES(a, b, c, d)                                         \
+    a += b;                                                                    \
+    d = ROTL_LANES(d ^ a, 16);                                                 \
+    c += d;                                                                    \
+    b = ROTL_LANES(b ^ c, 12);                                                 \
+    a += b;                                                                    \
+    d = ROTL_LANES(d ^ a, 8);                                                  \
+    c += d;                                                                    \
+    b = ROTL_LANES(b ^ c, 7)
+
+static void
+chacha20_blocks(const uint32_t in[][16], uint8_t out[][64], size_t lanes)
+{
+    chacha20_lanes_t x[16], s[16];
+
+    if (lanes == 1)
+    {
+        chacha20_block(in[0], out[0]);
+        return;
+    }
+    /* idle lanes repeat the first, and are not stored */
+    for (int i = 0; i < 16; i++)
+    {
+        s[i] = (chacha20_lanes_t) { in[0][i], in[lanes > 1 ? 1 : 0][i],
+            in[lanes > 2 ? 2 : 0][i], in[lanes > 3 ? 3 : 0][i] };
+        x[i] = s[i];
+    }
+    for (int i = 0; i < 10; i++)
+    {
+        QUARTERROUND_LANES(x[0], x[4], x[8], x[12]);
+        QUARTERROUND_LANES(x[1], x[5], x[9], x[13]);
+        QUARTERROUND_LANES(x[2], x[6], x[10], x[14]);
+        QUARTERROUND_LANES(x[3], x[7], x[11], x[15]);
+        QUARTERROUND_LANES(x[0], x[5], x[10], x[15]);
+        QUARTERROUND_LANES(x[1], x[6], x[11], x[12]);
+        QUARTERROUND_LANES(x[2], x[7], x[8], x[13]);
+        QUARTERROUND_LANES(x[3], x[4], x[9], x[14]);
+    }
+    for (int i = 0; i < 16; i++)
+    {
+        x[i] += s[i];
+    }
+    for (size_t l = 0; l < lanes; l++)
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            store32(&out[l][4 * i], x[i][l]);
+        }
+    }
+}
+#else
+#define CHACHA20_LANES 1
+
+static void
+chacha20_blocks(const uint32_t in[][16], uint8_t out[][64], size_t lanes)
+{
+    (void)lanes;
+    chacha20_block(in[0], out[0]);
+}
+#endif
+
+/* key stream blocks queued for the lanes, and where they go */
+struct chacha20_queue_t
+{
+    uint32_t in[CHACHA20_LANES][16];
+    uint8_t  out[CHACHA20_LANES][64];
+    uint8_t* dst[CHACHA20_LANES];
+    size_t   len[CHACHA20_LANES];
+    bool     copy[CHACHA20_LANES]; /* a Poly1305 key, rather than XORed */
+    size_t   lanes;
+};
+
+static void
+chacha20_queue_flush(struct chacha20_queue_t* q)
+{
+    if (q->lanes == 0)
+    {
+        return;
+    }
+    chacha20_blocks((const uint32_t(*)[16])q->in, q->out, q->lanes);
+    for (size_t l = 0; l < q->lanes; l++)
+    {
+        if (q->copy[l])
+        {
+            memcpy(q->dst[l], q->out[l], q->len[l]);
+            continue;
+        }
+        for (size_t i = 0; i < q->len[l]; i++)
+        {
+            q->dst[l][i] ^= q->out[l][i];
+        }
+    }
+    q->lanes = 0;
+}
+
+static void
+chacha20_queue_add(struct chacha20_queue_t* q, const uint32_t state[16],
+    uint32_t counter, uint8_t* dst, size_t len, bool copy)
+{
+    size_t l = q->lanes++;
+    memcpy(q->in[l], state, sizeof(q->in[l]));
+    q->in[l][12] = counter;
+    q->dst[l]    = dst;
+    q->len[l]    = len;
+    q->copy[l]   = copy;
+    if (q->lanes == CHACHA20_LANES)
+    {
+        chacha20_queue_flush(q);
+    }
+}
+
+/* the key stream of a job from block 1 on, XORed into its buffer */
+static void
+chacha20_queue_stream(struct chacha20_queue_t* q, const uint32_t state[16],
+    uint8_t* buf, size_t len)
+{
+    for (uint32_t counter = 1; len > 0; counter++)
+    {
+        size_t n = len < 64 ? len : 64;
+        chacha20_queue_add(q, state, counter, buf, n, false);
+        buf += n;
+        len -= n;
+    }
+}
+
+static void
+chacha20_setup(uint32_t state[16], const uint8_t key[32],
+    const uint8_t nonce[12])
+{
+    state[0] = 0x61707865; /* "expand 32-byte k" */
+    state[1] = 0x3320646e;
+    state[2] = 0x79622d32;
+    state[3] = 0x6b206574;
+    for (int i = 0; i < 8; i++)
+    {
+        state[4 + i] = load32(&key[4 * i]);
+    }
+    state[12] = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        state[13 + i] = load32(&nonce[4 * i]);
+    }
+}
+
+/* XOR buf with the key stream from block 1 on; block 0 keys Poly1305 */
+static void
+chacha20_xor(uint32_t state[16], uint8_t* buf, size_t len)
+{
+    uint8_t stream[64];
+
+    for (state[12] = 1; len > 0; state[12]++)
+    {
+        size_t n = len < sizeof(stream) ? len : sizeof(stream);
+        chacha20_block(state, stream);
+        for (size_t i = 0; i < n; i++)
+        {
+            buf[i] ^= stream[i];
+        }
+        buf += n;
+        len -= n;
+    }
+}
+
+/* Poly1305 in 26-bit limbs, on 16-byte blocks */
+struct poly1305_t
+{
+    uint32_t r[5];
+    uint32_t h[5];
+    uint32_t pad[4];
+};
+
+static void
+poly1305_init(struct poly1305_t* st, const uint8_t key[32])
+{
+    st->r[0] = load32(&key[0]) & 0x3ffffff;
+    st->r[1] = (load32(&key[3]) >> 2) & 0x3ffff03;
+    st->r[2] = (load32(&key[6]) >> 4) & 0x3ffc0ff;
+    st->r[3] = (load32(&key[9]) >> 6) & 0x3f03fff;
+    st->r[4] = (load32(&key[12]) >> 8) & 0x00fffff;
+    memset(st->h, 0, sizeof(st->h));
+    for (int i = 0; i < 4; i++)
+    {
+        st->pad[i] = load32(&key[16 + 4 * i]);
+    }
+}
+
+static void
+poly1305_blocks(struct poly1305_t* st, const uint8_t* m, size_t blocks)
+{
+    const uint32_t r0 = st->r[0], r1 = st->r[1], r2 = st->r[2],
+                   r3 = st->r[3], r4 = st->r[4];
+    const uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+    uint32_t h0 = st->h[0], h1 = st->h[1], h2 = st->h[2], h3 = st->h[3],
+             h4 = st->h[4];
+
+    for (; blocks > 0; blocks--, m += 16)
+    {
+        h0 += load32(&m[0]) & 0x3ffffff;
+        h1 += (load32(&m[3]) >> 2) & 0x3ffffff;
+        h2 += (load32(&m[6]) >> 4) & 0x3ffffff;
+        h3 += (load32(&m[9]) >> 6) & 0x3ffffff;
+        h4 += (load32(&m[12]) >> 8) | (1u << 24);
+
+        uint64_t d0 = (uint64_t)h0 * r0 + (uint64_t)h1 * s4
+            + (uint64_t)h2 * s3 + (uint64_t)h3 * s2 + (uint64_t)h4 * s1;
+        uint64_t d1 = (uint64_t)h0 * r1 + (uint64_t)h1 * r0
+            + (uint64_t)h2 * s4 + (uint64_t)h3 * s3 + (uint64_t)h4 * s2;
+        uint64_t d2 = (uint64_t)h0 * r2 + (uint64_t)h1 * r1
+            + (uint64_t)h2 * r0 + (uint64_t)h3 * s4 + (uint64_t)h4 * s3;
+        uint64_t d3 = (uint64_t)h0 * r3 + (uint64_t)h1 * r2
+            + (uint64_t)h2 * r1 + (uint64_t)h3 * r0 + (uint64_t)h4 * s4;
+        uint64_t d4 = (uint64_t)h0 * r4 + (uint64_t)h1 * r3
+            + (uint64_t)h2 * r2 + (uint64_t)h3 * r1 + (uint64_t)h4 * r0;
+
+        uint32_t c;
+        c  = (uint32_t)(d0 >> 26);
+        h0 = (uint32_t)d0 & 0x3ffffff;
+        d1 += c;
+        c  = (uint32_t)(d1 >> 26);
+        h1 = (uint32_t)d1 & 0x3ffffff;
+        d2 += c;
+        c  = (uint32_t)(d2 >> 26);
+        h2 = (uint32_t)d2 & 0x3ffffff;
+        d3 += c;
+        c  = (uint32_t)(d3 >> 26);
+        h3 = (uint32_t)d3 & 0x3ffffff;
+        d4 += c;
+        c  = (uint32_t)(d4 >> 26);
+        h4 = (uint32_t)d4 & 0x3ffffff;
+        h0 += c * 5;
+        c  = h0 >> 26;
+        h0 &= 0x3ffffff;
+        h1 += c;
+    }
+
+    st->h[0] = h0;
+    st->h[1] = h1;
+    st->h[2] = h2;
+    st->h[3] = h3;
+    st->h[4] = h4;
+}
+
+/* the AEAD pads every part with zeros to a whole block */
+static void
+poly1305_pad16(struct poly1305_t* st, const uint8_t* m, size_t len)
+{
+    poly1305_blocks(st, m, len / 16);
+    if (len % 16 != 0)
+    {
+        uint8_t block[16] = { 0 };
+        memcpy(block, &m[len & ~(size_t)15], len % 16);
+        poly1305_blocks(st, block, 1);
+    }
+}
+
+static void
+poly1305_finish(struct poly1305_t* st, uint8_t tag[16])
+{
+    uint32_t h0 = st->h[0], h1 = st->h[1], h2 = st->h[2], h3 = st->h[3],
+             h4 = st->h[4];
+    uint32_t c, g0, g1, g2, g3, g4, mask;
+    uint64_t f;
+
+    c  = h1 >> 26;
+    h1 &= 0x3ffffff;
+    h2 += c;
+    c  = h2 >> 26;
+    h2 &= 0x3ffffff;
+    h3 += c;
+    c  = h3 >> 26;
+    h3 &= 0x3ffffff;
+    h4 += c;
+    c  = h4 >> 26;
+    h4 &= 0x3ffffff;
+    h0 += c * 5;
+    c  = h0 >> 26;
+    h0 &= 0x3ffffff;
+    h1 += c;
+
+    /* h - p, and pick it in constant time if it did not underflow */
+    g0 = h0 + 5;
+    c  = g0 >> 26;
+    g0 &= 0x3ffffff;
+    g1 = h1 + c;
+    c  = g1 >> 26;
+    g1 &= 0x3ffffff;
+    g2 = h2 + c;
+    c  = g2 >> 26;
+    g2 &= 0x3ffffff;
+    g3 = h3 + c;
+    c  = g3 >> 26;
+    g3 &= 0x3ffffff;
+    g4 = h4 + c - (1u << 26);
+
+    mask = (g4 >> 31) - 1;
+    h0   = (h0 & ~mask) | (g0 & mask);
+    h1   = (h1 & ~mask) | (g1 & mask);
+    h2   = (h2 & ~mask) | (g2 & mask);
+    h3   = (h3 & ~mask) | (g3 & mask);
+    h4   = (h4 & ~mask) | (g4 & mask);
+
+    h0 = h0 | h1 << 26;
+    h1 = h1 >> 6 | h2 << 20;
+    h2 = h2 >> 12 | h3 << 14;
+    h3 = h3 >> 18 | h4 << 8;
+
+    f = (uint64_t)h0 + st->pad[0];
+    store32(&tag[0], (uint32_t)f);
+    f = (uint64_t)h1 + st->pad[1] + (f >> 32);
+    store32(&tag[4], (uint32_t)f);
+    f = (uint64_t)h2 + st->pad[2] + (f >> 32);
+    store32(&tag[8], (uint32_t)f);
+    f = (uint64_t)h3 + st->pad[3] + (f >> 32);
+    store32(&tag[12], (uint32_t)f);
+}
+
+static void
+poly1305_tag(const uint8_t key[32], const uint8_t* ad, size_t ad_len,
+    const uint8_t* buf, size_t len, uint8_t tag[16])
+{
+    struct poly1305_t st;
+    uint8_t           lengths[16];
+
+    poly1305_init(&st, key);
+    poly1305_pad16(&st, ad, ad_len);
+    poly1305_pad16(&st, buf, len);
+    store32(&lengths[0], (uint32_t)ad_len);
+    store32(&lengths[4], (uint32_t)((uint64_t)ad_len >> 32));
+    store32(&lengths[8], (uint32_t)len);
+    store32(&lengths[12], (uint32_t)((uint64_t)len >> 32));
+    poly1305_blocks(&st, lengths, 1);
+    poly1305_finish(&st, tag);
+}
+
+static void
+chacha20poly1305_tag(uint32_t state[16], const uint8_t* ad, size_t ad_len,
+    const uint8_t* buf, size_t len, uint8_t tag[16])
+{
+    uint8_t block0[64];
+
+    state[12] = 0;
+    chacha20_block(state, block0);
+    poly1305_tag(block0, ad, ad_len, buf, len, tag);
+}
+
+static bool
+tag_equal(const uint8_t* a, const uint8_t* b)
+{
+    uint8_t diff = 0;
+    for (int i = 0; i < CHACHA20POLY1305_TAG_LEN; i++)
+    {
+        diff |= a[i] ^ b[i];
+    }
+    return diff == 0;
+}
+
+void
+chacha20poly1305_seal(const uint8_t key[CHACHA20POLY1305_KEY_LEN],
+    const uint8_t nonce[CHACHA20POLY1305_NONCE_LEN], const uint8_t* ad,
+    size_t ad_len, uint8_t* buf, size_t len,
+    uint8_t tag[CHACHA20POLY1305_TAG_LEN])
+{
+    uint32_t state[16];
+
+    chacha20_setup(state, key, nonce);
+    chacha20_xor(state, buf, len);
+    chacha20poly1305_tag(state, ad, ad_len, buf, len, tag);
+}
+
+bool
+chacha20poly1305_open(const uint8_t key[CHACHA20POLY1305_KEY_LEN],
+    const uint8_t nonce[CHACHA20POLY1305_NONCE_LEN], const uint8_t* ad,
+    size_t ad_len, uint8_t* buf, size_t len,
+    const uint8_t tag[CHACHA20POLY1305_TAG_LEN])
+{
+    uint32_t state[16];
+    uint8_t  expected[CHACHA20POLY1305_TAG_LEN];
+
+    chacha20_setup(state, key, nonce);
+    chacha20poly1305_tag(state, ad, ad_len, buf, len, expected);
+    if (!tag_equal(expected, tag))
+    {
+        return false;
+    }
+    chacha20_xor(state, buf, len);
+    return true;
+}
+
+/* jobs are set up this many at a time */
+#define CHACHA20POLY1305_BATCH 16
+
+void
+chacha20poly1305_seal_batch(struct chacha20poly1305_job_t* jobs, size_t n)
+{
+    struct chacha20_queue_t q = { .lanes = 0 };
+    uint32_t                state[CHACHA20POLY1305_BATCH][16];
+    uint8_t                 otk[CHACHA20POLY1305_BATCH][32];
+
+    for (; n > 0; jobs += CHACHA20POLY1305_BATCH)
+    {
+        size_t m = n < CHACHA20POLY1305_BATCH ? n : CHACHA20POLY1305_BATCH;
+        n -= m;
+
+        for (size_t j = 0; j < m; j++)
+        {
+            chacha20_setup(state[j], jobs[j].key, jobs[j].nonce);
+            chacha20_queue_add(&q, state[j], 0, otk[j], sizeof(otk[j]), true);
+            chacha20_queue_stream(&q, state[j], jobs[j].buf, jobs[j].len);
+        }
+        chacha20_queue_flush(&q);
+        for (size_t j = 0; j < m; j++)
+        {
+            poly1305_tag(otk[j], jobs[j].ad, jobs[j].ad_len, jobs[j].buf,
+                jobs[j].len, jobs[j].tag);
+        }
+    }
+}
+
+void
+chacha20poly1305_open_batch(struct chacha20poly1305_job_t* jobs, size_t n)
+{
+    struct chacha20_queue_t q = { .lanes = 0 };
+    uint32_t                state[CHACHA20POLY1305_BATCH][16];
+    uint8_t                 otk[CHACHA20POLY1305_BATCH][32];
+    uint8_t                 expected[CHACHA20POLY1305_TAG_LEN];
+
+    for (; n > 0; jobs += CHACHA20POLY1305_BATCH)
+    {
+        size_t m = n < CHACHA20POLY1305_BATCH ? n : CHACHA20POLY1305_BATCH;
+        n -= m;
+
+        /* check every tag first, then decrypt the frames that passed */
+        for (size_t j = 0; j < m; j++)
+        {
+            chacha20_setup(state[j], jobs[j].key, jobs[j].nonce);
+            chacha20_queue_add(&q, state[j], 0, otk[j], sizeof(otk[j]), true);
+        }
+        chacha20_queue_flush(&q);
+        for (size_t j = 0; j < m; j++)
+        {
+            poly1305_tag(otk[j], jobs[j].ad, jobs[j].ad_len, jobs[j].buf,
+                jobs[j].len, expected);
+            jobs[j].ok = tag_equal(expected, jobs[j].tag);
+            if (jobs[j].ok)
+            {
+                chacha20_queue_stream(&q, state[j], jobs[j].buf, jobs[j].len);
+            }
+        }
+        chacha20_queue_flush(&q);
+    }
+}
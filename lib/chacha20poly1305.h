@@ -0,0 +1,50 @@
+#ifndef _CHACHA20POLY1305_H_
+#define _CHACHA20POLY1305_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * ChaCha20-Poly1305 AEAD (RFC 8439), in place.
+ *
+ * Portable C on 32-bit words: it needs no AES instructions, which the
+ * Raspberry Pi's Cortex-A72 does not have. Batches run four key stream
+ * blocks at once with SSE2 or NEON.
+ */
+
+#define CHACHA20POLY1305_KEY_LEN   32
+#define CHACHA20POLY1305_NONCE_LEN 12
+#define CHACHA20POLY1305_TAG_LEN   16
+
+void chacha20poly1305_seal(const uint8_t key[CHACHA20POLY1305_KEY_LEN],
+    const uint8_t nonce[CHACHA20POLY1305_NONCE_LEN], const uint8_t* ad,
+    size_t ad_len, uint8_t* buf, size_t len,
+    uint8_t tag[CHACHA20POLY1305_TAG_LEN]);
+
+/* false, and buf untouched, if the tag does not match */
+bool chacha20poly1305_open(const uint8_t key[CHACHA20POLY1305_KEY_LEN],
+    const uint8_t nonce[CHACHA20POLY1305_NONCE_LEN], const uint8_t* ad,
+    size_t ad_len, uint8_t* buf, size_t len,
+    const uint8_t tag[CHACHA20POLY1305_TAG_LEN]);
+
+/*
+ * One of a batch of independent seals or opens. The key streams of a batch
+ * are computed several blocks at a time, in the SIMD lanes of the CPU.
+ */
+struct chacha20poly1305_job_t
+{
+    const uint8_t* key;
+    const uint8_t* nonce;
+    const uint8_t* ad;
+    size_t         ad_len;
+    uint8_t*       buf;
+    size_t         len;
+    uint8_t*       tag; /* written by seal, checked by open */
+    bool           ok;  /* open: the tag matched and buf is decrypted */
+};
+
+void chacha20poly1305_seal_batch(struct chacha20poly1305_job_t* jobs, size_t n);
+void chacha20poly1305_open_batch(struct chacha20poly1305_job_t* jobs, size_t n);
+
+#endif /* _CHACHA20POLY1305_H_ */
@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
@@ -12,12 +13,39 @@
 #include <certikos/macros.h>
 
 #ifdef _STD_LIBC_
+#include <sys/eventfd.h>
+#include <unistd.h>
+
 static inline unsigned long long time_us(void)
 {
     struct timespec ts;
     clock_gettime(CLOCK_MONOTONIC, &ts);
     return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
 }
+
+/* eventfd used by the threaded sources to wake an event-driven pipeline */
+static inline int event_create(void)
+{
+    return eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+static inline void event_notify(int fd)
+{
+    uint64_t one = 1;
+    if (fd != -1 && write(fd, &one, sizeof(one)) < 0)
+    {
+        /* counter saturated, the reader is already woken up */
+    }
+}
+
+static inline void event_clear(int fd)
+{
+    uint64_t count;
+    if (fd != -1 && read(fd, &count, sizeof(count)) < 0)
+    {
+        /* EAGAIN: nothing pending */
+    }
+}
 #endif /* _STD_LIBC_ */
 
 #ifdef _CERTIKOS_
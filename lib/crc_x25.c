@@ -0,0 +1,410 @@
+#include "crc_x25.h"
+#include "secure_gateway.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define CRC_X25_HAS_CLMUL
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__GNUC__) && defined(_STD_LIBC_)
+#define CRC_X25_HAS_CLMUL
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#ifndef HWCAP_PMULL
+#define HWCAP_PMULL (1 << 4)
+#endif
+#endif
+
+#define CRC_X25_POLY 0x8408 /* 0x1021 reflected */
+
+static uint16_t crc_x25_table[8][256];
+static bool     crc_x25_ready;
+
+/*
+ * Zero bytes fed into a CRC act on it linearly: crc_x25_zeros[k][0][i] and
+ * crc_x25_zeros[k][1][i] are what its low and high byte i turn into after
+ * 2^k of them. Frames need no more than 2^9.
+ */
+#define CRC_X25_ZERO_POWERS 9
+static uint16_t crc_x25_zeros[CRC_X25_ZERO_POWERS][2][256];
+
+static uint16_t crc_x25_slice8(uint16_t crc, const uint8_t* buf, size_t len);
+static crc_x25_fn_t        crc_x25_impl = crc_x25_slice8;
+static enum crc_x25_impl_t crc_x25_impl_id = CRC_X25_IMPL_SLICE8;
+
+static uint16_t
+crc_x25_bytewise(uint16_t crc, const uint8_t* buf, size_t len)
+{
+    crc_accumulate_buffer(&crc, (const char*)buf, (uint16_t)len);
+    return crc;
+}
+
+static inline uint16_t
+crc_x25_table_update(uint16_t crc, const uint8_t* buf, size_t len)
+{
+    while (len--)
+    {
+        crc = (crc >> 8) ^ crc_x25_table[0][(crc ^ *buf++) & 0xFF];
+    }
+    return crc;
+}
+
+/*
+ * Slicing-by-8: table[k][i] is the CRC of byte i followed by k zero bytes,
+ * so eight bytes are folded in with eight independent lookups.
+ */
+static uint16_t
+crc_x25_slice8(uint16_t crc, const uint8_t* buf, size_t len)
+{
+    while (len >= 8)
+    {
+        uint16_t lo = crc ^ (buf[0] | (buf[1] << 8));
+        crc         = crc_x25_table[7][lo & 0xFF] ^ crc_x25_table[6][lo >> 8]
+            ^ crc_x25_table[5][buf[2]] ^ crc_x25_table[4][buf[3]]
+            ^ crc_x25_table[3][buf[4]] ^ crc_x25_table[2][buf[5]]
+            ^ crc_x25_table[1][buf[6]] ^ crc_x25_table[0][buf[7]];
+        buf += 8;
+        len -= 8;
+    }
+    return crc_x25_table_update(crc, buf, len);
+}
+
+#ifdef CRC_X25_HAS_CLMUL
+/*
+ * Carry-less multiply folding, 16 bytes at a time.
+ *
+ * In the reflected domain bit j of a little-endian 128-bit block is the
+ * coefficient of x^(127 - j). Folding the accumulator A = H x^64 + L over
+ * the next block N gives A x^128 + N = H x^192 + L x^128 + N, and reducing
+ * the constants mod P keeps everything in 128 bits. A carry-less product of
+ * two reflected 64-bit operands comes out one degree short in reflected
+ * 128-bit form, so the constants are x^191 and x^127 mod P. Each is stored
+ * reflected in a 64-bit lane: the x^d term at bit 63 - d.
+ *
+ * The 16 accumulated bytes are then run through the table with a zero CRC,
+ * which is the same as reducing them, and the tail follows.
+ */
+#define CRC_X25_CLMUL_MIN_LEN 32
+
+static uint64_t crc_x25_k_hi; /* x^191 mod P, multiplies the low qword */
+static uint64_t crc_x25_k_lo; /* x^127 mod P, multiplies the high qword */
+
+static uint64_t
+crc_x25_clmul_constant(unsigned n)
+{
+    /* x^n mod P, P = x^16 + x^12 + x^5 + 1, in normal bit order */
+    uint32_t r = 1;
+    for (unsigned i = 0; i < n; i++)
+    {
+        r <<= 1;
+        if (r & 0x10000)
+        {
+            r ^= 0x11021;
+        }
+    }
+
+    uint64_t k = 0;
+    for (unsigned d = 0; d < 16; d++)
+    {
+        if (r & (1u << d))
+        {
+            k |= 1ULL << (63 - d);
+        }
+    }
+    return k;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("pclmul,sse4.1"))) static uint16_t
+crc_x25_clmul(uint16_t crc, const uint8_t* buf, size_t len)
+{
+    if (len < CRC_X25_CLMUL_MIN_LEN)
+    {
+        return crc_x25_slice8(crc, buf, len);
+    }
+
+    const __m128i k = _mm_set_epi64x(
+        (long long)crc_x25_k_lo, (long long)crc_x25_k_hi);
+    __m128i a = _mm_loadu_si128((const __m128i*)buf);
+    a         = _mm_xor_si128(a, _mm_cvtsi32_si128(crc));
+    buf += 16;
+    len -= 16;
+
+    while (len >= 16)
+    {
+        __m128i n = _mm_loadu_si128((const __m128i*)buf);
+        __m128i h = _mm_clmulepi64_si128(a, k, 0x00);
+        __m128i l = _mm_clmulepi64_si128(a, k, 0x11);
+        a         = _mm_xor_si128(n, _mm_xor_si128(h, l));
+        buf += 16;
+        len -= 16;
+    }
+
+    uint8_t folded[16];
+    _mm_storeu_si128((__m128i*)folded, a);
+    crc = crc_x25_slice8(0, folded, sizeof(folded));
+    return crc_x25_slice8(crc, buf, len);
+}
+
+static bool
+crc_x25_clmul_supported(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+}
+#else /* __aarch64__ */
+__attribute__((target("+crypto"))) static uint16_t
+crc_x25_clmul(uint16_t crc, const uint8_t* buf, size_t len)
+{
+    if (len < CRC_X25_CLMUL_MIN_LEN)
+    {
+        return crc_x25_slice8(crc, buf, len);
+    }
+
+    const poly64x2_t k = vcombine_p64(
+        vcreate_p64(crc_x25_k_hi), vcreate_p64(crc_x25_k_lo));
+    uint8x16_t a = vld1q_u8(buf);
+    a = veorq_u8(a, vreinterpretq_u8_u64(vcombine_u64(
+                        vcreate_u64(crc), vcreate_u64(0))));
+    buf += 16;
+    len -= 16;
+
+    while (len >= 16)
+    {
+        poly64x2_t ap = vreinterpretq_p64_u8(a);
+        uint8x16_t h  = vreinterpretq_u8_p128(vmull_p64(
+            vgetq_lane_p64(ap, 0), vgetq_lane_p64(k, 0)));
+        uint8x16_t l = vreinterpretq_u8_p128(vmull_high_p64(ap, k));
+        a            = veorq_u8(vld1q_u8(buf), veorq_u8(h, l));
+        buf += 16;
+        len -= 16;
+    }
+
+    uint8_t folded[16];
+    vst1q_u8(folded, a);
+    crc = crc_x25_slice8(0, folded, sizeof(folded));
+    return crc_x25_slice8(crc, buf, len);
+}
+
+static bool
+crc_x25_clmul_supported(void)
+{
+    return (getauxval(AT_HWCAP) & HWCAP_PMULL) != 0;
+}
+#endif
+#endif /* CRC_X25_HAS_CLMUL */
+
+static inline uint16_t
+crc_x25_zeros_apply(unsigned k, uint16_t crc)
+{
+    return crc_x25_zeros[k][0][crc & 0xFF] ^ crc_x25_zeros[k][1][crc >> 8];
+}
+
+void
+crc_x25_init(void)
+{
+    if (crc_x25_ready)
+    {
+        return;
+    }
+
+    for (unsigned i = 0; i < 256; i++)
+    {
+        uint16_t crc = (uint16_t)i;
+        for (unsigned bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC_X25_POLY : crc >> 1;
+        }
+        crc_x25_table[0][i] = crc;
+    }
+    for (unsigned k = 1; k < 8; k++)
+    {
+        for (unsigned i = 0; i < 256; i++)
+        {
+            uint16_t prev          = crc_x25_table[k - 1][i];
+            crc_x25_table[k][i]    = (prev >> 8) ^ crc_x25_table[0][prev & 0xFF];
+        }
+    }
+
+    for (unsigned i = 0; i < 256; i++)
+    {
+        crc_x25_zeros[0][0][i] = crc_x25_table[0][i];
+        crc_x25_zeros[0][1][i] = (uint16_t)i;
+    }
+    for (unsigned k = 1; k < CRC_X25_ZERO_POWERS; k++)
+    {
+        for (unsigned i = 0; i < 256; i++)
+        {
+            crc_x25_zeros[k][0][i] = crc_x25_zeros_apply(
+                k - 1, crc_x25_zeros_apply(k - 1, (uint16_t)i));
+            crc_x25_zeros[k][1][i] = crc_x25_zeros_apply(
+                k - 1, crc_x25_zeros_apply(k - 1, (uint16_t)(i << 8)));
+        }
+    }
+
+#ifdef CRC_X25_HAS_CLMUL
+    crc_x25_k_hi = crc_x25_clmul_constant(191);
+    crc_x25_k_lo = crc_x25_clmul_constant(127);
+    if (crc_x25_clmul_supported())
+    {
+        crc_x25_impl    = crc_x25_clmul;
+        crc_x25_impl_id = CRC_X25_IMPL_CLMUL;
+    }
+#endif
+
+    crc_x25_ready = true;
+}
+
+uint16_t
+crc_x25_update(uint16_t crc, const uint8_t* buf, size_t len)
+{
+    return crc_x25_impl(crc, buf, len);
+}
+
+/**
+ * The change of the CRC of a buffer when len of its bytes, followed by
+ * trailing others, are XORed with delta: a CRC of delta alone, carried
+ * past the trailing bytes in log(trailing) steps.
+ */
+uint16_t
+crc_x25_delta(const uint8_t* delta, size_t len, size_t trailing)
+{
+    uint16_t crc = crc_x25_impl(0, delta, len);
+    unsigned k   = 0;
+
+    for (; trailing != 0 && k < CRC_X25_ZERO_POWERS - 1; k++, trailing >>= 1)
+    {
+        if (trailing & 1)
+        {
+            crc = crc_x25_zeros_apply(k, crc);
+        }
+    }
+    /* what is left is in multiples of the largest power */
+    for (; trailing != 0; trailing--)
+    {
+        crc = crc_x25_zeros_apply(k, crc);
+    }
+    return crc;
+}
+
+crc_x25_fn_t
+crc_x25_get_impl(enum crc_x25_impl_t impl)
+{
+    switch (impl)
+    {
+    case CRC_X25_IMPL_BYTEWISE: return crc_x25_bytewise;
+    case CRC_X25_IMPL_SLICE8: return crc_x25_slice8;
+#ifdef CRC_X25_HAS_CLMUL
+    case CRC_X25_IMPL_CLMUL:
+        return crc_x25_clmul_supported() ? crc_x25_clmul : NULL;
+#endif
+    default: return NULL;
+    }
+}
+
+enum crc_x25_impl_t
+crc_x25_active_impl(void)
+{
+    return crc_x25_impl_id;
+}
+
+const char*
+crc_x25_impl_name(enum crc_x25_impl_t impl)
+{
+    switch (impl)
+    {
+    case CRC_X25_IMPL_BYTEWISE: return "bytewise";
+    case CRC_X25_IMPL_SLICE8: return "slice8";
+    case CRC_X25_IMPL_CLMUL: return "clmul";
+    default: return "unknown";
+    }
+}
+
+/*
+ * mavlink_finalize_message_buffer() with the header and payload checksummed
+ * in one pass. The tx sequence is taken from (and advanced in) msg->status.
+ * Outgoing signing is not supported, as in the rest of the gateway.
+ */
+uint16_t
+message_finalize(struct message_t* msg, uint8_t system_id,
+    uint8_t component_id, uint8_t min_length, uint8_t length,
+    uint8_t crc_extra)
+{
+    mavlink_message_t* m        = &msg->msg;
+    bool               mavlink1 = (msg->status.flags
+                          & MAVLINK_STATUS_FLAG_OUT_MAVLINK1) != 0;
+    uint8_t  header[MAVLINK_CORE_HEADER_MAVLINK1_LEN + 1];
+    uint8_t  header_len;
+    uint16_t crc;
+
+    m->magic          = mavlink1 ? MAVLINK_STX_MAVLINK1 : MAVLINK_STX;
+    m->len            = mavlink1 ? min_length
+                                 : _mav_trim_payload(_MAV_PAYLOAD(m), length);
+    m->sysid          = system_id;
+    m->compid         = component_id;
+    m->incompat_flags = 0;
+    m->compat_flags   = 0;
+    m->seq            = msg->status.current_tx_seq++;
+
+    if (mavlink1)
+    {
+        header_len = MAVLINK_CORE_HEADER_MAVLINK1_LEN + 1;
+        header[0]  = m->magic;
+        header[1]  = m->len;
+        header[2]  = m->seq;
+        header[3]  = m->sysid;
+        header[4]  = m->compid;
+        header[5]  = m->msgid & 0xFF;
+        crc        = crc_x25_update(X25_INIT_CRC, &header[1], header_len - 1);
+        crc = crc_x25_update(crc, (const uint8_t*)_MAV_PAYLOAD(m), m->len);
+    }
+    else
+    {
+        /* the v2 header is in wire order right in front of the payload */
+        header_len = MAVLINK_CORE_HEADER_LEN + 1;
+        crc        = crc_x25_update(
+            X25_INIT_CRC, &m->len, header_len - 1 + m->len);
+    }
+    crc_accumulate(crc_extra, &crc);
+
+    mavlink_ck_a(m) = (uint8_t)(crc & 0xFF);
+    mavlink_ck_b(m) = (uint8_t)(crc >> 8);
+    m->checksum     = crc;
+    return m->len + header_len + MAVLINK_NUM_CHECKSUM_BYTES;
+}
+
+/**
+ * The change of the checksum of msg when len payload bytes from offset on
+ * are XORed with delta, see message_patch().
+ */
+uint16_t
+message_crc_delta(const struct message_t* msg, size_t offset,
+    const uint8_t* delta, size_t len)
+{
+    ASSERT(offset + len <= msg->msg.len && "patch is out of the payload");
+
+    /* crc_extra follows the payload */
+    return crc_x25_delta(delta, len, msg->msg.len - offset - len + 1);
+}
+
+/**
+ * For transforms that rewrite payload bytes in place: update the checksum
+ * by crc_delta, as message_crc_delta() gives it, and leave the header
+ * alone. False if msg has to be finalized instead, as it is signed, or a
+ * MAVLink 2 payload now ends in zeros and has to be trimmed.
+ */
+bool
+message_patch(struct message_t* msg, uint16_t crc_delta)
+{
+    mavlink_message_t* m = &msg->msg;
+
+    if (m->magic == MAVLINK_STX
+        && ((m->incompat_flags & MAVLINK_IFLAG_SIGNED) != 0
+            || (m->len > 0 && _MAV_PAYLOAD(m)[m->len - 1] == 0)))
+    {
+        return false;
+    }
+
+    m->checksum ^= crc_delta;
+    mavlink_ck_a(m) = (uint8_t)(m->checksum & 0xFF);
+    mavlink_ck_b(m) = (uint8_t)(m->checksum >> 8);
+    return true;
+}
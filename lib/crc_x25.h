@@ -0,0 +1,41 @@
+#ifndef _CRC_X25_H_
+#define _CRC_X25_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * MAVLink X.25 CRC (CRC-16/MCRF4XX: reflected 0x1021, no final xor) over
+ * whole buffers. Equivalent to crc_accumulate_buffer() from checksum.h:
+ *
+ *     crc = crc_x25_update(crc, buf, len);
+ *
+ * crc_x25_init() builds the tables and picks the fastest implementation the
+ * CPU supports (PCLMULQDQ on x86-64, PMULL on AArch64, slicing-by-8
+ * otherwise); it is called from pipeline_init().
+ *
+ * The CRC is linear: when bytes of a checksummed buffer are XORed with
+ * delta, its CRC changes by crc_x25_delta(delta, len, trailing), where
+ * trailing is the number of bytes that follow them, whatever comes before.
+ */
+
+enum crc_x25_impl_t
+{
+    CRC_X25_IMPL_BYTEWISE = 0, /* checksum.h reference */
+    CRC_X25_IMPL_SLICE8,
+    CRC_X25_IMPL_CLMUL,
+
+    MAX_CRC_X25_IMPLS
+};
+
+void     crc_x25_init(void);
+uint16_t crc_x25_update(uint16_t crc, const uint8_t* buf, size_t len);
+uint16_t crc_x25_delta(const uint8_t* delta, size_t len, size_t trailing);
+
+/* for benchmarks and tests, returns NULL if not supported on this CPU */
+typedef uint16_t (*crc_x25_fn_t)(uint16_t crc, const uint8_t* buf, size_t len);
+crc_x25_fn_t        crc_x25_get_impl(enum crc_x25_impl_t impl);
+enum crc_x25_impl_t crc_x25_active_impl(void);
+const char*         crc_x25_impl_name(enum crc_x25_impl_t impl);
+
+#endif /* _CRC_X25_H_ */
@@ -0,0 +1,422 @@
+#include "frame_scanner.h"
+#include "crc_x25.h"
+
+static size_t
+frame_scanner_find(const struct frame_scanner_t* sc, uint8_t stx)
+{
+    const uint8_t* p = memchr(&sc->buf[sc->pos], stx, sc->len - sc->pos);
+    return p != NULL ? (size_t)(p - sc->buf) : sc->len;
+}
+
+void
+frame_parser_reset(struct frame_parser_t* parser)
+{
+    memset(parser, 0, sizeof(*parser));
+}
+
+static inline bool
+frame_parser_idle(const mavlink_status_t* status)
+{
+    return status->parse_state == MAVLINK_PARSE_STATE_UNINIT
+        || status->parse_state == MAVLINK_PARSE_STATE_IDLE;
+}
+
+/*
+ * Queue everything after the start-of-frame marker of a rejected frame for
+ * rescanning, ahead of the bytes that are still waiting to be rescanned.
+ * The rejected frame was read from replay[] if anything is left there, so
+ * the result never outgrows the buffer.
+ */
+static void
+frame_parser_requeue(struct frame_parser_t* parser)
+{
+    size_t keep = parser->replay_len - parser->replay_pos;
+    size_t redo = parser->raw_len > 0 ? parser->raw_len - 1 : 0;
+
+    ASSERT(redo + keep <= sizeof(parser->replay) && "resync overflow");
+    memmove(&parser->replay[redo], &parser->replay[parser->replay_pos], keep);
+    memcpy(parser->replay, &parser->raw[1], redo);
+    parser->replay_pos = 0;
+    parser->replay_len = (uint16_t)(redo + keep);
+    parser->raw_len    = 0;
+}
+
+/* hand the bytes of raw[] that the tap has not seen yet to it */
+static void
+frame_parser_tap(struct frame_parser_t* parser)
+{
+    if (parser->raw_len > parser->tapped)
+    {
+        parser->tap(parser->tap_arg, &parser->raw[parser->tapped],
+            parser->raw_len - parser->tapped, parser->tapped);
+    }
+    parser->tapped = 0;
+}
+
+/*
+ * End of input: stream out what has arrived of the frame in progress, once
+ * its header (and so its message id) is complete.
+ */
+void
+frame_parser_flush(struct frame_parser_t* parser)
+{
+    size_t hdr;
+
+    if (parser->tap == NULL || frame_parser_idle(&parser->status)
+        || parser->raw_len <= parser->tapped)
+    {
+        return;
+    }
+
+    hdr = parser->raw[0] == MAVLINK_STX_MAVLINK1 ? FRAME_V1_HEADER_LEN
+                                                 : FRAME_V2_HEADER_LEN;
+    if (parser->raw_len >= hdr)
+    {
+        parser->tap(parser->tap_arg, &parser->raw[parser->tapped],
+            parser->raw_len - parser->tapped, parser->tapped);
+        parser->tapped = parser->raw_len;
+    }
+}
+
+static uint8_t
+frame_parser_feed(struct frame_parser_t* parser, uint8_t c, bool replayed,
+    mavlink_message_t* r_message, mavlink_status_t* r_status)
+{
+    mavlink_status_t* status = &parser->status;
+    bool              busy   = !frame_parser_idle(status);
+
+    if (parser->resync || parser->tap != NULL)
+    {
+        if (!busy)
+        {
+            parser->raw_len      = 0;
+            parser->raw_replayed = replayed;
+        }
+        if (parser->raw_len < sizeof(parser->raw))
+        {
+            parser->raw[parser->raw_len++] = c;
+        }
+    }
+
+    uint8_t rv = mavlink_frame_char_buffer(
+        &parser->rxmsg, status, c, r_message, r_status);
+
+    if (rv == MAVLINK_FRAMING_BAD_CRC || rv == MAVLINK_FRAMING_BAD_SIGNATURE)
+    {
+        _mav_parse_error(status);
+        status->msg_received = MAVLINK_FRAMING_INCOMPLETE;
+        status->parse_state  = MAVLINK_PARSE_STATE_IDLE;
+        if (parser->tapped > 0)
+        {
+            /* already on its way, let the receiver reject it */
+            frame_parser_tap(parser);
+        }
+        if (parser->resync)
+        {
+            frame_parser_requeue(parser);
+        }
+        else
+        {
+            parser->raw_len = 0;
+            if (c == MAVLINK_STX)
+            {
+                status->parse_state = MAVLINK_PARSE_STATE_GOT_STX;
+                parser->rxmsg.len   = 0;
+                parser->raw[parser->raw_len++] = c;
+                mavlink_start_checksum(&parser->rxmsg);
+            }
+        }
+        return MAVLINK_FRAMING_INCOMPLETE;
+    }
+
+    if (rv == MAVLINK_FRAMING_OK)
+    {
+        if (parser->tap != NULL)
+        {
+            frame_parser_tap(parser);
+        }
+        if (parser->resync && parser->raw_replayed)
+        {
+            parser->resync_frames++;
+            parser->resync_bytes += parser->raw_len;
+        }
+        parser->raw_len = 0;
+    }
+    else if (parser->resync && busy && frame_parser_idle(status))
+    {
+        /* the header was rejected (bad flags or length) */
+        frame_parser_requeue(parser);
+    }
+    return rv;
+}
+
+/*
+ * mavlink_parse_char() on a caller-owned parser: a frame with a bad CRC or
+ * signature counts as a parse error and restarts the parser, picking up a
+ * start-of-frame marker in the last byte. In resync mode the parser instead
+ * restarts on the byte after the start of the rejected frame; those bytes
+ * are rescanned by the frame scanner before it continues with new input.
+ */
+uint8_t
+frame_parser_char(struct frame_parser_t* parser, uint8_t c,
+    mavlink_message_t* r_message, mavlink_status_t* r_status)
+{
+    return frame_parser_feed(parser, c, false, r_message, r_status);
+}
+
+/*
+ * Resync mode: rescan the bytes of a rejected frame, up to the next frame
+ * found among them. Returns MAVLINK_FRAMING_INCOMPLETE once they are used
+ * up; the frame scanner does this before it takes new input.
+ */
+uint8_t
+frame_parser_replay(struct frame_parser_t* parser,
+    mavlink_message_t* r_message, mavlink_status_t* r_status)
+{
+    while (parser->replay_pos < parser->replay_len)
+    {
+        if (frame_parser_feed(parser, parser->replay[parser->replay_pos++],
+                true, r_message, r_status)
+            == MAVLINK_FRAMING_OK)
+        {
+            return MAVLINK_FRAMING_OK;
+        }
+    }
+    return MAVLINK_FRAMING_INCOMPLETE;
+}
+
+void
+frame_scanner_start(struct frame_scanner_t* sc, struct frame_parser_t* parser,
+    const uint8_t* buf, size_t len, mavlink_status_t* r_status)
+{
+    sc->buf       = buf;
+    sc->len       = len;
+    sc->pos       = 0;
+    sc->parser    = parser;
+    sc->r_status  = r_status;
+    sc->drop      = NULL;
+    sc->next_stx  = frame_scanner_find(sc, MAVLINK_STX);
+    sc->next_stx1 = frame_scanner_find(sc, MAVLINK_STX_MAVLINK1);
+}
+
+static inline bool
+frame_scanner_is_dropped(const struct frame_scanner_t* sc, uint32_t msgid)
+{
+    int i = msg_index(msgid);
+    return i != MSG_INDEX_NONE && (sc->drop[i / 64] & (1ULL << (i % 64)));
+}
+
+/*
+ * Validate and copy out the complete frame at sc->pos, signed or not.
+ * Returns MAVLINK_FRAMING_INCOMPLETE if the frame is not entirely in the
+ * buffer or fails validation, in which case the byte parser takes over at
+ * the same position.
+ *
+ * Frames whose message is in the drop table are skipped by their length
+ * without a CRC check, and only the header is copied out
+ * (FRAME_SCANNER_DROPPED). The length is trusted only if the frame ends the
+ * buffer or is followed by a start-of-frame marker.
+ */
+static uint8_t
+frame_scanner_take(struct frame_scanner_t* sc, mavlink_message_t* msg)
+{
+    const uint8_t* p     = &sc->buf[sc->pos];
+    size_t         avail = sc->len - sc->pos;
+    bool           v1    = p[0] == MAVLINK_STX_MAVLINK1;
+    size_t         hdr   = v1 ? FRAME_V1_HEADER_LEN : FRAME_V2_HEADER_LEN;
+    size_t         end;
+    size_t         sig = 0;
+    uint8_t        len;
+    uint32_t       msgid;
+    uint8_t        rv = MAVLINK_FRAMING_OK;
+
+    if (avail < hdr)
+    {
+        return MAVLINK_FRAMING_INCOMPLETE;
+    }
+
+    len = p[1];
+    if (v1)
+    {
+        msgid = p[5];
+    }
+    else
+    {
+        /* unknown flags take the slow path */
+        if ((p[2] & ~MAVLINK_IFLAG_SIGNED) != 0)
+        {
+            return MAVLINK_FRAMING_INCOMPLETE;
+        }
+        if (p[2] & MAVLINK_IFLAG_SIGNED)
+        {
+            sig = MAVLINK_SIGNATURE_BLOCK_LEN;
+        }
+        msgid = p[7] | (p[8] << 8) | ((uint32_t)p[9] << 16);
+    }
+
+    end = hdr + len + MAVLINK_NUM_CHECKSUM_BYTES + sig;
+    if (avail < end)
+    {
+        return MAVLINK_FRAMING_INCOMPLETE;
+    }
+
+    if (sc->drop != NULL && frame_scanner_is_dropped(sc, msgid)
+        && (avail == end || p[end] == MAVLINK_STX
+            || p[end] == MAVLINK_STX_MAVLINK1))
+    {
+        rv = FRAME_SCANNER_DROPPED;
+    }
+    else
+    {
+        const mavlink_msg_entry_t* e = mavlink_get_msg_entry(msgid);
+        uint16_t crc = crc_x25_update(X25_INIT_CRC, &p[1], hdr - 1 + len);
+        crc_accumulate(e != NULL ? e->crc_extra : 0, &crc);
+        if (p[hdr + len] != (crc & 0xFF) || p[hdr + len + 1] != (crc >> 8))
+        {
+            return MAVLINK_FRAMING_INCOMPLETE;
+        }
+
+        msg->checksum = crc;
+        memcpy(_MAV_PAYLOAD_NON_CONST(msg), &p[hdr], len);
+        /* zero the truncated extension fields, like the byte parser does */
+        if (e != NULL && len < e->max_msg_len)
+        {
+            memset(&_MAV_PAYLOAD_NON_CONST(msg)[len], 0, e->max_msg_len - len);
+        }
+        msg->ck[0] = p[hdr + len];
+        msg->ck[1] = p[hdr + len + 1];
+        /* checked by the source's key store, if any, see signing.h */
+        memcpy(msg->signature, &p[hdr + len + MAVLINK_NUM_CHECKSUM_BYTES],
+            sig);
+
+        if (sc->parser->tap != NULL)
+        {
+            sc->parser->tap(sc->parser->tap_arg, p, end, 0);
+        }
+    }
+
+    msg->magic = p[0];
+    msg->len   = len;
+    if (v1)
+    {
+        msg->incompat_flags = 0;
+        msg->compat_flags   = 0;
+        msg->seq            = p[2];
+        msg->sysid          = p[3];
+        msg->compid         = p[4];
+    }
+    else
+    {
+        msg->incompat_flags = p[2];
+        msg->compat_flags   = p[3];
+        msg->seq            = p[4];
+        msg->sysid          = p[5];
+        msg->compid         = p[6];
+    }
+    msg->msgid = msgid;
+
+    /*
+     * same bookkeeping as mavlink_frame_char_buffer() on a good frame; an
+     * error left by frame_parser_char() on a bad CRC would have been
+     * reported and cleared by the first byte of this frame
+     */
+    mavlink_status_t* status = &sc->parser->status;
+    status->parse_error      = 0;
+    if (v1)
+    {
+        status->flags |= MAVLINK_STATUS_FLAG_IN_MAVLINK1;
+    }
+    else
+    {
+        status->flags &= ~MAVLINK_STATUS_FLAG_IN_MAVLINK1;
+    }
+    status->msg_received   = MAVLINK_FRAMING_OK;
+    status->parse_state    = MAVLINK_PARSE_STATE_IDLE;
+    status->packet_idx     = len;
+    status->current_rx_seq = msg->seq;
+    if (status->packet_rx_success_count == 0)
+    {
+        status->packet_rx_drop_count = 0;
+    }
+    status->packet_rx_success_count++;
+
+    if (sc->r_status != NULL)
+    {
+        sc->r_status->parse_state             = status->parse_state;
+        sc->r_status->packet_idx              = status->packet_idx;
+        sc->r_status->current_rx_seq          = status->current_rx_seq + 1;
+        sc->r_status->packet_rx_success_count = status->packet_rx_success_count;
+        sc->r_status->packet_rx_drop_count    = status->parse_error;
+        sc->r_status->flags                   = status->flags;
+    }
+
+    sc->pos += end;
+    return rv;
+}
+
+void
+frame_scanner_drop(struct frame_scanner_t* sc, const uint64_t* drop)
+{
+    sc->drop = drop;
+}
+
+uint8_t
+frame_scanner_next(struct frame_scanner_t* sc, mavlink_message_t* msg)
+{
+    struct frame_parser_t* parser = sc->parser;
+    mavlink_status_t*      status = &parser->status;
+
+    for (;;)
+    {
+        /* bytes of a rejected frame go before new input */
+        if (frame_parser_replay(parser, msg, sc->r_status)
+            == MAVLINK_FRAMING_OK)
+        {
+            return MAVLINK_FRAMING_OK;
+        }
+
+        if (sc->pos >= sc->len)
+        {
+            break;
+        }
+
+        /* a frame is in progress, let the byte parser finish it */
+        if (!frame_parser_idle(status))
+        {
+            if (frame_parser_char(
+                    sc->parser, sc->buf[sc->pos++], msg, sc->r_status)
+                == MAVLINK_FRAMING_OK)
+            {
+                return MAVLINK_FRAMING_OK;
+            }
+            continue;
+        }
+
+        /* skip to the next start-of-frame marker */
+        if (sc->next_stx < sc->pos)
+        {
+            sc->next_stx = frame_scanner_find(sc, MAVLINK_STX);
+        }
+        if (sc->next_stx1 < sc->pos)
+        {
+            sc->next_stx1 = frame_scanner_find(sc, MAVLINK_STX_MAVLINK1);
+        }
+        sc->pos = sc->next_stx < sc->next_stx1 ? sc->next_stx : sc->next_stx1;
+        if (sc->pos >= sc->len)
+        {
+            break;
+        }
+
+        uint8_t rv = frame_scanner_take(sc, msg);
+        if (rv != MAVLINK_FRAMING_INCOMPLETE)
+        {
+            return rv;
+        }
+
+        /* partial or suspicious frame, hand it to the byte parser */
+        frame_parser_char(sc->parser, sc->buf[sc->pos++], msg, sc->r_status);
+    }
+
+    frame_parser_flush(parser);
+    return MAVLINK_FRAMING_INCOMPLETE;
+}
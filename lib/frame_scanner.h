@@ -0,0 +1,69 @@
+#ifndef _FRAME_SCANNER_H_
+#define _FRAME_SCANNER_H_
+
+#include "secure_gateway.h"
+
+/*
+ * Block-based MAVLink frame scanner.
+ *
+ * Instead of running mavlink_parse_char() on every byte, the scanner looks
+ * for the next start-of-frame marker with memchr(), validates the header,
+ * and checks the CRC over the whole frame when it lies in the buffer. Frames
+ * that cross a buffer boundary, and frames that fail validation, are fed to
+ * the MAVLink byte parser, so the parser state carries over to the next
+ * buffer and errors are accounted exactly as by mavlink_parse_char().
+ *
+ * The parser state lives in a struct frame_parser_t owned by the caller
+ * rather than in the per-channel globals of the MAVLink library, so there is
+ * no limit of MAVLINK_COMM_NUM_BUFFERS streams, and distinct parsers can be
+ * used from distinct threads.
+ *
+ * A drop table (one bit per msg_index()) makes the scanner skip frames of
+ * unwanted messages by their length, see frame_scanner_drop().
+ *
+ * Usage:
+ *     frame_parser_reset(&parser);
+ *     frame_scanner_start(&sc, &parser, buf, len, &status);
+ *     while (frame_scanner_next(&sc, &msg) == MAVLINK_FRAMING_OK)
+ *         ...
+ *
+ * Input that arrives a byte at a time skips the scanner: each byte goes to
+ * frame_parser_char(), then frame_parser_replay() runs until it returns
+ * MAVLINK_FRAMING_INCOMPLETE, and frame_parser_flush() once nothing more
+ * is buffered.
+ */
+
+#define FRAME_V2_HEADER_LEN (MAVLINK_CORE_HEADER_LEN + 1)
+#define FRAME_V1_HEADER_LEN (MAVLINK_CORE_HEADER_MAVLINK1_LEN + 1)
+
+/* frame_scanner_next(): a frame in the drop table, only the header is set */
+#define FRAME_SCANNER_DROPPED (MAVLINK_FRAMING_BAD_SIGNATURE + 1)
+
+struct frame_scanner_t
+{
+    const uint8_t*    buf;
+    size_t            len;
+    size_t            pos;
+    struct frame_parser_t* parser;
+    mavlink_status_t*      r_status;
+    const uint64_t*        drop;
+
+    /* cached positions of the next v2 / v1 start-of-frame markers */
+    size_t            next_stx;
+    size_t            next_stx1;
+};
+
+void    frame_parser_reset(struct frame_parser_t* parser);
+uint8_t frame_parser_char(struct frame_parser_t* parser, uint8_t c,
+       mavlink_message_t* r_message, mavlink_status_t* r_status);
+uint8_t frame_parser_replay(struct frame_parser_t* parser,
+       mavlink_message_t* r_message, mavlink_status_t* r_status);
+void    frame_parser_flush(struct frame_parser_t* parser);
+
+void    frame_scanner_start(struct frame_scanner_t* sc,
+       struct frame_parser_t* parser, const uint8_t* buf, size_t len,
+       mavlink_status_t* r_status);
+void    frame_scanner_drop(struct frame_scanner_t* sc, const uint64_t* drop);
+uint8_t frame_scanner_next(struct frame_scanner_t* sc, mavlink_message_t* msg);
+
+#endif /* _FRAME_SCANNER_H_ */
@@ -0,0 +1,423 @@
+#include "geofence.h"
+
+/* > 0 if c is left of a -> b, exact within GEOFENCE_MAX_SPAN */
+static inline int64_t
+geofence_orient(const struct geofence_point_t* a,
+    const struct geofence_point_t* b, const struct geofence_point_t* c)
+{
+    return ((int64_t)b->lon - a->lon) * ((int64_t)c->lat - a->lat)
+        - ((int64_t)b->lat - a->lat) * ((int64_t)c->lon - a->lon);
+}
+
+/* whether a horizontal ray from p to the east crosses e (half-open) */
+static inline bool
+geofence_ray_crosses(
+    const struct geofence_edge_t* e, const struct geofence_point_t* p)
+{
+    if ((e->a.lat > p->lat) == (e->b.lat > p->lat))
+    {
+        return false;
+    }
+    return (geofence_orient(&e->a, &e->b, p) > 0) == (e->b.lat > e->a.lat);
+}
+
+/*
+ * Whether segment p -> r crosses e, r being off e. Endpoints of e on the line
+ * of p -> r count as right of it, so a path through a vertex is counted once
+ * if it crosses the boundary, and not at all (or twice) if it only touches
+ * it.
+ */
+static inline bool
+geofence_segment_crosses(const struct geofence_edge_t* e,
+    const struct geofence_point_t* p, const struct geofence_point_t* r)
+{
+    if ((geofence_orient(p, r, &e->a) > 0)
+        == (geofence_orient(p, r, &e->b) > 0))
+    {
+        return false;
+    }
+    return (geofence_orient(&e->a, &e->b, p) > 0)
+        != (geofence_orient(&e->a, &e->b, r) > 0);
+}
+
+static bool
+geofence_on_edge(
+    const struct geofence_edge_t* e, const struct geofence_point_t* p)
+{
+    return geofence_orient(&e->a, &e->b, p) == 0
+        && (p->lat - e->a.lat) * (int64_t)(p->lat - e->b.lat) <= 0
+        && (p->lon - e->a.lon) * (int64_t)(p->lon - e->b.lon) <= 0;
+}
+
+static inline size_t
+geofence_cell_of(const struct geofence_t* fence, int32_t lat, int32_t lon)
+{
+    size_t y = (size_t)(lat - fence->min.lat) / (size_t)fence->cell_lat;
+    size_t x = (size_t)(lon - fence->min.lon) / (size_t)fence->cell_lon;
+    y        = y < fence->grid ? y : fence->grid - 1;
+    x        = x < fence->grid ? x : fence->grid - 1;
+    return y * fence->grid + x;
+}
+
+void
+geofence_reset(struct geofence_t* fence)
+{
+    fence->edge_count    = 0;
+    fence->polygon_count = 0;
+    fence->inclusion     = 0;
+    fence->exclusion     = 0;
+    fence->built         = false;
+}
+
+/**
+ * Add a polygon of count vertices. The polygon is closed implicitly, a last
+ * vertex that repeats the first is ignored.
+ */
+int
+geofence_add_polygon(struct geofence_t* fence, bool exclusion,
+    const struct geofence_point_t* points, size_t count)
+{
+    ASSERT(fence != NULL && "fence is NULL");
+    ASSERT(points != NULL && "points are NULL");
+
+    while (count > 1 && points[count - 1].lat == points[0].lat
+        && points[count - 1].lon == points[0].lon)
+    {
+        count--;
+    }
+    if (count < 3)
+    {
+        WARN("geofence: polygon of %lu vertices\n", count);
+        return SEC_GATEWAY_INVALID_PARAM;
+    }
+    if (fence->polygon_count == GEOFENCE_MAX_POLYGONS
+        || fence->edge_count + count > GEOFENCE_MAX_EDGES)
+    {
+        WARN("geofence: more than %d polygons or %d edges\n",
+            GEOFENCE_MAX_POLYGONS, GEOFENCE_MAX_EDGES);
+        return SEC_GATEWAY_NO_RESOURCE;
+    }
+
+    uint32_t bit = 1u << fence->polygon_count++;
+    for (size_t i = 0; i < count; i++)
+    {
+        const struct geofence_point_t* a = &points[i];
+        const struct geofence_point_t* b = &points[(i + 1) % count];
+        if (a->lat == b->lat && a->lon == b->lon)
+        {
+            continue; /* repeated vertex */
+        }
+        struct geofence_edge_t* e = &fence->edges[fence->edge_count++];
+        e->a                      = *a;
+        e->b                      = *b;
+        e->polygon                = bit;
+    }
+
+    if (exclusion)
+        fence->exclusion |= bit;
+    else
+        fence->inclusion |= bit;
+    fence->built = false;
+    return SUCC;
+}
+
+/* the cells the bounding box of e overlaps */
+static void
+geofence_edge_cells(const struct geofence_t* fence,
+    const struct geofence_edge_t* e, size_t* x0, size_t* y0, size_t* x1,
+    size_t* y1)
+{
+    size_t c0 = geofence_cell_of(fence,
+        e->a.lat < e->b.lat ? e->a.lat : e->b.lat,
+        e->a.lon < e->b.lon ? e->a.lon : e->b.lon);
+    size_t c1 = geofence_cell_of(fence,
+        e->a.lat > e->b.lat ? e->a.lat : e->b.lat,
+        e->a.lon > e->b.lon ? e->a.lon : e->b.lon);
+    *x0 = c0 % fence->grid;
+    *y0 = c0 / fence->grid;
+    *x1 = c1 % fence->grid;
+    *y1 = c1 / fence->grid;
+}
+
+/* bucket the edges into cells, fails if refs overflow */
+static bool
+geofence_bucket(struct geofence_t* fence)
+{
+    size_t cells = fence->grid * fence->grid;
+    size_t x, y, x0, y0, x1, y1, total = 0;
+
+    for (size_t c = 0; c <= cells; c++)
+    {
+        fence->cells[c].start = 0;
+    }
+
+    /* count, then fill from the back: start ends up at the first ref */
+    for (size_t i = 0; i < fence->edge_count; i++)
+    {
+        geofence_edge_cells(fence, &fence->edges[i], &x0, &y0, &x1, &y1);
+        total += (x1 - x0 + 1) * (y1 - y0 + 1);
+        if (total > GEOFENCE_MAX_EDGE_REFS)
+        {
+            return false;
+        }
+        for (y = y0; y <= y1; y++)
+            for (x = x0; x <= x1; x++)
+                fence->cells[y * fence->grid + x].start++;
+    }
+    for (size_t c = 1; c <= cells; c++)
+    {
+        fence->cells[c].start += fence->cells[c - 1].start;
+    }
+    for (size_t i = 0; i < fence->edge_count; i++)
+    {
+        geofence_edge_cells(fence, &fence->edges[i], &x0, &y0, &x1, &y1);
+        for (y = y0; y <= y1; y++)
+            for (x = x0; x <= x1; x++)
+                fence->refs[--fence->cells[y * fence->grid + x].start]
+                    = (uint16_t)i;
+    }
+    return true;
+}
+
+/* pick a reference point of the cell off its edges */
+static bool
+geofence_reference(struct geofence_t* fence, size_t c)
+{
+    struct geofence_cell_t* cell = &fence->cells[c];
+    size_t  y    = c / fence->grid;
+    size_t  x    = c % fence->grid;
+    int64_t lat0 = fence->min.lat + (int64_t)fence->cell_lat * (int64_t)y;
+    int64_t lon0 = fence->min.lon + (int64_t)fence->cell_lon * (int64_t)x;
+
+    /* a few points spread over the cell */
+    for (int k = 1; k < 8; k++)
+    {
+        cell->ref.lat = (int32_t)(lat0 + (int64_t)fence->cell_lat * k / 8);
+        cell->ref.lon
+            = (int32_t)(lon0 + (int64_t)fence->cell_lon * ((k * 5) % 8) / 8);
+
+        bool on_edge = false;
+        for (uint32_t r = cell->start; r < fence->cells[c + 1].start; r++)
+        {
+            const struct geofence_edge_t* e = &fence->edges[fence->refs[r]];
+            if (geofence_on_edge(e, &cell->ref))
+            {
+                on_edge = true;
+                break;
+            }
+        }
+        if (!on_edge)
+        {
+            cell->inside = 0;
+            for (size_t i = 0; i < fence->edge_count; i++)
+            {
+                if (geofence_ray_crosses(&fence->edges[i], &cell->ref))
+                {
+                    cell->inside ^= fence->edges[i].polygon;
+                }
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool
+geofence_references(struct geofence_t* fence)
+{
+    for (size_t c = 0; c < fence->grid * fence->grid; c++)
+    {
+        if (!geofence_reference(fence, c))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Index the polygons, required before geofence_allows().
+ */
+int
+geofence_build(struct geofence_t* fence)
+{
+    ASSERT(fence != NULL && "fence is NULL");
+
+    if (fence->polygon_count == 0)
+    {
+        WARN("geofence: no polygons\n");
+        return SEC_GATEWAY_INVALID_STATE;
+    }
+
+    fence->min = fence->max = fence->edges[0].a;
+    for (size_t i = 0; i < fence->edge_count; i++)
+    {
+        const struct geofence_point_t* a = &fence->edges[i].a;
+        fence->min.lat = a->lat < fence->min.lat ? a->lat : fence->min.lat;
+        fence->min.lon = a->lon < fence->min.lon ? a->lon : fence->min.lon;
+        fence->max.lat = a->lat > fence->max.lat ? a->lat : fence->max.lat;
+        fence->max.lon = a->lon > fence->max.lon ? a->lon : fence->max.lon;
+    }
+    int64_t span_lat = (int64_t)fence->max.lat - fence->min.lat;
+    int64_t span_lon = (int64_t)fence->max.lon - fence->min.lon;
+    if (span_lat >= GEOFENCE_MAX_SPAN || span_lon >= GEOFENCE_MAX_SPAN)
+    {
+        WARN("geofence: fence spans too far\n");
+        return SEC_GATEWAY_INVALID_PARAM;
+    }
+
+    /* about two cells per edge, fewer if refs overflow */
+    fence->grid = 1;
+    while (fence->grid * fence->grid < 2 * fence->edge_count
+        && fence->grid < GEOFENCE_MAX_GRID)
+    {
+        fence->grid *= 2;
+    }
+    /* tiny cells may have no reference point off the edges, grow them */
+    for (;; fence->grid /= 2)
+    {
+        fence->cell_lat = (int32_t)(span_lat / (int64_t)fence->grid + 1);
+        fence->cell_lon = (int32_t)(span_lon / (int64_t)fence->grid + 1);
+        if (geofence_bucket(fence) && geofence_references(fence))
+        {
+            break;
+        }
+        if (fence->grid == 1)
+        {
+            WARN("geofence: cannot index the polygons\n");
+            return SEC_GATEWAY_NO_RESOURCE;
+        }
+    }
+
+    fence->built = true;
+    INFO("geofence: %lu polygons, %lu edges, %lux%lu grid\n",
+        fence->polygon_count, fence->edge_count, fence->grid, fence->grid);
+    return SUCC;
+}
+
+/**
+ * Whether a position (degE7) is inside the fence.
+ */
+bool
+geofence_allows(const struct geofence_t* fence, int32_t lat, int32_t lon)
+{
+    ASSERT(fence->built && "geofence is not built");
+
+    uint32_t inside = 0;
+    if (lat >= fence->min.lat && lat <= fence->max.lat
+        && lon >= fence->min.lon && lon <= fence->max.lon)
+    {
+        const struct geofence_point_t p    = { lat, lon };
+        size_t                        c    = geofence_cell_of(fence, lat, lon);
+        const struct geofence_cell_t* cell = &fence->cells[c];
+
+        inside = cell->inside;
+        for (uint32_t r = cell->start; r < fence->cells[c + 1].start; r++)
+        {
+            const struct geofence_edge_t* e = &fence->edges[fence->refs[r]];
+            if (geofence_segment_crosses(e, &p, &cell->ref))
+            {
+                inside ^= e->polygon;
+            }
+        }
+    }
+
+    return (fence->inclusion == 0 || (inside & fence->inclusion) != 0)
+        && (inside & fence->exclusion) == 0;
+}
+
+#ifdef _STD_LIBC_
+#include <errno.h>
+
+#define GEOFENCE_MAX_POINTS GEOFENCE_MAX_EDGES
+
+int
+geofence_load(struct geofence_t* fence, const char* path)
+{
+    static struct geofence_point_t points[GEOFENCE_MAX_POINTS + 1];
+    size_t                         count = 0;
+    size_t                         line  = 0;
+    int  kind = -1; /* 0: inclusion, 1: exclusion, -1: ArduPilot list */
+    int  rv   = SUCC;
+    char buf[256];
+
+    FILE* f = fopen(path, "r");
+    if (f == NULL)
+    {
+        WARN("cannot open %s: %s\n", path, strerror(errno));
+        return SEC_GATEWAY_IO_FAULT;
+    }
+
+    geofence_reset(fence);
+    for (;;)
+    {
+        bool  eof = fgets(buf, sizeof(buf), f) == NULL;
+        char* p   = buf;
+        line++;
+
+        if (!eof)
+        {
+            buf[strcspn(buf, "#\r\n")] = '\0';
+            p += strspn(p, " \t");
+            if (*p == '\0')
+            {
+                continue;
+            }
+        }
+
+        bool keyword = !eof
+            && (strncmp(p, "inclusion", 9) == 0
+                || strncmp(p, "exclusion", 9) == 0);
+        if (eof || keyword)
+        {
+            /* close the polygon so far */
+            if (kind == -1 && count > 0)
+            {
+                /* the first point is the return point */
+                rv = geofence_add_polygon(fence, false, points + 1, count - 1);
+            }
+            else if (kind != -1)
+            {
+                rv = geofence_add_polygon(fence, kind == 1, points, count);
+            }
+            if (rv != SUCC || eof)
+            {
+                break;
+            }
+            kind  = p[0] == 'e';
+            count = 0;
+            continue;
+        }
+
+        char*  mid;
+        char*  end;
+        double lat = strtod(p, &mid);
+        double lon = strtod(mid, &end);
+        if (mid == p || end == mid || *(end + strspn(end, " \t")) != '\0'
+            || lat < -90
+            || lat > 90 || lon < -180 || lon > 180)
+        {
+            WARN("%s:%lu: expected \"lat lon\"\n", path, line);
+            rv = SEC_GATEWAY_INVALID_PARAM;
+            break;
+        }
+        if (count == GEOFENCE_MAX_POINTS + 1)
+        {
+            WARN("%s:%lu: more than %d points\n", path, line,
+                GEOFENCE_MAX_POINTS);
+            rv = SEC_GATEWAY_NO_RESOURCE;
+            break;
+        }
+        points[count].lat = (int32_t)(lat * 1e7 + (lat < 0 ? -0.5 : 0.5));
+        points[count].lon = (int32_t)(lon * 1e7 + (lon < 0 ? -0.5 : 0.5));
+        count++;
+    }
+    fclose(f);
+
+    if (rv == SUCC)
+    {
+        rv = geofence_build(fence);
+    }
+    return rv;
+}
+#endif
@@ -0,0 +1,97 @@
+#ifndef _GEOFENCE_H_
+#define _GEOFENCE_H_
+
+#include "secure_gateway.h"
+
+/*
+ * Inclusion and exclusion polygons, and a uniform grid over them for
+ * constant-time point queries.
+ *
+ * A position is inside the fence if it lies in one of the inclusion
+ * polygons (or there are none) and in none of the exclusion polygons.
+ *
+ * geofence_build() lays a grid over the bounding box of the polygons and
+ * records, for every cell, the edges that may pass through it and which
+ * polygons contain a reference point in the cell. A query only tests the
+ * segment from the position to the reference point of its cell against the
+ * edges of that cell: every crossing flips the containment of one polygon.
+ *
+ * Coordinates are degE7, as in MISSION_ITEM_INT, and are compared exactly
+ * in 64-bit integers, which bounds the fence to 2^30 degE7 (about 107
+ * degrees) on each axis. Fences across the antimeridian are not supported.
+ */
+
+#ifndef GEOFENCE_MAX_EDGES
+#ifdef _STD_LIBC_
+#define GEOFENCE_MAX_EDGES     1024
+#define GEOFENCE_MAX_POLYGONS  32
+#define GEOFENCE_MAX_GRID      64
+#define GEOFENCE_MAX_EDGE_REFS 32768
+#else
+#define GEOFENCE_MAX_EDGES     256
+#define GEOFENCE_MAX_POLYGONS  8
+#define GEOFENCE_MAX_GRID      16
+#define GEOFENCE_MAX_EDGE_REFS 2048
+#endif
+#endif
+
+static_assert(GEOFENCE_MAX_POLYGONS <= 32, "polygon sets are 32-bit masks");
+static_assert(GEOFENCE_MAX_EDGES <= UINT16_MAX, "edges are 16-bit indices");
+
+#define GEOFENCE_MAX_SPAN (1 << 30)
+
+struct geofence_point_t
+{
+    int32_t lat, lon;
+};
+
+struct geofence_edge_t
+{
+    struct geofence_point_t a, b;
+    uint32_t                polygon; /* bit of the polygon */
+};
+
+struct geofence_cell_t
+{
+    struct geofence_point_t ref;    /* reference point */
+    uint32_t                inside; /* polygons that contain ref */
+    uint32_t                start;  /* first of the cell in refs */
+};
+
+struct geofence_t
+{
+    /* polygons */
+    struct geofence_edge_t edges[GEOFENCE_MAX_EDGES];
+    size_t                 edge_count;
+    size_t                 polygon_count;
+    uint32_t               inclusion; /* inclusion polygons */
+    uint32_t               exclusion; /* exclusion polygons */
+
+    /* grid, set up by geofence_build() */
+    bool                    built;
+    struct geofence_point_t min, max;
+    int32_t                 cell_lat, cell_lon; /* cell size */
+    size_t                  grid;               /* grid x grid cells */
+    struct geofence_cell_t  cells[GEOFENCE_MAX_GRID * GEOFENCE_MAX_GRID + 1];
+    uint16_t                refs[GEOFENCE_MAX_EDGE_REFS]; /* edges by cell */
+};
+
+void geofence_reset(struct geofence_t* fence);
+int  geofence_add_polygon(struct geofence_t* fence, bool exclusion,
+     const struct geofence_point_t* points, size_t count);
+int  geofence_build(struct geofence_t* fence);
+bool geofence_allows(
+    const struct geofence_t* fence, int32_t lat, int32_t lon);
+
+#ifdef _STD_LIBC_
+/*
+ * Load a fence file. Lines hold "lat lon" in degrees; '#' starts a comment.
+ * A line "inclusion" or "exclusion" starts a polygon of that kind. Points
+ * before the first of them are an ArduPilot fence point list (as written by
+ * MAVProxy "fence save"): the return point, followed by one inclusion
+ * polygon.
+ */
+int geofence_load(struct geofence_t* fence, const char* path);
+#endif
+
+#endif /* _GEOFENCE_H_ */
@@ -0,0 +1,115 @@
+#include "link_table.h"
+
+static inline struct link_slot_t*
+link_table_slot(const struct link_table_t* table, size_t i)
+{
+    return (struct link_slot_t*)(table->entries
+        + (i & (table->capacity - 1)) * table->stride);
+}
+
+/* the high bits of a multiplicative hash depend on all bits of the key */
+static inline size_t
+link_table_hash(uint32_t key)
+{
+    return (size_t)(key * 0x9E3779B1u) >> 16;
+}
+
+static inline bool
+link_table_live(
+    const struct link_table_t* table, const struct link_slot_t* slot,
+    uint64_t now)
+{
+    return slot->touched != 0 && now - slot->touched < table->timeout_us;
+}
+
+/**
+ * Set up a table over capacity entries of stride bytes each, which start
+ * with a struct link_slot_t.
+ */
+void
+link_table_init(struct link_table_t* table, void* entries, size_t stride,
+    size_t capacity, uint64_t timeout_us)
+{
+    ASSERT(stride >= sizeof(struct link_slot_t) && "entry too small");
+    ASSERT(capacity >= LINK_TABLE_PROBES && capacity <= LINK_TABLE_MAX
+        && (capacity & (capacity - 1)) == 0
+        && "capacity must be a power of two");
+
+    table->entries    = entries;
+    table->stride     = stride;
+    table->capacity   = capacity;
+    table->timeout_us = timeout_us;
+    table->evicted    = 0;
+    memset(entries, 0, stride * capacity);
+}
+
+/**
+ * The live entry of key, touched, or NULL.
+ */
+void*
+link_table_find(struct link_table_t* table, uint32_t key, uint64_t now)
+{
+    size_t h = link_table_hash(key);
+    for (size_t i = 0; i < LINK_TABLE_PROBES; i++)
+    {
+        struct link_slot_t* slot = link_table_slot(table, h + i);
+        if (slot->key == key && link_table_live(table, slot, now))
+        {
+            slot->touched = now;
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * The entry of key, touched. A new entry is zeroed past the slot header.
+ */
+void*
+link_table_insert(struct link_table_t* table, uint32_t key, uint64_t now)
+{
+    ASSERT(now != 0 && "time 0 marks free slots");
+
+    size_t              h      = link_table_hash(key);
+    struct link_slot_t* victim = NULL;
+    for (size_t i = 0; i < LINK_TABLE_PROBES; i++)
+    {
+        struct link_slot_t* slot = link_table_slot(table, h + i);
+        if (!link_table_live(table, slot, now))
+        {
+            /* the first free slot, unless the key is live further on */
+            if (victim == NULL || link_table_live(table, victim, now))
+                victim = slot;
+            continue;
+        }
+        if (slot->key == key)
+        {
+            slot->touched = now;
+            return slot;
+        }
+        if (victim == NULL
+            || (link_table_live(table, victim, now)
+                && slot->touched < victim->touched))
+        {
+            victim = slot;
+        }
+    }
+
+    if (link_table_live(table, victim, now))
+    {
+        table->evicted++;
+    }
+    memset(victim, 0, table->stride);
+    victim->key     = key;
+    victim->touched = now;
+    return victim;
+}
+
+/**
+ * Free an entry returned by link_table_find() or link_table_insert().
+ */
+void
+link_table_remove(struct link_table_t* table, void* entry)
+{
+    ((struct link_slot_t*)entry)->touched = 0;
+}
@@ -0,0 +1,52 @@
+#ifndef _LINK_TABLE_H_
+#define _LINK_TABLE_H_
+
+#include "secure_gateway.h"
+
+/*
+ * Bounded per-link state of stateful policies.
+ *
+ * A link is a MAVLink (sysid, compid), see link_key(), or any other 32-bit
+ * key that includes one. The table is a fixed array of entries, allocated
+ * by the caller, that all start with a struct link_slot_t. A key may only
+ * live in the LINK_TABLE_PROBES slots after its hash, so lookups take
+ * constant time. Entries not touched for timeout_us
+ * are free again; if all the slots of a key are live, inserting it evicts
+ * the least recently touched one.
+ *
+ * Not thread-safe: policies run on the pipeline thread.
+ */
+
+#define LINK_TABLE_PROBES 8
+#define LINK_TABLE_MAX    65536 /* entries */
+
+struct link_slot_t
+{
+    uint64_t touched; /* time_us() of the last use, 0 if free */
+    uint32_t key;
+};
+
+struct link_table_t
+{
+    uint8_t* entries;
+    size_t   stride;   /* bytes per entry */
+    size_t   capacity; /* entries, a power of two */
+    uint64_t timeout_us;
+
+    /* statistics */
+    size_t evicted; /* live entries replaced by others */
+};
+
+static inline uint32_t
+link_key(uint8_t sysid, uint8_t compid)
+{
+    return (uint32_t)sysid << 8 | compid;
+}
+
+void  link_table_init(struct link_table_t* table, void* entries,
+     size_t stride, size_t capacity, uint64_t timeout_us);
+void* link_table_find(struct link_table_t* table, uint32_t key, uint64_t now);
+void* link_table_insert(struct link_table_t* table, uint32_t key, uint64_t now);
+void  link_table_remove(struct link_table_t* table, void* entry);
+
+#endif /* _LINK_TABLE_H_ */
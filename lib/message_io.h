@@ -0,0 +1,90 @@
+#ifndef _MESSAGE_IO_H_
+#define _MESSAGE_IO_H_
+
+#ifndef _STD_LIBC_
+#error "This file requires sys/uio.h!"
+#endif
+
+#include "secure_gateway.h"
+#include <stddef.h>
+#include <sys/uio.h>
+
+/*
+ * Scatter/gather view of the on-wire bytes of a message.
+ *
+ * mavlink_message_t keeps the MAVLink 2 header fields in wire order right in
+ * front of the payload, so for v2 frames header and payload are sent straight
+ * out of the message. The frame is not re-serialized and its length is kept
+ * as received (mavlink_msg_to_send_buffer() would trim the payload after the
+ * fact). Only the checksum, which the parser and the finalizer both leave in
+ * msg->checksum, and the MAVLink 1 header need a few bytes of scratch.
+ */
+
+#define MESSAGE_WIRE_MAX_IOV 4
+
+struct message_wire_t
+{
+    struct iovec iov[MESSAGE_WIRE_MAX_IOV];
+    int          iovcnt;
+    size_t       len;
+    uint8_t      header[MAVLINK_CORE_HEADER_MAVLINK1_LEN + 1];
+    uint8_t      ck[2];
+};
+
+static inline void
+message_wire(const struct message_t* msg, struct message_wire_t* wire)
+{
+    const mavlink_message_t* m = &msg->msg;
+    int                      n = 0;
+
+    if (m->magic == MAVLINK_STX_MAVLINK1)
+    {
+        wire->header[0] = m->magic;
+        wire->header[1] = m->len;
+        wire->header[2] = m->seq;
+        wire->header[3] = m->sysid;
+        wire->header[4] = m->compid;
+        wire->header[5] = m->msgid & 0xFF;
+
+        wire->iov[n++] = (struct iovec) {
+            .iov_base = wire->header,
+            .iov_len  = sizeof(wire->header),
+        };
+        wire->iov[n++] = (struct iovec) {
+            .iov_base = (void*)_MAV_PAYLOAD(m),
+            .iov_len  = m->len,
+        };
+    }
+    else
+    {
+        wire->iov[n++] = (struct iovec) {
+            .iov_base = (void*)&m->magic,
+            .iov_len  = MAVLINK_CORE_HEADER_LEN + 1 + m->len,
+        };
+    }
+
+    wire->ck[0]    = (uint8_t)(m->checksum & 0xFF);
+    wire->ck[1]    = (uint8_t)(m->checksum >> 8);
+    wire->iov[n++] = (struct iovec) {
+        .iov_base = wire->ck,
+        .iov_len  = sizeof(wire->ck),
+    };
+
+    if (m->magic != MAVLINK_STX_MAVLINK1
+        && (m->incompat_flags & MAVLINK_IFLAG_SIGNED))
+    {
+        wire->iov[n++] = (struct iovec) {
+            .iov_base = (void*)m->signature,
+            .iov_len  = MAVLINK_SIGNATURE_BLOCK_LEN,
+        };
+    }
+
+    wire->iovcnt = n;
+    wire->len    = 0;
+    for (int i = 0; i < n; i++)
+    {
+        wire->len += wire->iov[i].iov_len;
+    }
+}
+
+#endif /* _MESSAGE_IO_H_ */
@@ -0,0 +1,189 @@
+#include "secure_gateway.h"
+#include <stddef.h>
+
+/*
+ * Fixed-capacity pool of reference-counted messages. A parsed frame is
+ * allocated once and shared by every sink it is routed to; whoever keeps a
+ * message beyond pipeline_push() (a queue, a worker) takes its own reference
+ * and the last message_put() returns it to the pool.
+ *
+ * The free list is a Treiber stack of slot indices. The head carries a
+ * generation tag in its upper half so a slot recycled between the load and
+ * the CAS of a concurrent allocation cannot be mistaken for the old head.
+ */
+
+#define MESSAGE_POOL_NIL UINT32_MAX
+
+struct message_pool_t
+{
+    struct message_t messages[MESSAGE_POOL_SIZE];
+    uint32_t         next[MESSAGE_POOL_SIZE];
+    uint64_t         head; /* (tag << 32) | index */
+    size_t           available;
+    size_t           exhausted;
+};
+
+static struct message_pool_t message_pool;
+
+static inline bool
+message_pooled(const struct message_t* msg)
+{
+    return msg >= &message_pool.messages[0]
+        && msg < &message_pool.messages[MESSAGE_POOL_SIZE];
+}
+
+static void
+message_pool_push(uint32_t index)
+{
+    uint64_t head = __atomic_load_n(&message_pool.head, __ATOMIC_RELAXED);
+    uint64_t next;
+
+    do
+    {
+        __atomic_store_n(
+            &message_pool.next[index], (uint32_t)head, __ATOMIC_RELAXED);
+        next = (((head >> 32) + 1) << 32) | index;
+    } while (!__atomic_compare_exchange_n(&message_pool.head, &head, next,
+        true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    __atomic_fetch_add(&message_pool.available, 1, __ATOMIC_RELAXED);
+}
+
+static struct message_t*
+message_pool_pop(void)
+{
+    uint64_t head = __atomic_load_n(&message_pool.head, __ATOMIC_ACQUIRE);
+    uint64_t next;
+    uint32_t index;
+
+    do
+    {
+        index = (uint32_t)head;
+        if (index == MESSAGE_POOL_NIL)
+        {
+            __atomic_fetch_add(&message_pool.exhausted, 1, __ATOMIC_RELAXED);
+            return NULL;
+        }
+        next = (((head >> 32) + 1) << 32)
+            | __atomic_load_n(&message_pool.next[index], __ATOMIC_RELAXED);
+    } while (!__atomic_compare_exchange_n(&message_pool.head, &head, next,
+        true, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+
+    __atomic_fetch_sub(&message_pool.available, 1, __ATOMIC_RELAXED);
+    return &message_pool.messages[index];
+}
+
+void
+message_pool_init(void)
+{
+    message_pool.head      = MESSAGE_POOL_NIL;
+    message_pool.available = 0;
+    message_pool.exhausted = 0;
+    for (uint32_t i = MESSAGE_POOL_SIZE; i > 0; i--)
+    {
+        message_pool_push(i - 1);
+    }
+}
+
+struct message_t*
+message_alloc(void)
+{
+    struct message_t* msg = message_pool_pop();
+    if (msg == NULL)
+    {
+        return NULL;
+    }
+
+    bitmap_clear(&msg->sinks);
+    msg->source     = 0;
+    msg->attribute  = 0;
+    msg->view_msgid = MESSAGE_VIEW_NONE;
+    __atomic_store_n(&msg->refs, 1, __ATOMIC_RELAXED);
+    return msg;
+}
+
+struct message_t*
+message_copy(const struct message_t* msg)
+{
+    struct message_t* copy = message_pool_pop();
+    if (copy == NULL)
+    {
+        return NULL;
+    }
+
+    memcpy(copy, msg, sizeof(struct message_t));
+    __atomic_store_n(&copy->refs, 1, __ATOMIC_RELAXED);
+    return copy;
+}
+
+/*
+ * Copy-on-write copy for a sink transform. Only the header and the len
+ * payload bytes that are actually on the wire are copied, not the whole
+ * MAVLINK_MAX_PAYLOAD_LEN buffer.
+ */
+struct message_t*
+message_cow(const struct message_t* msg)
+{
+    struct message_t* copy = message_pool_pop();
+    if (copy == NULL)
+    {
+        return NULL;
+    }
+
+    memcpy(&copy->msg, &msg->msg,
+        offsetof(mavlink_message_t, payload64) + msg->msg.len);
+    memcpy(copy->msg.ck, msg->msg.ck,
+        sizeof(msg->msg.ck) + sizeof(msg->msg.signature));
+    memcpy(&copy->status, &msg->status, sizeof(copy->status));
+    memcpy(&copy->sinks, &msg->sinks, sizeof(copy->sinks));
+    copy->source     = msg->source;
+    copy->attribute  = msg->attribute;
+    copy->view_msgid = MESSAGE_VIEW_NONE; /* copied to be transformed */
+    __atomic_store_n(&copy->refs, 1, __ATOMIC_RELAXED);
+    return copy;
+}
+
+struct message_t*
+message_ref(struct message_t* msg)
+{
+    ASSERT(msg != NULL && "message is NULL");
+
+    /* messages outside the pool (on a stack, in a source) are copied in */
+    if (!message_pooled(msg))
+    {
+        return message_copy(msg);
+    }
+
+    ASSERT(__atomic_load_n(&msg->refs, __ATOMIC_RELAXED) > 0
+        && "message is not allocated");
+    __atomic_fetch_add(&msg->refs, 1, __ATOMIC_RELAXED);
+    return msg;
+}
+
+void
+message_put(struct message_t* msg)
+{
+    if (msg == NULL || !message_pooled(msg))
+    {
+        return;
+    }
+
+    uint32_t refs = __atomic_sub_fetch(&msg->refs, 1, __ATOMIC_ACQ_REL);
+    ASSERT(refs != UINT32_MAX && "message released too many times");
+    if (refs == 0)
+    {
+        message_pool_push((uint32_t)(msg - message_pool.messages));
+    }
+}
+
+size_t
+message_pool_available(void)
+{
+    return __atomic_load_n(&message_pool.available, __ATOMIC_RELAXED);
+}
+
+size_t
+message_pool_exhausted(void)
+{
+    return __atomic_load_n(&message_pool.exhausted, __ATOMIC_RELAXED);
+}
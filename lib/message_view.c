@@ -0,0 +1,72 @@
+#include "secure_gateway.h"
+
+/*
+ * Decode-once typed view of a message. The first policy that needs the
+ * payload of, say, COMMAND_LONG as a struct decodes it into msg->view, the
+ * following policies read it from there. The view is a cache, so it is
+ * filled in through a const message; transforms that rewrite the payload
+ * invalidate it.
+ */
+const void*
+message_view(const struct message_t* msg, uint32_t msgid)
+{
+    ASSERT(msg != NULL && "message is NULL");
+
+    if (msg->msg.msgid != msgid)
+    {
+        return NULL;
+    }
+
+    struct message_t* m = (struct message_t*)msg;
+    if (m->view_msgid == msgid)
+    {
+        return &m->view;
+    }
+
+    switch (msgid)
+    {
+    case MAVLINK_MSG_ID_COMMAND_LONG:
+        mavlink_msg_command_long_decode(&m->msg, &m->view.command_long);
+        break;
+    case MAVLINK_MSG_ID_COMMAND_INT:
+        mavlink_msg_command_int_decode(&m->msg, &m->view.command_int);
+        break;
+    case MAVLINK_MSG_ID_PARAM_SET:
+        mavlink_msg_param_set_decode(&m->msg, &m->view.param_set);
+        break;
+    case MAVLINK_MSG_ID_MISSION_COUNT:
+        mavlink_msg_mission_count_decode(&m->msg, &m->view.mission_count);
+        break;
+    case MAVLINK_MSG_ID_MISSION_ITEM:
+        mavlink_msg_mission_item_decode(&m->msg, &m->view.mission_item);
+        break;
+    case MAVLINK_MSG_ID_MISSION_ITEM_INT:
+        mavlink_msg_mission_item_int_decode(
+            &m->msg, &m->view.mission_item_int);
+        break;
+    case MAVLINK_MSG_ID_MISSION_REQUEST:
+        mavlink_msg_mission_request_decode(&m->msg, &m->view.mission_request);
+        break;
+    case MAVLINK_MSG_ID_MISSION_REQUEST_INT:
+        mavlink_msg_mission_request_int_decode(
+            &m->msg, &m->view.mission_request_int);
+        break;
+    case MAVLINK_MSG_ID_MISSION_ACK:
+        mavlink_msg_mission_ack_decode(&m->msg, &m->view.mission_ack);
+        break;
+    case MAVLINK_MSG_ID_SET_POSITION_TARGET_LOCAL_NED:
+        mavlink_msg_set_position_target_local_ned_decode(
+            &m->msg, &m->view.set_position_target_local_ned);
+        break;
+    case MAVLINK_MSG_ID_SET_POSITION_TARGET_GLOBAL_INT:
+        mavlink_msg_set_position_target_global_int_decode(
+            &m->msg, &m->view.set_position_target_global_int);
+        break;
+    default:
+        ASSERT(false && "message has no view");
+        return NULL;
+    }
+
+    m->view_msgid = msgid;
+    return &m->view;
+}
@@ -0,0 +1,180 @@
+#include "mission_tracker.h"
+
+void
+mission_tracker_init(struct mission_tracker_t* tracker, uint16_t max_items)
+{
+    link_table_init(&tracker->links, tracker->uploads,
+        sizeof(struct mission_upload_t), MISSION_TRACKER_LINKS,
+        MISSION_TRACKER_TIMEOUT_US);
+    tracker->max_items = max_items;
+}
+
+/* guided mode "fly to" and altitude change items, outside any upload */
+#define MISSION_ITEM_CURRENT_GUIDED     2
+#define MISSION_ITEM_CURRENT_ALT_CHANGE 3
+
+static bool
+mission_tracker_item(struct mission_tracker_t* tracker,
+    const struct message_t* msg, uint16_t seq, uint8_t target_system,
+    uint8_t target_component, uint8_t mission_type, uint8_t current,
+    uint64_t now)
+{
+    /* not part of a mission, the geofence (if any) has checked them */
+    if (current == MISSION_ITEM_CURRENT_GUIDED
+        || current == MISSION_ITEM_CURRENT_ALT_CHANGE)
+    {
+        return true;
+    }
+
+    struct mission_upload_t* upload = link_table_find(&tracker->links,
+        link_key(msg->msg.sysid, msg->msg.compid), now);
+
+    if (upload == NULL)
+    {
+        WARN("mission %u:%u: item %u outside an upload\n", msg->msg.sysid,
+            msg->msg.compid, seq);
+        return false;
+    }
+    if (upload->source != msg->source
+        || upload->target_system != target_system
+        || upload->target_component != target_component
+        || upload->mission_type != mission_type)
+    {
+        WARN("mission %u:%u: item %u does not match the upload\n",
+            msg->msg.sysid, msg->msg.compid, seq);
+        return false;
+    }
+    if (seq >= upload->requested)
+    {
+        WARN("mission %u:%u: item %u was not requested\n", msg->msg.sysid,
+            msg->msg.compid, seq);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Track a message of a mission computer, false if it breaks an upload.
+ */
+bool
+mission_tracker_gcs(struct mission_tracker_t* tracker,
+    const struct message_t* msg, uint64_t now)
+{
+    switch (msg->msg.msgid)
+    {
+    case MAVLINK_MSG_ID_MISSION_COUNT:
+    {
+        const mavlink_mission_count_t* count = message_mission_count(msg);
+        if (tracker->max_items != 0 && count->count > tracker->max_items)
+        {
+            WARN("mission %u:%u: %u items, at most %u\n", msg->msg.sysid,
+                msg->msg.compid, count->count, tracker->max_items);
+            return false;
+        }
+
+        /* a new count restarts the upload */
+        struct mission_upload_t* upload = link_table_insert(&tracker->links,
+            link_key(msg->msg.sysid, msg->msg.compid), now);
+        upload->source           = msg->source;
+        upload->target_system    = count->target_system;
+        upload->target_component = count->target_component;
+        upload->mission_type     = count->mission_type;
+        upload->count            = count->count;
+        upload->requested        = 0;
+        return true;
+    }
+    case MAVLINK_MSG_ID_MISSION_ITEM_INT:
+    {
+        const mavlink_mission_item_int_t* item = message_mission_item_int(msg);
+        return mission_tracker_item(tracker, msg, item->seq,
+            item->target_system, item->target_component, item->mission_type,
+            item->current, now);
+    }
+    case MAVLINK_MSG_ID_MISSION_ITEM:
+    {
+        const mavlink_mission_item_t* item = message_mission_item(msg);
+        return mission_tracker_item(tracker, msg, item->seq,
+            item->target_system, item->target_component, item->mission_type,
+            item->current, now);
+    }
+    default:
+        return true;
+    }
+}
+
+/* the upload a vehicle message answers to, or NULL */
+static struct mission_upload_t*
+mission_tracker_answered(struct mission_tracker_t* tracker,
+    const struct message_t* msg, uint8_t target_system,
+    uint8_t target_component, uint8_t mission_type, uint64_t now)
+{
+    struct mission_upload_t* upload = link_table_find(
+        &tracker->links, link_key(target_system, target_component), now);
+
+    if (upload == NULL || upload->mission_type != mission_type
+        || (upload->target_system != 0
+            && upload->target_system != msg->msg.sysid))
+    {
+        return NULL;
+    }
+    return upload;
+}
+
+static void
+mission_tracker_request(struct mission_tracker_t* tracker,
+    const struct message_t* msg, uint8_t target_system,
+    uint8_t target_component, uint8_t mission_type, uint16_t seq,
+    uint64_t now)
+{
+    struct mission_upload_t* upload = mission_tracker_answered(
+        tracker, msg, target_system, target_component, mission_type, now);
+
+    /* items may be asked for again, the highest one bounds the upload */
+    if (upload != NULL && seq < upload->count && seq >= upload->requested)
+    {
+        upload->requested = seq + 1;
+    }
+}
+
+/**
+ * Track a message of the vehicle. The vehicle is trusted, its messages are
+ * never rejected.
+ */
+void
+mission_tracker_vehicle(struct mission_tracker_t* tracker,
+    const struct message_t* msg, uint64_t now)
+{
+    switch (msg->msg.msgid)
+    {
+    case MAVLINK_MSG_ID_MISSION_REQUEST_INT:
+    {
+        const mavlink_mission_request_int_t* r
+            = message_mission_request_int(msg);
+        mission_tracker_request(tracker, msg, r->target_system,
+            r->target_component, r->mission_type, r->seq, now);
+        break;
+    }
+    case MAVLINK_MSG_ID_MISSION_REQUEST:
+    {
+        const mavlink_mission_request_t* r = message_mission_request(msg);
+        mission_tracker_request(tracker, msg, r->target_system,
+            r->target_component, r->mission_type, r->seq, now);
+        break;
+    }
+    case MAVLINK_MSG_ID_MISSION_ACK:
+    {
+        /* accepted or not, the upload is over */
+        const mavlink_mission_ack_t* ack    = message_mission_ack(msg);
+        struct mission_upload_t*     upload = mission_tracker_answered(tracker,
+                msg, ack->target_system, ack->target_component,
+                ack->mission_type, now);
+        if (upload != NULL)
+        {
+            link_table_remove(&tracker->links, upload);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef _MISSION_TRACKER_H_
+#define _MISSION_TRACKER_H_
+
+#include "link_table.h"
+
+/*
+ * Mission uploads in flight, by the (sysid, compid) of the uploader.
+ *
+ * A mission computer starts an upload with MISSION_COUNT; the vehicle then
+ * asks for every item with MISSION_REQUEST_INT (or MISSION_REQUEST) and
+ * ends the upload with MISSION_ACK. An item, MISSION_ITEM_INT or
+ * MISSION_ITEM, is only let through if it belongs to a live upload from
+ * the same source, to the same vehicle and of the same mission type, and
+ * the vehicle has asked for it. Uploads idle for MISSION_TRACKER_TIMEOUT_US
+ * are forgotten, as the vehicle gives up on them too.
+ *
+ * Guided mode items (current 2, fly to, and 3, change altitude) are not
+ * part of an upload and pass; the geofence checks where they go. Partial
+ * uploads (MISSION_WRITE_PARTIAL_LIST) are not tracked.
+ */
+
+#ifndef MISSION_TRACKER_LINKS
+#ifdef _STD_LIBC_
+#define MISSION_TRACKER_LINKS 64
+#else
+#define MISSION_TRACKER_LINKS 8
+#endif
+#endif
+
+#define MISSION_TRACKER_TIMEOUT_US 10000000ull
+
+struct mission_upload_t
+{
+    struct link_slot_t slot;
+    size_t             source;
+    uint8_t            target_system;
+    uint8_t            target_component;
+    uint8_t            mission_type;
+    uint16_t           count;
+    uint16_t           requested; /* items asked for: 0 .. requested - 1 */
+};
+
+struct mission_tracker_t
+{
+    struct link_table_t     links;
+    struct mission_upload_t uploads[MISSION_TRACKER_LINKS];
+    uint16_t                max_items; /* 0 for no limit */
+};
+
+void mission_tracker_init(
+    struct mission_tracker_t* tracker, uint16_t max_items);
+bool mission_tracker_gcs(
+    struct mission_tracker_t* tracker, const struct message_t* msg,
+    uint64_t now);
+void mission_tracker_vehicle(
+    struct mission_tracker_t* tracker, const struct message_t* msg,
+    uint64_t now);
+
+#endif /* _MISSION_TRACKER_H_ */
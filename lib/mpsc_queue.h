@@ -0,0 +1,111 @@
+#ifndef _MPSC_QUEUE_H_
+#define _MPSC_QUEUE_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "secure_gateway.h"
+
+#ifdef __STDC_NO_ATOMICS__
+#error "This file requires C11 atomic!"
+#endif
+
+/*
+ * Bounded lock-free multi-producer / single-consumer queue of message
+ * pointers (Vyukov's sequence-numbered ring). Producers claim a cell with a
+ * CAS on head; the consumer reads the oldest cell with mpsc_queue_peek() and
+ * hands it back with mpsc_queue_release(). The queue does not manage message
+ * references, the caller transfers one along with the pointer.
+ */
+
+struct mpsc_cell_t
+{
+    _Atomic(size_t)   seq;
+    struct message_t* msg;
+};
+
+struct mpsc_queue_t
+{
+    struct mpsc_cell_t* cells;
+    size_t              mask;
+    _Alignas(64) _Atomic(size_t) head; /* producers */
+    _Alignas(64) size_t tail;          /* consumer */
+};
+
+static inline void
+mpsc_queue_init(struct mpsc_queue_t* q, struct mpsc_cell_t* cells, size_t size)
+{
+    ASSERT(q != NULL && "q is NULL");
+    ASSERT(cells != NULL && "cells is NULL");
+    ASSERT(size > 0 && (size & (size - 1)) == 0 && "size is not a power of 2");
+
+    q->cells = cells;
+    q->mask  = size - 1;
+    for (size_t i = 0; i < size; i++)
+    {
+        atomic_init(&cells[i].seq, i);
+    }
+    atomic_init(&q->head, 0);
+    q->tail = 0;
+}
+
+/* returns false if the queue is full */
+static inline bool
+mpsc_queue_push(struct mpsc_queue_t* q, struct message_t* msg)
+{
+    struct mpsc_cell_t* cell;
+    size_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+    for (;;)
+    {
+        cell       = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&q->head, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            return false;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+        }
+    }
+
+    cell->msg = msg;
+    /* seq_cst so that a consumer going to sleep cannot miss it */
+    atomic_store(&cell->seq, pos + 1);
+    return true;
+}
+
+/* returns the oldest message, or NULL if the queue is empty */
+static inline struct message_t*
+mpsc_queue_peek(struct mpsc_queue_t* q)
+{
+    struct mpsc_cell_t* cell = &q->cells[q->tail & q->mask];
+    size_t seq = atomic_load(&cell->seq);
+    if ((intptr_t)seq - (intptr_t)(q->tail + 1) < 0)
+    {
+        return NULL;
+    }
+    return cell->msg;
+}
+
+static inline void
+mpsc_queue_release(struct mpsc_queue_t* q)
+{
+    struct mpsc_cell_t* cell = &q->cells[q->tail & q->mask];
+    atomic_store_explicit(
+        &cell->seq, q->tail + q->mask + 1, memory_order_release);
+    q->tail++;
+}
+
+#endif /* _MPSC_QUEUE_H_ */
@@ -0,0 +1,45 @@
+#include "secure_gateway.h"
+
+const uint8_t  msg_index_level1[MAVLINK_MSG_INDEX_PAGES] = MAVLINK_MSG_INDEX_LEVEL1;
+const uint16_t msg_index_level2[MAVLINK_MSG_INDEX_USED_PAGES]
+                               [1 << MAVLINK_MSG_INDEX_PAGE_BITS]
+    = MAVLINK_MSG_INDEX_LEVEL2;
+const mavlink_msg_entry_t msg_index_entries[] = MAVLINK_MESSAGE_CRCS;
+
+static_assert(sizeof(msg_index_entries) / sizeof(msg_index_entries[0])
+        == MAVLINK_MSG_INDEX_COUNT,
+    "message index does not match MAVLINK_MESSAGE_CRCS, regenerate it");
+
+#ifdef MAVLINK_USE_MESSAGE_INFO
+/* mavgen emits MAVLINK_MESSAGE_INFO in the same msgid order */
+static const mavlink_message_info_t msg_index_info[] = MAVLINK_MESSAGE_INFO;
+
+static_assert(sizeof(msg_index_info) / sizeof(msg_index_info[0])
+        == MAVLINK_MSG_INDEX_COUNT,
+    "message index does not match MAVLINK_MESSAGE_INFO, regenerate it");
+
+const mavlink_message_info_t*
+message_info(uint32_t msgid)
+{
+    int i = msg_index(msgid);
+    if (i == MSG_INDEX_NONE || msg_index_info[i].msgid != msgid)
+    {
+        return NULL;
+    }
+    return &msg_index_info[i];
+}
+
+/* linear, for configuration only */
+const mavlink_message_info_t*
+message_info_by_name(const char* name)
+{
+    for (size_t i = 0; i < MAVLINK_MSG_INDEX_COUNT; i++)
+    {
+        if (strcmp(msg_index_info[i].name, name) == 0)
+        {
+            return &msg_index_info[i];
+        }
+    }
+    return NULL;
+}
+#endif
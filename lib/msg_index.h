@@ -0,0 +1,51 @@
+#ifndef _MSG_INDEX_H_
+#define _MSG_INDEX_H_
+
+/*
+ * Constant-time message metadata lookup.
+ *
+ * tools/gen_msg_index.py turns MAVLINK_MESSAGE_CRCS of the generated dialect
+ * into a two-level table at build time: msgid >> 8 selects a 256-entry page,
+ * msgid & 0xFF the dense index of the message (its position in
+ * MAVLINK_MESSAGE_CRCS and MAVLINK_MESSAGE_INFO). The dense index is also
+ * what per-message tables in the gateway are indexed by.
+ *
+ * This header is included before <mavlink.h> and replaces the binary search
+ * of mavlink_get_msg_entry() through MAVLINK_GET_MSG_ENTRY, so the MAVLink
+ * parser and finalizer pick it up as well.
+ */
+
+#include <mavlink_types.h>
+#include <mavlink_msg_index.h>
+
+#define MSG_INDEX_NONE (-1)
+
+extern const uint8_t  msg_index_level1[MAVLINK_MSG_INDEX_PAGES];
+extern const uint16_t msg_index_level2[MAVLINK_MSG_INDEX_USED_PAGES]
+                                      [1 << MAVLINK_MSG_INDEX_PAGE_BITS];
+extern const mavlink_msg_entry_t msg_index_entries[MAVLINK_MSG_INDEX_COUNT];
+
+/* dense index of msgid in [0, MAVLINK_MSG_INDEX_COUNT), or MSG_INDEX_NONE */
+static inline int
+msg_index(uint32_t msgid)
+{
+    uint32_t page = msgid >> MAVLINK_MSG_INDEX_PAGE_BITS;
+    if (page >= MAVLINK_MSG_INDEX_PAGES || msg_index_level1[page] == 0)
+    {
+        return MSG_INDEX_NONE;
+    }
+
+    uint16_t slot = msg_index_level2[msg_index_level1[page] - 1]
+                                    [msgid & ((1 << MAVLINK_MSG_INDEX_PAGE_BITS) - 1)];
+    return (int)slot - 1;
+}
+
+#define MAVLINK_GET_MSG_ENTRY
+static inline const mavlink_msg_entry_t*
+mavlink_get_msg_entry(uint32_t msgid)
+{
+    int i = msg_index(msgid);
+    return i == MSG_INDEX_NONE ? NULL : &msg_index_entries[i];
+}
+
+#endif /* _MSG_INDEX_H_ */
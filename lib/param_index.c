@@ -0,0 +1,45 @@
+#include "param_index.h"
+
+static const uint16_t protected_param_seeds[PROTECTED_PARAMS_BUCKETS]
+    = PROTECTED_PARAMS_SEEDS;
+static const struct protected_param_t protected_params[PROTECTED_PARAMS_SLOTS]
+    = PROTECTED_PARAMS;
+
+static_assert((PROTECTED_PARAMS_BUCKETS & (PROTECTED_PARAMS_BUCKETS - 1)) == 0
+        && (PROTECTED_PARAMS_SLOTS & (PROTECTED_PARAMS_SLOTS - 1)) == 0,
+    "protected parameter tables must be powers of two, regenerate them");
+
+/**
+ * The rule of param_id id, or NULL if the parameter is not protected.
+ */
+const struct protected_param_t*
+protected_param(const char* id)
+{
+    uint32_t h      = param_index_hash(id);
+    uint32_t bucket = h & (PROTECTED_PARAMS_BUCKETS - 1);
+    uint32_t slot   = param_index_mix(h, protected_param_seeds[bucket])
+        & (PROTECTED_PARAMS_SLOTS - 1);
+
+    const struct protected_param_t* param = &protected_params[slot];
+    if (param->rule == PARAM_RULE_NONE
+        || strncmp(param->name, id, PARAM_NAME_LEN) != 0)
+    {
+        return NULL;
+    }
+    return param;
+}
+
+bool
+protected_param_allows(const struct protected_param_t* param, float value)
+{
+    switch (param->rule)
+    {
+    case PARAM_RULE_RANGE:
+        /* NaN is outside every range */
+        return value >= param->min && value <= param->max;
+    case PARAM_RULE_READONLY:
+        return false;
+    default:
+        return true;
+    }
+}
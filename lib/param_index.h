@@ -0,0 +1,62 @@
+#ifndef _PARAM_INDEX_H_
+#define _PARAM_INDEX_H_
+
+/*
+ * Constant-time lookup of protected parameters.
+ *
+ * tools/gen_param_index.py turns protected_params.txt into a perfect hash
+ * at build time: the hash of a name selects a bucket, the hash mixed with
+ * the seed of the bucket the slot of the name. A PARAM_SET is checked with
+ * one hash of its param_id and one compare, however many parameters are
+ * protected.
+ */
+
+#include "context.h"
+
+#define PARAM_NAME_LEN 16 /* of param_id */
+
+enum param_rule_t
+{
+    PARAM_RULE_NONE = 0,
+    PARAM_RULE_READONLY, /* may not be set */
+    PARAM_RULE_RANGE,    /* may be set to values in [min, max] */
+};
+
+struct protected_param_t
+{
+    char              name[PARAM_NAME_LEN]; /* NUL-terminated unless full */
+    enum param_rule_t rule;
+    float             min, max;
+};
+
+#include <protected_params.h>
+
+/* FNV-1a, and the murmur3 finalizer; must match tools/gen_param_index.py */
+static inline uint32_t
+param_index_hash(const char* id)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < PARAM_NAME_LEN && id[i] != '\0'; i++)
+    {
+        h = (h ^ (uint8_t)id[i]) * 16777619u;
+    }
+    return h;
+}
+
+static inline uint32_t
+param_index_mix(uint32_t h, uint32_t seed)
+{
+    h ^= seed;
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+}
+
+const struct protected_param_t* protected_param(const char* id);
+bool protected_param_allows(
+    const struct protected_param_t* param, float value);
+
+#endif /* _PARAM_INDEX_H_ */
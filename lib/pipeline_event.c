@@ -0,0 +1,117 @@
+#ifndef _STD_LIBC_
+#error "This file requires epoll!"
+#endif
+
+#include "secure_gateway.h"
+#include <errno.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+/* wake up periodically so the console and perf reports keep running */
+#define PIPELINE_EVENT_TIMEOUT_MS 100
+/* sources without a pollable fd are still polled, just less eagerly */
+#define PIPELINE_POLL_TIMEOUT_MS  1
+
+/*
+ * Add the fd of a source to the epoll set, unless it is there already.
+ * Sources open their device or socket lazily, so the fd may only become
+ * valid (or change) after pipeline_event_init(); false if there is none.
+ */
+static bool
+pipeline_event_register(struct pipeline_t* pipeline, size_t i)
+{
+    struct source_t* src = &pipeline->sources.sources[i];
+    int              fd  = src->poll_fd != NULL ? src->poll_fd(src) : -1;
+
+    if (fd == -1)
+    {
+        return false;
+    }
+    if (fd == pipeline->epoll_fds[i])
+    {
+        return true;
+    }
+
+    struct epoll_event ev = {
+        .events = EPOLLIN,
+        .data   = { .u64 = i },
+    };
+    /* a closed fd leaves the set by itself, one still open has to move */
+    if (epoll_ctl(pipeline->epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1
+        && (errno != EEXIST
+            || epoll_ctl(pipeline->epoll_fd, EPOLL_CTL_MOD, fd, &ev) == -1))
+    {
+        perror("Failed to register source with epoll!");
+        return false;
+    }
+    pipeline->epoll_fds[i] = fd;
+    return true;
+}
+
+int
+pipeline_event_init(struct pipeline_t* pipeline)
+{
+    ASSERT(pipeline != NULL && "pipeline is NULL");
+
+    pipeline->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (pipeline->epoll_fd == -1)
+    {
+        perror("Failed to create epoll instance!");
+        return SEC_GATEWAY_IO_FAULT;
+    }
+
+    for (size_t i = 0; i < MAX_SOURCES; i++)
+    {
+        struct source_t* src = &pipeline->sources.sources[i];
+        pipeline->epoll_fds[i] = -1;
+        if (src->is_connected && src->poll_fd != NULL
+            && !pipeline_event_register(pipeline, i))
+        {
+            WARN("source %s has no pollable fd yet, it will be polled\n",
+                source_name(i));
+        }
+    }
+
+    return SUCC;
+}
+
+void
+pipeline_event_wait(struct pipeline_t* pipeline, struct bitmap_t* ready)
+{
+    struct epoll_event events[MAX_SOURCES];
+    int                timeout = PIPELINE_EVENT_TIMEOUT_MS;
+
+    bitmap_clear(ready);
+
+    for (size_t i = 0; i < MAX_SOURCES; i++)
+    {
+        struct source_t* src = &pipeline->sources.sources[i];
+        if (src->is_connected && !pipeline_event_register(pipeline, i))
+        {
+            bitmap_set(ready, i);
+            timeout = PIPELINE_POLL_TIMEOUT_MS;
+        }
+    }
+
+    int n = epoll_wait(pipeline->epoll_fd, events, MAX_SOURCES, timeout);
+    if (n == -1 && errno != EINTR)
+    {
+        perror("epoll_wait() failed!");
+        return;
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        bitmap_set(ready, (size_t)events[i].data.u64);
+    }
+}
+
+void
+pipeline_event_cleanup(struct pipeline_t* pipeline)
+{
+    if (pipeline->epoll_fd != -1)
+    {
+        close(pipeline->epoll_fd);
+        pipeline->epoll_fd = -1;
+    }
+}
@@ -0,0 +1,271 @@
+#ifndef _STD_LIBC_
+#error "This file requires threads and poll!"
+#endif
+
+#include "secure_gateway.h"
+#include "mpsc_queue.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <threads.h>
+
+/*
+ * Threaded pipeline mode: every source gets an ingest thread that reads and
+ * parses its own byte stream (each source owns its frame parser, so parsers
+ * never share state) and runs the source transform. Completed frames are
+ * published to a lock-free MPSC queue; pipeline_spin() is the only consumer
+ * and runs routing, policies and sink delivery in arrival order.
+ */
+
+/* must be a power of 2, and well below MESSAGE_POOL_SIZE */
+#define PIPELINE_INGEST_QUEUE_LEN 512
+/* ingest threads re-check for termination at least this often */
+#define PIPELINE_INGEST_TIMEOUT_MS 100
+/* sources without a pollable fd are polled at this interval */
+#define PIPELINE_INGEST_POLL_US 1000
+
+struct ingest_thread_t
+{
+    struct pipeline_t* pipeline;
+    struct source_t*   src;
+    thrd_t             thread;
+    bool               running;
+};
+
+struct pipeline_ingest_t
+{
+    struct mpsc_queue_t    queue;
+    struct mpsc_cell_t     cells[PIPELINE_INGEST_QUEUE_LEN];
+    struct ingest_thread_t threads[MAX_SOURCES];
+    atomic_bool            terminated;
+    atomic_bool            consumer_waiting;
+    int                    event_fd;
+    size_t                 full_stalls;
+};
+
+static void
+ingest_sleep_us(uint64_t us)
+{
+    struct timespec ts = {
+        .tv_sec  = us / 1000000,
+        .tv_nsec = (us % 1000000) * 1000,
+    };
+    thrd_sleep(&ts, NULL);
+}
+
+/* pipeline->push() of the ingest threads, one wakeup per batch */
+static int
+pipeline_ingest_enqueue(
+    struct pipeline_t* pipeline, struct message_t* const* msgs, size_t n)
+{
+    struct pipeline_ingest_t* ingest = pipeline->ingest;
+    int                       rv     = SUCC;
+
+    for (size_t k = 0; k < n && rv == SUCC; k++)
+    {
+        /* the queue holds its own reference until the consumer is done */
+        struct message_t* msg = message_ref(msgs[k]);
+        if (msg == NULL)
+        {
+            rv = SEC_GATEWAY_NO_MEMORY;
+            break;
+        }
+
+        while (!mpsc_queue_push(&ingest->queue, msg))
+        {
+            /* the routing stage is behind, apply back-pressure */
+            if (atomic_load(&ingest->terminated))
+            {
+                message_put(msg);
+                rv = SEC_GATEWAY_NO_RESOURCE;
+                break;
+            }
+            __atomic_fetch_add(&ingest->full_stalls, 1, __ATOMIC_RELAXED);
+            thrd_yield();
+        }
+    }
+
+    if (atomic_load(&ingest->consumer_waiting))
+    {
+        event_notify(ingest->event_fd);
+    }
+    return rv;
+}
+
+static int
+ingest_thread(void* arg)
+{
+    struct ingest_thread_t*   t      = arg;
+    struct pipeline_ingest_t* ingest = t->pipeline->ingest;
+    struct source_t*          src    = t->src;
+    int fd = src->poll_fd != NULL ? src->poll_fd(src) : -1;
+
+    while (!atomic_load(&ingest->terminated))
+    {
+        if (pipeline_drain_source(t->pipeline, src))
+        {
+            continue;
+        }
+
+        if (fd == -1)
+        {
+            ingest_sleep_us(PIPELINE_INGEST_POLL_US);
+            /* the source may open its device or socket later on */
+            fd = src->poll_fd != NULL ? src->poll_fd(src) : -1;
+            continue;
+        }
+
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        if (poll(&pfd, 1, PIPELINE_INGEST_TIMEOUT_MS) == -1 && errno != EINTR)
+        {
+            perror("Failed to poll source!");
+            ingest_sleep_us(PIPELINE_INGEST_POLL_US);
+        }
+    }
+
+    return 0;
+}
+
+int
+pipeline_ingest_start(struct pipeline_t* pipeline)
+{
+    ASSERT(pipeline != NULL && "pipeline is NULL");
+    ASSERT(pipeline->ingest == NULL && "ingest threads already started");
+
+    struct pipeline_ingest_t* ingest = calloc(1, sizeof(*ingest));
+    if (ingest == NULL)
+    {
+        return SEC_GATEWAY_NO_MEMORY;
+    }
+
+    ingest->event_fd = event_create();
+    if (ingest->event_fd == -1)
+    {
+        perror("Failed to create eventfd!");
+        free(ingest);
+        return SEC_GATEWAY_IO_FAULT;
+    }
+    mpsc_queue_init(&ingest->queue, ingest->cells, PIPELINE_INGEST_QUEUE_LEN);
+    atomic_init(&ingest->terminated, false);
+    atomic_init(&ingest->consumer_waiting, false);
+
+    pipeline->ingest = ingest;
+    pipeline->push   = pipeline_ingest_enqueue;
+
+    for (size_t i = 0; i < MAX_SOURCES; i++)
+    {
+        struct source_t* src = &pipeline->sources.sources[i];
+        if (!src->is_connected)
+        {
+            continue;
+        }
+
+        struct ingest_thread_t* t = &ingest->threads[i];
+        t->pipeline = pipeline;
+        t->src      = src;
+        if (thrd_create(&t->thread, ingest_thread, t) != thrd_success)
+        {
+            WARN("Failed to create ingest thread for source %s\n",
+                source_name(i));
+            pipeline_ingest_stop(pipeline);
+            return SEC_GATEWAY_THREAD_ERROR;
+        }
+        t->running = true;
+    }
+
+    return SUCC;
+}
+
+void
+pipeline_ingest_wait(struct pipeline_t* pipeline)
+{
+    struct pipeline_ingest_t* ingest = pipeline->ingest;
+    ASSERT(ingest != NULL && "ingest threads are not started");
+
+    if (mpsc_queue_peek(&ingest->queue) != NULL)
+    {
+        return;
+    }
+
+    /* announce the sleep, then re-check so a concurrent push is not lost */
+    atomic_store(&ingest->consumer_waiting, true);
+    if (mpsc_queue_peek(&ingest->queue) == NULL)
+    {
+        struct pollfd pfd = { .fd = ingest->event_fd, .events = POLLIN };
+        if (poll(&pfd, 1, PIPELINE_INGEST_TIMEOUT_MS) == -1 && errno != EINTR)
+        {
+            perror("Failed to wait for ingest queue!");
+        }
+    }
+    atomic_store(&ingest->consumer_waiting, false);
+    event_clear(ingest->event_fd);
+}
+
+bool
+pipeline_ingest_dispatch(struct pipeline_t* pipeline)
+{
+    struct pipeline_ingest_t* ingest = pipeline->ingest;
+    struct message_t*         batch[PIPELINE_BATCH];
+    size_t                    total = 0, n;
+
+    ASSERT(ingest != NULL && "ingest threads are not started");
+
+    /* bounded, so the console and perf reports still get their turn */
+    do
+    {
+        for (n = 0; n < PIPELINE_BATCH; n++)
+        {
+            batch[n] = mpsc_queue_peek(&ingest->queue);
+            if (batch[n] == NULL)
+            {
+                break;
+            }
+            mpsc_queue_release(&ingest->queue);
+        }
+        pipeline_push_batch(pipeline, batch, n);
+        for (size_t k = 0; k < n; k++)
+        {
+            message_put(batch[k]);
+        }
+        total += n;
+    } while (n == PIPELINE_BATCH && total < PIPELINE_INGEST_QUEUE_LEN);
+
+    return total > 0;
+}
+
+void
+pipeline_ingest_stop(struct pipeline_t* pipeline)
+{
+    struct pipeline_ingest_t* ingest = pipeline->ingest;
+
+    if (ingest == NULL)
+    {
+        return;
+    }
+
+    atomic_store(&ingest->terminated, true);
+    for (size_t i = 0; i < MAX_SOURCES; i++)
+    {
+        if (ingest->threads[i].running)
+        {
+            thrd_join(ingest->threads[i].thread, NULL);
+        }
+    }
+
+    struct message_t* msg;
+    while ((msg = mpsc_queue_peek(&ingest->queue)) != NULL)
+    {
+        mpsc_queue_release(&ingest->queue);
+        message_put(msg);
+    }
+
+    if (ingest->full_stalls > 0)
+    {
+        INFO("ingest queue was full %zu times\n", ingest->full_stalls);
+    }
+
+    pipeline->push   = pipeline_push_batch;
+    pipeline->ingest = NULL;
+    close(ingest->event_fd);
+    free(ingest);
+}
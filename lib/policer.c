@@ -0,0 +1,110 @@
+#include "policer.h"
+
+static_assert(MAX_SOURCES <= UINT8_MAX, "sources are 8-bit in bucket keys");
+static_assert(MAVLINK_MSG_INDEX_COUNT < UINT16_MAX,
+    "message indices are 16-bit in bucket keys");
+
+void
+policer_init(struct policer_t* policer)
+{
+    memset(policer->classes, 0, sizeof(policer->classes));
+    memset(policer->class_of, 0, sizeof(policer->class_of));
+    policer->class_count = 1;
+    /* the timeout grows with the slowest class, see policer_set_rate() */
+    link_table_init(&policer->buckets, policer->bucket_slots,
+        sizeof(struct policer_bucket_t), POLICER_BUCKETS, 0);
+}
+
+/**
+ * Police msgid, or every message with POLICER_ALL_MSGIDS, from source:
+ * rate messages per second per sysid, in bursts of up to burst.
+ */
+int
+policer_set_rate(struct policer_t* policer, size_t source, uint32_t msgid,
+    uint32_t rate, uint32_t burst, enum policer_action_t action)
+{
+    if (source >= MAX_SOURCES || rate == 0 || rate > 1000000 || burst == 0)
+    {
+        return SEC_GATEWAY_INVALID_PARAM;
+    }
+    int index = MSG_INDEX_NONE;
+    if (msgid != POLICER_ALL_MSGIDS)
+    {
+        index = msg_index(msgid);
+        if (index == MSG_INDEX_NONE)
+        {
+            WARN("policer: message %u is not in the dialect\n", msgid);
+            return SEC_GATEWAY_INVALID_PARAM;
+        }
+    }
+    if (policer->class_count == POLICER_MAX_CLASSES)
+    {
+        return SEC_GATEWAY_NO_RESOURCE;
+    }
+
+    size_t                  c   = policer->class_count++;
+    struct policer_class_t* cls = &policer->classes[c];
+    cls->interval_us            = 1000000 / rate;
+    cls->tolerance_us           = (burst - 1) * cls->interval_us;
+    cls->action                 = action;
+
+    if (index == MSG_INDEX_NONE)
+    {
+        memset(policer->class_of[source], (int)c,
+            sizeof(policer->class_of[source]));
+    }
+    else
+    {
+        policer->class_of[source][index] = (uint8_t)c;
+    }
+
+    /* an idle bucket is full again, it may as well be forgotten */
+    uint64_t refill = cls->tolerance_us + cls->interval_us;
+    if (policer->buckets.timeout_us < refill)
+    {
+        policer->buckets.timeout_us = refill;
+    }
+    return SUCC;
+}
+
+/**
+ * Charge msg to its bucket, false if it is to be dropped.
+ */
+bool
+policer_admit(struct policer_t* policer, struct message_t* msg, uint64_t now)
+{
+    int    i     = msg_index(msg->msg.msgid);
+    size_t index = i == MSG_INDEX_NONE ? MAVLINK_MSG_INDEX_COUNT : (size_t)i;
+    size_t c     = policer->class_of[msg->source][index];
+    if (c == 0)
+    {
+        return true;
+    }
+
+    const struct policer_class_t* cls = &policer->classes[c];
+    uint32_t key = (uint32_t)msg->source << 24 | (uint32_t)msg->msg.sysid << 16
+        | (uint32_t)index;
+    struct policer_bucket_t* bucket
+        = link_table_find(&policer->buckets, key, now);
+    if (bucket == NULL)
+    {
+        size_t evicted = policer->buckets.evicted;
+        bucket         = link_table_insert(&policer->buckets, key, now);
+        bucket->tat    = policer->buckets.evicted == evicted
+               ? now
+               : now + cls->tolerance_us + cls->interval_us;
+    }
+
+    uint64_t tat = bucket->tat > now ? bucket->tat : now;
+    if (tat - now > cls->tolerance_us)
+    {
+        if (cls->action == POLICER_DROP)
+        {
+            return false;
+        }
+        msg->attribute |= MESSAGE_ATTRIBUTE_POLICED;
+        return true;
+    }
+    bucket->tat = tat + cls->interval_us;
+    return true;
+}
@@ -0,0 +1,71 @@
+#ifndef _POLICER_H_
+#define _POLICER_H_
+
+#include "link_table.h"
+
+/*
+ * Flood policing ahead of the policies.
+ *
+ * Every (source, sysid, msgid) gets a token bucket of the rate class its
+ * (source, msgid) is set to: rate messages per second, bursts of up to
+ * burst. Messages above the rate are dropped, or let through marked with
+ * MESSAGE_ATTRIBUTE_POLICED for a full egress queue to shed before anything
+ * else. The gateway sets built-in rates; "police" rules of a rules file
+ * replace them (see policy_rules.h).
+ *
+ * A bucket is one theoretical arrival time (GCRA), kept in a bounded link
+ * table; a bucket that had to evict a live one starts out empty, so spoofing
+ * sysids to churn the table buys nothing.
+ *
+ * Not thread-safe: it runs on the pipeline thread.
+ */
+
+#ifndef POLICER_BUCKETS
+#ifdef _STD_LIBC_
+#define POLICER_BUCKETS 1024
+#else
+#define POLICER_BUCKETS 64
+#endif
+#endif
+
+#define POLICER_MAX_CLASSES 16
+#define POLICER_ALL_MSGIDS  UINT32_MAX
+
+enum policer_action_t
+{
+    POLICER_DROP = 0,
+    POLICER_MARK,
+};
+
+struct policer_class_t
+{
+    uint64_t              interval_us; /* between two messages at the rate */
+    uint64_t              tolerance_us; /* how far ahead a burst may run */
+    enum policer_action_t action;
+};
+
+struct policer_bucket_t
+{
+    struct link_slot_t slot;
+    uint64_t           tat; /* theoretical arrival time of the next message */
+};
+
+struct policer_t
+{
+    /* rate classes, 0 is "not policed" */
+    struct policer_class_t classes[POLICER_MAX_CLASSES];
+    size_t                 class_count;
+    uint8_t class_of[MAX_SOURCES][MAVLINK_MSG_INDEX_COUNT + 1];
+
+    struct link_table_t     buckets;
+    struct policer_bucket_t bucket_slots[POLICER_BUCKETS];
+};
+
+void policer_init(struct policer_t* policer);
+int  policer_set_rate(struct policer_t* policer, size_t source,
+     uint32_t msgid, uint32_t rate, uint32_t burst,
+     enum policer_action_t action);
+bool policer_admit(
+    struct policer_t* policer, struct message_t* msg, uint64_t now);
+
+#endif /* _POLICER_H_ */
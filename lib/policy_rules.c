@@ -0,0 +1,750 @@
+#include "policy_rules.h"
+#include "policer.h"
+#include <errno.h>
+#include <mavlink_enum_index.h>
+
+struct policy_rules_enum_t
+{
+    const char* name;
+    int64_t     value;
+};
+
+static const struct policy_rules_enum_t policy_rules_enums[]
+    = MAVLINK_ENUM_INDEX;
+
+/* rules of the pipeline, and the ones being compiled */
+static struct policy_rule_t policy_rules[MAX_POLICIES];
+static struct policy_rule_t policy_rules_staged[MAX_POLICIES];
+
+static inline int
+policy_rules_holds(uint8_t op, int cmp)
+{
+    switch (op)
+    {
+    case POLICY_RULE_OP_EQ: return cmp == 0;
+    case POLICY_RULE_OP_NE: return cmp != 0;
+    case POLICY_RULE_OP_LT: return cmp < 0;
+    case POLICY_RULE_OP_LE: return cmp <= 0;
+    case POLICY_RULE_OP_GT: return cmp > 0;
+    default: return cmp >= 0;
+    }
+}
+
+#define POLICY_RULES_CMP(a, b) (((a) > (b)) - ((a) < (b)))
+
+/* payloads are little-endian and unaligned */
+#define POLICY_RULES_LOAD(T, dst, p)                                           \
+    do                                                                         \
+    {                                                                          \
+        T v_;                                                                  \
+        memcpy(&v_, (p), sizeof(T));                                           \
+        (dst) = v_;                                                            \
+    } while (0)
+
+static inline int
+policy_rules_term(const struct policy_rule_term_t* t, const uint8_t* payload)
+{
+    const uint8_t* p = payload + t->offset;
+    int64_t        i;
+    double         f;
+
+    switch (t->type)
+    {
+    case MAVLINK_TYPE_CHAR:
+        if (t->len != 0)
+        {
+            int cmp = strncmp((const char*)p, t->value.s, t->len);
+            return policy_rules_holds(t->op, POLICY_RULES_CMP(cmp, 0));
+        }
+        i = *p;
+        break;
+    case MAVLINK_TYPE_UINT8_T: i = *p; break;
+    case MAVLINK_TYPE_INT8_T: i = (int8_t)*p; break;
+    case MAVLINK_TYPE_UINT16_T: POLICY_RULES_LOAD(uint16_t, i, p); break;
+    case MAVLINK_TYPE_INT16_T: POLICY_RULES_LOAD(int16_t, i, p); break;
+    case MAVLINK_TYPE_UINT32_T: POLICY_RULES_LOAD(uint32_t, i, p); break;
+    case MAVLINK_TYPE_INT32_T: POLICY_RULES_LOAD(int32_t, i, p); break;
+    case MAVLINK_TYPE_INT64_T: POLICY_RULES_LOAD(int64_t, i, p); break;
+    case MAVLINK_TYPE_UINT64_T:
+    {
+        uint64_t u;
+        POLICY_RULES_LOAD(uint64_t, u, p);
+        return policy_rules_holds(t->op, POLICY_RULES_CMP(u, t->value.u));
+    }
+    case MAVLINK_TYPE_FLOAT:
+        POLICY_RULES_LOAD(float, f, p);
+        goto real;
+    default:
+        POLICY_RULES_LOAD(double, f, p);
+        goto real;
+    }
+    return policy_rules_holds(t->op, POLICY_RULES_CMP(i, t->value.i));
+
+real:
+    /* NaN is unordered: only != holds */
+    if (f != f)
+    {
+        return t->op == POLICY_RULE_OP_NE;
+    }
+    return policy_rules_holds(t->op, POLICY_RULES_CMP(f, t->value.f));
+}
+
+/**
+ * Reject the message if every term of the rule holds for it. The policy
+ * table already matched the source and message of the rule.
+ */
+int
+policy_rules_check(const struct security_policy_t* policy,
+    const struct message_t* msg, size_t* attribute)
+{
+    const struct policy_rule_t* rule = policy->arg;
+    const uint8_t* payload = (const uint8_t*)_MAV_PAYLOAD(&msg->msg);
+
+    for (size_t k = 0; k < rule->count; k++)
+    {
+        if (!policy_rules_term(&rule->terms[k], payload))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Compiler
+ */
+
+enum policy_rules_token_t
+{
+    TOKEN_END,
+    TOKEN_IDENT,
+    TOKEN_NUMBER,
+    TOKEN_STRING,
+    TOKEN_OP,
+    TOKEN_AND,
+    TOKEN_ARROW,
+    TOKEN_DOT,
+    TOKEN_COMMA,
+    TOKEN_ERROR,
+};
+
+struct policy_rules_lexer_t
+{
+    const char* name;
+    size_t      line;
+    const char* p;
+
+    /* identifiers and strings of the line, NUL-terminated */
+    char   store[2 * POLICY_RULE_MAX_LINE];
+    size_t used;
+
+    /* current token */
+    enum policy_rules_token_t token;
+    const char*               text; /* ident or string, in store */
+    bool                      real; /* number has a fraction or exponent */
+    int64_t                   i;
+    double                    f;
+    uint8_t                   op;
+};
+
+#define RULE_ERROR(lx, fmt, ...)                                               \
+    WARN("%s:%lu: " fmt "\n", (lx)->name, (lx)->line, ##__VA_ARGS__)
+
+static const char*
+policy_rules_store(struct policy_rules_lexer_t* lx, const char* p, size_t len)
+{
+    /* a line holds fewer tokens than bytes, this cannot overflow */
+    char* text = &lx->store[lx->used];
+    memcpy(text, p, len);
+    text[len] = '\0';
+    lx->used += len + 1;
+    return text;
+}
+
+static bool
+policy_rules_ident_char(char c)
+{
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')
+        || (c >= '0' && c <= '9') || c == '_';
+}
+
+static enum policy_rules_token_t
+policy_rules_next(struct policy_rules_lexer_t* lx)
+{
+    const char* p = lx->p;
+    while (*p == ' ' || *p == '\t' || *p == '\r')
+    {
+        p++;
+    }
+
+    if (*p == '\0' || *p == '#')
+    {
+        lx->p = p;
+        return lx->token = TOKEN_END;
+    }
+
+    if (policy_rules_ident_char(*p) && !(*p >= '0' && *p <= '9'))
+    {
+        const char* end = p;
+        while (policy_rules_ident_char(*end))
+        {
+            end++;
+        }
+        lx->text = policy_rules_store(lx, p, (size_t)(end - p));
+        lx->p    = end;
+        return lx->token = TOKEN_IDENT;
+    }
+
+    if (p[0] == '-' && p[1] == '>')
+    {
+        lx->p = p + 2;
+        return lx->token = TOKEN_ARROW;
+    }
+
+    if ((*p >= '0' && *p <= '9') || *p == '-'
+        || (*p == '.' && p[1] >= '0' && p[1] <= '9'))
+    {
+        char* end;
+        errno    = 0;
+        lx->i    = strtoll(p, &end, 0);
+        lx->real = *end == '.' || *end == 'e' || *end == 'E';
+        if (lx->real)
+        {
+            lx->f = strtod(p, &end);
+        }
+        else
+        {
+            lx->f = (double)lx->i;
+        }
+        if (end == p || errno != 0 || policy_rules_ident_char(*end))
+        {
+            return lx->token = TOKEN_ERROR;
+        }
+        lx->p = end;
+        return lx->token = TOKEN_NUMBER;
+    }
+
+    if (*p == '"')
+    {
+        const char* end = strchr(p + 1, '"');
+        if (end == NULL)
+        {
+            return lx->token = TOKEN_ERROR;
+        }
+        lx->text = policy_rules_store(lx, p + 1, (size_t)(end - p - 1));
+        lx->p    = end + 1;
+        return lx->token = TOKEN_STRING;
+    }
+
+    if (p[0] == '&' && p[1] == '&')
+    {
+        lx->p = p + 2;
+        return lx->token = TOKEN_AND;
+    }
+
+    lx->p     = p + 2;
+    lx->token = TOKEN_OP;
+    if (p[1] == '=')
+    {
+        switch (p[0])
+        {
+        case '=': lx->op = POLICY_RULE_OP_EQ; return lx->token;
+        case '!': lx->op = POLICY_RULE_OP_NE; return lx->token;
+        case '<': lx->op = POLICY_RULE_OP_LE; return lx->token;
+        case '>': lx->op = POLICY_RULE_OP_GE; return lx->token;
+        }
+    }
+
+    lx->p = p + 1;
+    switch (p[0])
+    {
+    case '<': lx->op = POLICY_RULE_OP_LT; return lx->token;
+    case '>': lx->op = POLICY_RULE_OP_GT; return lx->token;
+    case '.': return lx->token = TOKEN_DOT;
+    case ',': return lx->token = TOKEN_COMMA;
+    }
+    return lx->token = TOKEN_ERROR;
+}
+
+static int
+policy_rules_enum_cmp(const void* key, const void* entry)
+{
+    return strcmp(key, ((const struct policy_rules_enum_t*)entry)->name);
+}
+
+static int
+policy_rules_message(struct policy_rules_lexer_t* lx,
+    struct policy_rule_t* rule, const mavlink_message_info_t** info,
+    const char* name)
+{
+    const mavlink_message_info_t* m = message_info_by_name(name);
+    if (m == NULL)
+    {
+        RULE_ERROR(lx, "unknown message %s", name);
+        return SEC_GATEWAY_INVALID_PARAM;
+    }
+    if (*info != NULL && *info != m)
+    {
+        RULE_ERROR(lx, "rule mixes messages %s and %s", (*info)->name, name);
+        return SEC_GATEWAY_INVALID_PARAM;
+    }
+    *info       = m;
+    rule->msgid = m->msgid;
+    return SUCC;
+}
+
+/* field op value, the lexer is at op */
+static int
+policy_rules_term_compile(struct policy_rules_lexer_t* lx,
+    struct policy_rule_t* rule, const mavlink_message_info_t* info,
+    const char* name)
+{
+    const mavlink_field_info_t* field = NULL;
+    for (unsigned k = 0; k < info->num_fields; k++)
+    {
+        if (strcmp(info->fields[k].name, name) == 0)
+        {
+            field = &info->fields[k];
+            break;
+        }
+    }
+    if (field == NULL)
+    {
+        RULE_ERROR(lx, "%s has no field %s", info->name, name);
+        return SEC_GATEWAY_INVALID_PARAM;
+    }
+    if (field->array_length != 0 && field->type != MAVLINK_TYPE_CHAR)
+    {
+        RULE_ERROR(lx, "%s.%s: array fields are not supported", info->name,
+            name);
+        return SEC_GATEWAY_INVALID_PARAM;
+    }
+    if (rule->count == POLICY_RULE_MAX_TERMS)
+    {
+        RULE_ERROR(lx, "more than %d terms", POLICY_RULE_MAX_TERMS);
+        return SEC_GATEWAY_NO_RESOURCE;
+    }
+
+    struct policy_rule_term_t* t = &rule->terms[rule->count];
+    memset(t, 0, sizeof(*t));
+    t->type   = field->type;
+    t->op     = lx->op;
+    t->offset = field->wire_offset;
+    t->len    = field->array_length;
+
+    bool is_real = field->type == MAVLINK_TYPE_FLOAT
+        || field->type == MAVLINK_TYPE_DOUBLE;
+    switch (policy_rules_next(lx))
+    {
+    case TOKEN_STRING:
+        if (t->len == 0)
+        {
+            RULE_ERROR(lx, "%s.%s is not a string", info->name, name);
+            return SEC_GATEWAY_INVALID_PARAM;
+        }
+        if (strlen(lx->text) > t->len)
+        {
+            RULE_ERROR(lx, "\"%s\" does not fit %s.%s", lx->text, info->name,
+                name);
+            return SEC_GATEWAY_INVALID_PARAM;
+        }
+        strncpy(t->value.s, lx->text, sizeof(t->value.s));
+        break;
+    case TOKEN_IDENT:
+    {
+        const struct policy_rules_enum_t* e = bsearch(lx->text,
+            policy_rules_enums,
+            sizeof(policy_rules_enums) / sizeof(policy_rules_enums[0]),
+            sizeof(policy_rules_enums[0]), policy_rules_enum_cmp);
+        if (e == NULL)
+        {
+            RULE_ERROR(lx, "unknown constant %s", lx->text);
+            return SEC_GATEWAY_INVALID_PARAM;
+        }
+        lx->real = false;
+        lx->i    = e->value;
+        lx->f    = (double)e->value;
+    }
+    /* fall through */
+    case TOKEN_NUMBER:
+        if (t->len != 0)
+        {
+            RULE_ERROR(lx, "%s.%s is a string", info->name, name);
+            return SEC_GATEWAY_INVALID_PARAM;
+        }
+        if (lx->real && !is_real)
+        {
+            RULE_ERROR(lx, "%s.%s is an integer", info->name, name);
+            return SEC_GATEWAY_INVALID_PARAM;
+        }
+        if (is_real)
+            t->value.f = lx->f;
+        else
+            t->value.i = lx->i;
+        break;
+    default:
+        RULE_ERROR(lx, "expected a value after %s", name);
+        return SEC_GATEWAY_INVALID_PARAM;
+    }
+
+    rule->count++;
+    return SUCC;
+}
+
+static int
+policy_rules_sources(
+    struct policy_rules_lexer_t* lx, struct policy_rule_t* rule)
+{
+    bitmap_clear(&rule->sources);
+    do
+    {
+        if (policy_rules_next(lx) != TOKEN_IDENT)
+        {
+            RULE_ERROR(lx, "expected a source after 'from'");
+            return SEC_GATEWAY_INVALID_PARAM;
+        }
+        if (strcmp(lx->text, "vmc") == 0)
+        {
+            bitmap_set(&rule->sources, SOURCE_TYPE_VMC);
+        }
+        else if (strcmp(lx->text, "legacy") == 0)
+        {
+            bitmap_set(&rule->sources, SOURCE_TYPE_LEGACY);
+        }
+        else if (strcmp(lx->text, "enclave") == 0)
+        {
+            /* enclave sources are numbered from SOURCE_TYPE_ENCLAVE up */
+            for (size_t s = SOURCE_TYPE_ENCLAVE; s < MAX_SOURCES; s++)
+            {
+                bitmap_set(&rule->sources, s);
+            }
+        }
+        else
+        {
+            RULE_ERROR(lx, "unknown source %s", lx->text);
+            return SEC_GATEWAY_INVALID_PARAM;
+        }
+    } while (policy_rules_next(lx) == TOKEN_COMMA);
+    return SUCC;
+}
+
+/* "police" rate [burst] ["mark"], the lexer is at "police" */
+static int
+policy_rules_police(struct policy_rules_lexer_t* lx, struct policy_rule_t* rule)
+{
+    if (rule->count != 0)
+    {
+        RULE_ERROR(lx, "police takes no fields");
+        return SEC_GATEWAY_INVALID_PARAM;
+    }
+    if (policy_rules_next(lx) != TOKEN_NUMBER || lx->real || lx->i < 1
+        || lx->i > 1000000)
+    {
+        RULE_ERROR(lx, "police takes a rate of 1 to 1000000 per second");
+        return SEC_GATEWAY_INVALID_PARAM;
+    }
+    /* a second's worth of burst, unless given */
+    rule->rate  = (uint32_t)lx->i;
+    rule->burst = rule->rate;
+    if (policy_rules_next(lx) == TOKEN_NUMBER)
+    {
+        if (lx->real || lx->i < 1 || lx->i > UINT32_MAX)
+        {
+            RULE_ERROR(lx, "police takes a burst of at least 1");
+            return SEC_GATEWAY_INVALID_PARAM;
+        }
+        rule->burst = (uint32_t)lx->i;
+        policy_rules_next(lx);
+    }
+    if (lx->token == TOKEN_IDENT && strcmp(lx->text, "mark") == 0)
+    {
+        rule->mark = true;
+        policy_rules_next(lx);
+    }
+    return SUCC;
+}
+
+/* compile one line into rule, *blank is set for lines without a rule */
+static int
+policy_rules_line(
+    struct policy_rules_lexer_t* lx, struct policy_rule_t* rule, bool* blank)
+{
+    const mavlink_message_info_t* info = NULL;
+    int                           rv;
+
+    memset(rule, 0, sizeof(*rule));
+    memset(&rule->sources, 0xFF, sizeof(rule->sources));
+    rule->line  = lx->line;
+    rule->msgid = POLICY_RULE_ANY_MSGID;
+
+    *blank = policy_rules_next(lx) == TOKEN_END;
+    if (*blank)
+    {
+        return SUCC;
+    }
+
+    while (lx->token == TOKEN_IDENT && strcmp(lx->text, "from") != 0)
+    {
+        const char* name = lx->text;
+        switch (policy_rules_next(lx))
+        {
+        case TOKEN_DOT:
+            if ((rv = policy_rules_message(lx, rule, &info, name)) != SUCC)
+                return rv;
+            if (policy_rules_next(lx) != TOKEN_IDENT)
+            {
+                RULE_ERROR(lx, "expected a field of %s", info->name);
+                return SEC_GATEWAY_INVALID_PARAM;
+            }
+            name = lx->text;
+            if (policy_rules_next(lx) != TOKEN_OP)
+            {
+                RULE_ERROR(lx, "expected an operator after %s", name);
+                return SEC_GATEWAY_INVALID_PARAM;
+            }
+            /* fall through */
+        case TOKEN_OP:
+            if (info == NULL)
+            {
+                RULE_ERROR(lx, "field %s of no message", name);
+                return SEC_GATEWAY_INVALID_PARAM;
+            }
+            rv = policy_rules_term_compile(lx, rule, info, name);
+            if (rv != SUCC)
+                return rv;
+            policy_rules_next(lx);
+            break;
+        default:
+            if ((rv = policy_rules_message(lx, rule, &info, name)) != SUCC)
+                return rv;
+            break;
+        }
+
+        if (lx->token != TOKEN_AND)
+        {
+            break;
+        }
+        policy_rules_next(lx);
+    }
+
+    if (lx->token == TOKEN_IDENT && strcmp(lx->text, "from") == 0)
+    {
+        if ((rv = policy_rules_sources(lx, rule)) != SUCC)
+            return rv;
+    }
+
+    if (lx->token != TOKEN_ARROW)
+    {
+        RULE_ERROR(lx, "expected '->'");
+        return SEC_GATEWAY_INVALID_PARAM;
+    }
+    if (policy_rules_next(lx) != TOKEN_IDENT)
+    {
+        RULE_ERROR(lx, "expected an action after '->'");
+        return SEC_GATEWAY_INVALID_PARAM;
+    }
+    if (strcmp(lx->text, "police") == 0)
+    {
+        if ((rv = policy_rules_police(lx, rule)) != SUCC)
+            return rv;
+    }
+    else
+    {
+        if (strcmp(lx->text, "drop") == 0)
+        {
+            if (info == NULL || rule->count != 0)
+            {
+                RULE_ERROR(lx, "drop takes a message and no fields");
+                return SEC_GATEWAY_INVALID_PARAM;
+            }
+            rule->drop = true;
+        }
+        else if (strcmp(lx->text, "reject") != 0)
+        {
+            RULE_ERROR(lx, "unknown action %s", lx->text);
+            return SEC_GATEWAY_INVALID_PARAM;
+        }
+        policy_rules_next(lx);
+    }
+    if (lx->token != TOKEN_END)
+    {
+        RULE_ERROR(lx, "trailing input after the action");
+        return SEC_GATEWAY_INVALID_PARAM;
+    }
+    return SUCC;
+}
+
+int
+policy_rules_compile(
+    struct pipeline_t* pipeline, const char* name, const char* text)
+{
+    ASSERT(pipeline != NULL && "pipeline is NULL");
+    ASSERT(text != NULL && "rules are NULL");
+
+    static struct policy_rules_lexer_t lx; /* large, and not reentrant */
+    size_t                             count = 0;
+    char                               line[POLICY_RULE_MAX_LINE + 1];
+    int                                rv;
+
+    lx.name = name;
+    lx.line = 0;
+
+    while (*text != '\0')
+    {
+        const char* eol = strchr(text, '\n');
+        size_t      len = eol ? (size_t)(eol - text) : strlen(text);
+        lx.line++;
+        if (len > POLICY_RULE_MAX_LINE)
+        {
+            RULE_ERROR(&lx, "line too long");
+            return SEC_GATEWAY_INVALID_PARAM;
+        }
+        memcpy(line, text, len);
+        line[len] = '\0';
+        text += eol ? len + 1 : len;
+
+        if (count == MAX_POLICIES)
+        {
+            RULE_ERROR(&lx, "more than %d rules", MAX_POLICIES);
+            return SEC_GATEWAY_NO_RESOURCE;
+        }
+        bool blank;
+        lx.p    = line;
+        lx.used = 0;
+        rv      = policy_rules_line(&lx, &policy_rules_staged[count], &blank);
+        if (rv != SUCC)
+        {
+            return rv;
+        }
+        if (!blank)
+        {
+            count++;
+        }
+    }
+
+    /* every rule but a police rule takes a policy */
+    size_t policies = 0;
+    for (size_t r = 0; r < count; r++)
+    {
+        policies += policy_rules_staged[r].rate == 0;
+    }
+    if (policies > POLICY_RULE_MAX_RULES)
+    {
+        WARN("%s: more than %d rules besides police rules\n", name,
+            POLICY_RULE_MAX_RULES);
+        return SEC_GATEWAY_NO_RESOURCE;
+    }
+
+    /* every source of a police rule takes a rate class */
+    size_t classes = 0;
+    for (size_t r = 0; r < count; r++)
+    {
+        for (size_t s = SOURCE_TYPE_VMC;
+             policy_rules_staged[r].rate != 0 && s < MAX_SOURCES; s++)
+        {
+            if (bitmap_test(&policy_rules_staged[r].sources, s))
+            {
+                classes++;
+            }
+        }
+    }
+    if (classes != 0 && pipeline->policer == NULL)
+    {
+        WARN("%s: police rules need a policer\n", name);
+        return SEC_GATEWAY_INVALID_STATE;
+    }
+    if (classes >= POLICER_MAX_CLASSES)
+    {
+        WARN("%s: police rules take more than %d rate classes\n", name,
+            POLICER_MAX_CLASSES - 1);
+        return SEC_GATEWAY_NO_RESOURCE;
+    }
+
+    memcpy(policy_rules, policy_rules_staged, count * sizeof(policy_rules[0]));
+    policy_reset(&pipeline->policies);
+    /* the drop table is derived from the policies as well */
+    memset(&pipeline->drop_table, 0, sizeof(pipeline->drop_table));
+    security_policy_protected_params(pipeline);
+    if (classes != 0)
+    {
+        policer_init(pipeline->policer);
+    }
+
+    for (size_t r = 0; r < count; r++)
+    {
+        struct policy_rule_t* rule = &policy_rules[r];
+        if (rule->rate != 0)
+        {
+            for (size_t s = SOURCE_TYPE_VMC; s < MAX_SOURCES; s++)
+            {
+                if (!bitmap_test(&rule->sources, s))
+                {
+                    continue;
+                }
+                rv = policer_set_rate(pipeline->policer, s,
+                    rule->msgid == POLICY_RULE_ANY_MSGID ? POLICER_ALL_MSGIDS
+                                                         : rule->msgid,
+                    rule->rate, rule->burst,
+                    rule->mark ? POLICER_MARK : POLICER_DROP);
+                ASSERT(rv == SUCC && "police rule was not validated");
+            }
+            continue;
+        }
+
+        rv = policy_register_scoped(&pipeline->policies, rule->line, NULL,
+            policy_rules_check, rule->sources,
+            rule->msgid == POLICY_RULE_ANY_MSGID ? NULL : &rule->msgid, 1);
+        ASSERT(rv == SUCC && "rules were not counted");
+        pipeline->policies.policies[pipeline->policies.count - 1].arg = rule;
+
+        for (size_t s = 0; rule->drop && s < MAX_SOURCES; s++)
+        {
+            if (bitmap_test(&rule->sources, s))
+            {
+                pipeline_drop_msgid(pipeline, s, rule->msgid);
+            }
+        }
+    }
+
+    INFO("%s: %lu rules\n", name, count);
+    return SUCC;
+}
+
+int
+policy_rules_load(struct pipeline_t* pipeline, const char* path)
+{
+    FILE* f = fopen(path, "r");
+    if (f == NULL)
+    {
+        WARN("cannot open %s: %s\n", path, strerror(errno));
+        return SEC_GATEWAY_IO_FAULT;
+    }
+
+    char*  text = NULL;
+    size_t size = 0;
+    size_t len  = 0;
+    size_t n;
+    do
+    {
+        if (len + 1 >= size)
+        {
+            size       = size ? size * 2 : 4096;
+            char* more = realloc(text, size);
+            if (more == NULL)
+            {
+                free(text);
+                fclose(f);
+                return SEC_GATEWAY_NO_MEMORY;
+            }
+            text = more;
+        }
+        n = fread(text + len, 1, size - len - 1, f);
+        len += n;
+    } while (n != 0);
+    text[len] = '\0';
+    fclose(f);
+
+    int rv = policy_rules_compile(pipeline, path, text);
+    free(text);
+    return rv;
+}
@@ -0,0 +1,113 @@
+#ifndef _POLICY_RULES_H_
+#define _POLICY_RULES_H_
+
+#include "secure_gateway.h"
+
+/*
+ * Declarative security policies.
+ *
+ * A rules file replaces the policies of security_policy_init(), so they can
+ * be changed on the vehicle without rebuilding the gateway. The protected
+ * parameters of security_policy_protected_params() stay enforced. One rule
+ * per line, '#' starts a comment:
+ *
+ *     COMMAND_LONG.command == MAV_CMD_DO_FENCE_ENABLE && param1 == 0 -> reject
+ *     MEMINFO from legacy, enclave -> drop
+ *     PARAM_SET from legacy, enclave -> police 50 100
+ *
+ * A rule is a conjunction of terms, followed by the sources it applies to
+ * (all sources if "from" is left out) and its action:
+ *
+ *     rule   := [term {"&&" term}] ["from" source {"," source}] "->" action
+ *     term   := MESSAGE
+ *             | [MESSAGE "."] field op value
+ *     op     := "==" | "!=" | "<" | "<=" | ">" | ">="
+ *     value  := number | ENUM_ENTRY | "string"
+ *     source := "vmc" | "legacy" | "enclave"
+ *     action := "reject" | "drop" | "police" rate [burst] ["mark"]
+ *
+ * All terms of a rule refer to one message; unqualified fields are fields
+ * of the message named before. Strings compare against char[] fields.
+ * "reject" discards the messages the terms hold for; "drop" does the same
+ * before the CRC check (see pipeline_drop_msgid()) and takes a message
+ * without field terms.
+ *
+ * "police" takes no field terms either: it limits the message, or every
+ * message if none is named, to rate per second per sysid of each source, in
+ * bursts of up to burst (rate if left out). Messages above the rate are
+ * dropped, or marked for the egress queues to shed first (see policer.h).
+ * Police rules replace the rates of the pipeline's policer if there are any,
+ * and leave it alone otherwise.
+ *
+ * Rules are compiled when loaded: every rule is registered as a policy
+ * scoped to its sources and message, so pipeline_inspect() only runs the
+ * rules of the message at hand, and its terms are resolved to payload
+ * offsets and types. A rule check reads the fields it compares straight
+ * from the payload, without decoding the message.
+ */
+
+#define POLICY_RULE_MAX_TERMS  8
+#define POLICY_RULE_MAX_STRING 64
+#define POLICY_RULE_MAX_LINE   512
+#define POLICY_RULE_ANY_MSGID  UINT32_MAX /* a rule without a message */
+
+/*
+ * Policies registered besides the rules: security_policy_protected_params(),
+ * security_policy_geofence() and the two of security_policy_mission().
+ */
+#define POLICY_RULE_RESERVED   4
+#define POLICY_RULE_MAX_RULES  (MAX_POLICIES - POLICY_RULE_RESERVED)
+
+enum policy_rule_op_t
+{
+    POLICY_RULE_OP_EQ,
+    POLICY_RULE_OP_NE,
+    POLICY_RULE_OP_LT,
+    POLICY_RULE_OP_LE,
+    POLICY_RULE_OP_GT,
+    POLICY_RULE_OP_GE,
+};
+
+struct policy_rule_term_t
+{
+    uint8_t  type;   /* mavlink_message_type_t of the field */
+    uint8_t  op;     /* enum policy_rule_op_t */
+    uint16_t offset; /* wire offset of the field in the payload */
+    uint16_t len;    /* bytes of a char[] field, 0 otherwise */
+    union
+    {
+        int64_t  i;
+        uint64_t u;
+        double   f;
+        char     s[POLICY_RULE_MAX_STRING];
+    } value;
+};
+
+struct policy_rule_t
+{
+    size_t                    line;
+    uint32_t                  msgid; /* or POLICY_RULE_ANY_MSGID */
+    bool                      drop;
+    uint32_t                  rate; /* of a police rule, 0 otherwise */
+    uint32_t                  burst;
+    bool                      mark;
+    struct bitmap_t           sources;
+    size_t                    count;
+    struct policy_rule_term_t terms[POLICY_RULE_MAX_TERMS];
+};
+
+/*
+ * Compile rules and replace the policies of the pipeline with them, and
+ * with security_policy_protected_params(). Nothing changes if a rule does
+ * not compile, or if there are more than POLICY_RULE_MAX_RULES rules other
+ * than police rules. Call before pipeline_connect().
+ */
+int policy_rules_compile(
+    struct pipeline_t* pipeline, const char* name, const char* text);
+int policy_rules_load(struct pipeline_t* pipeline, const char* path);
+
+/* policy check of a compiled rule, for benchmarks */
+int policy_rules_check(const struct security_policy_t* policy,
+    const struct message_t* msg, size_t* attribute);
+
+#endif /* _POLICY_RULES_H_ */
@@ -123,14 +123,21 @@ ring_buffer_copy_to(struct ring_buffer_t* rb, uint8_t* buffer, size_t size)
     ASSERT(buffer != NULL && "buffer is NULL");
     ASSERT(size > 0 && "size is 0");
 
-    size_t i = 0;
-    while (i < size && !ring_buffer_is_empty(rb))
+    size_t avail = ring_buffer_size(rb);
+    size_t n     = size < avail ? size : avail;
+
+    /* at most two contiguous segments: tail..end, then start..head */
+    size_t first = rb->max - rb->tail;
+    first        = n < first ? n : first;
+    memcpy(buffer, &rb->buffer[rb->tail], first);
+    memcpy(buffer + first, rb->buffer, n - first);
+
+    rb->tail = (rb->tail + n) % rb->max;
+    if (n > 0)
     {
-        buffer[i++] = rb->buffer[rb->tail];
-        rb->tail    = (rb->tail + 1) % rb->max;
-        rb->full    = false;
+        rb->full = false;
     }
-    return i;
+    return n;
 }
 
 static inline void
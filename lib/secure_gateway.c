@@ -1,4 +1,9 @@
 #include "secure_gateway.h"
+#include "crc_x25.h"
+#include "frame_scanner.h"
+#include "policer.h"
+#include "sha256.h"
+#include "signing.h"
 
 struct pipeline_t secure_gateway_pipeline;
 
@@ -12,9 +17,21 @@ source_allocate(struct source_mgmt_t* src_mgmt, size_t source_id)
     ASSERT(source_id < MAX_SOURCES && "not enough slots for sources");
     struct source_t* src = &src_mgmt->sources[source_id];
     src->source_id       = source_id;
+    src->rx_bytes        = 0;
+    src->rx_dropped      = 0;
+    src->rx_filtered     = 0;
+    src->rx_policed      = 0;
+    src->rx_unsigned     = 0;
+    src->rx_rejected     = 0;
+    src->signing         = NULL;
+    src->rx              = NULL;
+    frame_parser_reset(&src->parser);
     src->has_more        = NULL;
     src->read_byte       = NULL;
+    src->read_bytes      = NULL;
+    src->poll_fd         = NULL;
     src->transform       = NULL;
+    src->transform_batch = NULL;
     src->is_connected    = true;
     return src;
 }
@@ -23,9 +40,15 @@ struct sink_t*
 sink_allocate(struct sink_mgmt_t* sink_mgmt, enum sink_type_t type)
 {
     struct sink_t* sink = &sink_mgmt->sinks[type];
-    sink->route         = NULL;
-    sink->transform     = NULL;
-    sink->is_connected  = true;
+    sink->route           = NULL;
+    sink->write_bytes     = NULL;
+    sink->transform       = NULL;
+    sink->transform_batch = NULL;
+    sink->egress          = NULL;
+    sink->signing         = NULL;
+    memset(&sink->status, 0, sizeof(sink->status));
+    sink->egress_depth    = 0;
+    sink->is_connected    = true;
     return sink;
 }
 
@@ -36,6 +59,47 @@ struct source_t *
     return &src_mgmt->sources[source_id];
 }
 
+/**
+ * Enable resynchronization for a source on a noisy link, see struct
+ * frame_parser_t. Call after the source is hooked.
+ */
+int
+source_set_resync(struct pipeline_t* pipeline, size_t source_id, bool enable)
+{
+    ASSERT(pipeline != NULL && "pipeline is NULL");
+    ASSERT(source_id < MAX_SOURCES && "source id is out of range");
+
+    struct source_t* src = &pipeline->sources.sources[source_id];
+    if (!src->is_connected)
+    {
+        return SEC_GATEWAY_INVALID_STATE;
+    }
+
+    src->parser.resync = enable;
+    return SUCC;
+}
+
+/**
+ * Accept only frames signed with a key of signing from a source, see
+ * signing.h. Call after the source is hooked.
+ */
+int
+source_set_signing(struct pipeline_t* pipeline, size_t source_id,
+    struct signing_t* signing)
+{
+    ASSERT(pipeline != NULL && "pipeline is NULL");
+    ASSERT(source_id < MAX_SOURCES && "source id is out of range");
+
+    struct source_t* src = &pipeline->sources.sources[source_id];
+    if (!src->is_connected)
+    {
+        return SEC_GATEWAY_INVALID_STATE;
+    }
+
+    src->signing = signing;
+    return SUCC;
+}
+
 struct sink_t*
 sink_get(struct sink_mgmt_t* sink_mgmt, enum sink_type_t type)
 {
@@ -43,18 +107,110 @@ sink_get(struct sink_mgmt_t* sink_mgmt, enum sink_type_t type)
     return &sink_mgmt->sinks[type];
 }
 
+/**
+ * Sign every MAVLink 2 frame routed to a sink with the key of link_id in
+ * signing, see signing.h. Call after the sink is hooked.
+ */
+int
+sink_set_signing(struct pipeline_t* pipeline, enum sink_type_t type,
+    struct signing_t* signing, uint8_t link_id)
+{
+    ASSERT(pipeline != NULL && "pipeline is NULL");
+    ASSERT(type < MAX_SINKS && "sink id is out of range");
+
+    struct sink_t* sink = pipeline->get_sink(pipeline, type);
+    if (!sink->is_connected)
+    {
+        return SEC_GATEWAY_INVALID_STATE;
+    }
+    if (signing != NULL && !signing->keys[link_id].valid)
+    {
+        return SEC_GATEWAY_INVALID_PARAM;
+    }
+
+    sink->signing         = signing;
+    sink->signing_link_id = link_id;
+    return SUCC;
+}
+
+/**
+ * Unregister all policies.
+ */
+void
+policy_reset(struct security_policy_mgmt_t* policy_mgmt)
+{
+    policy_mgmt->count = 0;
+    memset(policy_mgmt->table, 0, sizeof(policy_mgmt->table));
+}
+
 int
 policy_register(struct security_policy_mgmt_t* policy_mgmt, size_t policy_id,
     match_t match, check_t check)
 {
-    ASSERT(
-        policy_mgmt->count < MAX_POLICIES && "not enough slots for policies");
-    struct security_policy_t* p = &policy_mgmt->policies[policy_mgmt->count];
-    p->policy_id                = policy_id;
-    p->match                    = match;
-    p->check                    = check;
+    struct bitmap_t all;
+    memset(&all, 0xFF, sizeof(all));
+    return policy_register_scoped(
+        policy_mgmt, policy_id, match, check, all, NULL, 0);
+}
+
+/**
+ * Register a policy that applies only to the given sources and, unless
+ * msgids is NULL, the given messages. match() may further narrow it down,
+ * or be NULL. Nothing is registered if all MAX_POLICIES slots are taken.
+ */
+int
+policy_register_scoped(struct security_policy_mgmt_t* policy_mgmt,
+    size_t policy_id, match_t match, check_t check, struct bitmap_t sources,
+    const uint32_t* msgids, size_t msgid_count)
+{
+    if (policy_mgmt->count == MAX_POLICIES)
+    {
+        WARN("policy %lu: more than %d policies\n", policy_id, MAX_POLICIES);
+        return SEC_GATEWAY_NO_RESOURCE;
+    }
+    size_t                    index = policy_mgmt->count;
+    struct security_policy_t* p     = &policy_mgmt->policies[index];
+    p->policy_id                    = policy_id;
+    p->match                        = match;
+    p->check                        = check;
+    p->arg                          = NULL;
     policy_mgmt->count++;
-    return 0;
+
+    /* an accepting check changes nothing, it needs no table entries */
+    if (check == security_policy_check_accept)
+    {
+        return SUCC;
+    }
+
+    for (size_t s = 0; s < MAX_SOURCES; s++)
+    {
+        if (!bitmap_test(&sources, s))
+        {
+            continue;
+        }
+
+        if (msgids == NULL)
+        {
+            for (size_t i = 0; i <= POLICY_TABLE_UNKNOWN; i++)
+            {
+                policy_mgmt->table[s][i] |= 1ULL << index;
+            }
+            continue;
+        }
+
+        for (size_t k = 0; k < msgid_count; k++)
+        {
+            int i = msg_index(msgids[k]);
+            if (i == MSG_INDEX_NONE)
+            {
+                WARN("policy %lu: message %u is not in the dialect\n",
+                    policy_id, msgids[k]);
+                continue;
+            }
+            policy_mgmt->table[s][i] |= 1ULL << index;
+        }
+    }
+    return SUCC;
 }
 
 extern struct route_table_t default_route_table;
@@ -64,13 +220,26 @@ pipeline_init(struct pipeline_t* pipeline)
 {
     memset(&pipeline->sources, 0, sizeof(pipeline->sources));
     memset(&pipeline->sinks, 0, sizeof(pipeline->sinks));
+    message_pool_init();
+    crc_x25_init();
+    sha256_setup();
     pipeline->terminated = false;
     pipeline->policy_enabled = true;
-    pipeline->policies.count = 0;
-    pipeline->push           = pipeline_push;
+    pipeline->mode           = PIPELINE_MODE_POLL;
+    pipeline->epoll_fd       = -1;
+    pipeline->ingest         = NULL;
+    policy_reset(&pipeline->policies);
+    pipeline->policer        = NULL;
+    pipeline->push           = pipeline_push_batch;
     pipeline->get_sink       = pipeline_get_sink;
     memcpy(&pipeline->route_table, &default_route_table,
         sizeof(struct route_table_t));
+    memset(&pipeline->drop_table, 0, sizeof(struct drop_table_t));
+    memset(pipeline->cut_through, 0, sizeof(pipeline->cut_through));
+    for (size_t i = 0; i < MAX_SOURCES; i++)
+    {
+        pipeline->cut_through[i].pipeline = pipeline;
+    }
     security_policy_init(pipeline);
 #ifdef PROFILING
     perf_init(&perf_secure_gateway);
@@ -97,11 +266,48 @@ pipeline_connect(struct pipeline_t* pipeline)
             sink->init(sink);
         }
     }
+
+#ifdef _STD_LIBC_
+    for (size_t i = 0; i < MAX_SINKS; i++)
+    {
+        struct sink_t* sink = &pipeline->sinks.sinks[i];
+        if (sink->is_connected && sink->egress_depth > 0
+            && sink_egress_start(sink) != SUCC)
+        {
+            WARN("sink %zu: egress queue unavailable, routing inline\n", i);
+        }
+    }
+
+    if (pipeline->mode == PIPELINE_MODE_EVENT
+        && pipeline_event_init(pipeline) != SUCC)
+    {
+        WARN("event-driven mode unavailable, falling back to polling\n");
+        pipeline->mode = PIPELINE_MODE_POLL;
+    }
+    if (pipeline->mode == PIPELINE_MODE_THREADED
+        && pipeline_ingest_start(pipeline) != SUCC)
+    {
+        WARN("threaded mode unavailable, falling back to polling\n");
+        pipeline->mode = PIPELINE_MODE_POLL;
+    }
+#endif
 }
 
 void
 pipeline_disconnect(struct pipeline_t* pipeline)
 {
+#ifdef _STD_LIBC_
+    /* ingest threads read from the sources, stop them first */
+    pipeline_ingest_stop(pipeline);
+    pipeline_event_cleanup(pipeline);
+
+    /* flush what is still queued before the sinks go away */
+    for (size_t i = 0; i < MAX_SINKS; i++)
+    {
+        sink_egress_stop(&pipeline->sinks.sinks[i]);
+    }
+#endif
+
     for (size_t i = 0; i < MAX_SOURCES; i++)
     {
         struct source_t* src = &pipeline->sources.sources[i];
@@ -109,6 +315,36 @@ pipeline_disconnect(struct pipeline_t* pipeline)
         {
             src->cleanup(src);
         }
+        message_put(src->rx);
+        src->rx = NULL;
+
+        if (src->rx_filtered > 0)
+        {
+            INFO("MAVLink source %lu: %zu frames dropped at the header\n",
+                src->source_id, src->rx_filtered);
+        }
+        if (src->rx_policed > 0)
+        {
+            INFO("MAVLink source %lu: %zu frames dropped above their rate\n",
+                src->source_id, src->rx_policed);
+        }
+        if (src->rx_unsigned > 0)
+        {
+            INFO("MAVLink source %lu: %zu frames failed signature checks\n",
+                src->source_id, src->rx_unsigned);
+        }
+        if (src->rx_rejected > 0)
+        {
+            INFO("MAVLink source %lu: %zu frames rejected by the transform\n",
+                src->source_id, src->rx_rejected);
+        }
+        if (src->parser.resync_frames > 0)
+        {
+            INFO("MAVLink source %lu: resync recovered %zu frames (%zu "
+                 "bytes)\n",
+                src->source_id, src->parser.resync_frames,
+                src->parser.resync_bytes);
+        }
     }
 
     for (size_t i = 0; i < MAX_SINKS; i++)
@@ -121,12 +357,303 @@ pipeline_disconnect(struct pipeline_t* pipeline)
     }
 }
 
+#define PIPELINE_READ_CHUNK 4096
+
+/*
+ * Run the transform of a port over a batch of its messages. The frames it
+ * finalizes are numbered from the tx sequence of the port, which continues
+ * after the last one.
+ */
+static void
+pipeline_transform(transform_t transform, transform_batch_t transform_batch,
+    mavlink_status_t* status, struct message_t* const* msgs, size_t n,
+    int* rv)
+{
+    if (transform_batch == NULL)
+    {
+        for (size_t k = 0; k < n; k++)
+        {
+            msgs[k]->status.current_tx_seq = status->current_tx_seq;
+            rv[k]                          = transform(msgs[k]);
+            message_view_invalidate(msgs[k]);
+            status->current_tx_seq = msgs[k]->status.current_tx_seq;
+        }
+        return;
+    }
+
+    uint8_t seq = status->current_tx_seq;
+    for (size_t k = 0; k < n; k++)
+    {
+        msgs[k]->status.current_tx_seq = (uint8_t)(seq + k);
+    }
+    transform_batch(msgs, n, rv);
+    for (size_t k = 0; k < n; k++)
+    {
+        message_view_invalidate(msgs[k]);
+        if (msgs[k]->status.current_tx_seq != (uint8_t)(seq + k))
+        {
+            status->current_tx_seq = msgs[k]->status.current_tx_seq;
+        }
+    }
+}
+
+/* a frame is complete, false if it is lost */
+static bool
+pipeline_complete(
+    struct pipeline_t* pipeline, struct source_t* src, struct message_t* msg)
+{
+    if (msg != src->rx)
+    {
+        src->rx_dropped++;
+        WARN("MAVLink source %lu: message pool exhausted, frame dropped\n",
+            src->source_id);
+        return false;
+    }
+    src->rx = NULL;
+
+    memcpy(&msg->status, &src->cur.status, sizeof(msg->status));
+    msg->source = src->source_id;
+#ifdef PROFILING
+    perf_port_unit_update(&perf_secure_gateway, PERF_PORT_UNIT_TYPE_SOURCE,
+        src->source_id, msg);
+    /* the frame has already been streamed to the cut-through sinks */
+    struct bitmap_t* cut = &pipeline->cut_through[src->source_id].sinks;
+    for (size_t i = 0; i < MAX_SINKS; i++)
+    {
+        if (bitmap_test(cut, i))
+        {
+            perf_port_unit_update(
+                &perf_secure_gateway, PERF_PORT_UNIT_TYPE_SINK, i, msg);
+        }
+    }
+#endif
+    return true;
+}
+
+/* transform and push the completed frames of a source, and release them */
+static void
+pipeline_deliver(struct pipeline_t* pipeline, struct source_t* src,
+    struct message_t** msgs, size_t n)
+{
+    if (pipeline->transform_enabled
+        && (src->transform != NULL || src->transform_batch != NULL))
+    {
+        int    rv[PIPELINE_BATCH];
+        size_t kept = 0;
+
+        /* transforms may advance the tx sequence of the source */
+        pipeline_transform(src->transform, src->transform_batch,
+            &src->cur.status, msgs, n, rv);
+        for (size_t k = 0; k < n; k++)
+        {
+            if (rv[k] != SUCC)
+            {
+                src->rx_rejected++;
+                message_put(msgs[k]);
+                continue;
+            }
+            msgs[kept++] = msgs[k];
+        }
+        n = kept;
+    }
+    if (n == 0)
+    {
+        return;
+    }
+    /* push() borrows the messages, stages that keep one take a reference */
+    pipeline->push(pipeline, msgs, n);
+    for (size_t k = 0; k < n; k++)
+    {
+        message_put(msgs[k]);
+    }
+}
+
+/*
+ * A frame skipped by the scanner: account for it the way pipeline_push()
+ * would for a message the policies reject, without routing it.
+ */
+static void
+pipeline_drop(
+    struct pipeline_t* pipeline, struct source_t* src, struct message_t* msg)
+{
+    src->rx_filtered++;
+#ifdef PROFILING
+    perf_port_unit_update(&perf_secure_gateway, PERF_PORT_UNIT_TYPE_SOURCE,
+        src->source_id, msg);
+#endif
+}
+
+/* the message the next frame of a source is completed into */
+static struct message_t*
+pipeline_rx(struct source_t* src)
+{
+    /* frames are completed straight into a pooled message */
+    if (src->rx == NULL)
+    {
+        src->rx = message_alloc();
+    }
+    return src->rx != NULL ? src->rx : &src->cur;
+}
+
+/* the frames of a chunk are transformed and routed in batches */
+static void
+pipeline_collect(struct pipeline_t* pipeline, struct source_t* src,
+    struct message_t* msg, struct message_t** batch, size_t* n)
+{
+    if (!pipeline_complete(pipeline, src, msg))
+    {
+        return;
+    }
+    batch[(*n)++] = msg;
+    if (*n == PIPELINE_BATCH)
+    {
+        pipeline_deliver(pipeline, src, batch, *n);
+        *n = 0;
+    }
+}
+
+static void
+pipeline_scan(struct pipeline_t* pipeline, struct source_t* src,
+    const uint8_t* buf, size_t len)
+{
+    struct frame_scanner_t sc;
+    struct message_t*      msg;
+    struct message_t*      batch[PIPELINE_BATCH];
+    size_t                 n = 0;
+    uint8_t                rv;
+
+    frame_scanner_start(&sc, &src->parser, buf, len, &src->cur.status);
+    if (pipeline->policy_enabled)
+    {
+        frame_scanner_drop(&sc, pipeline->drop_table.table[src->source_id]);
+    }
+    for (;;)
+    {
+        msg = pipeline_rx(src);
+        rv  = frame_scanner_next(&sc, &msg->msg);
+        if (rv == FRAME_SCANNER_DROPPED)
+        {
+            pipeline_drop(pipeline, src, msg);
+            continue;
+        }
+        if (rv != MAVLINK_FRAMING_OK)
+        {
+            break;
+        }
+        pipeline_collect(pipeline, src, msg, batch, &n);
+    }
+    if (n > 0)
+    {
+        pipeline_deliver(pipeline, src, batch, n);
+    }
+
+#ifdef DEBUG
+    struct message_t* cur = &src->cur;
+    if (cur->status.packet_rx_drop_count > 0)
+    {
+        INFO("MAVLink source %d: parser state=%u dropped %i (total=%zu).\n",
+            src->source_id,
+            cur->status.parse_state,
+            cur->status.packet_rx_drop_count,
+            src->rx_bytes);
+    }
+#endif
+}
+
+/*
+ * Sources without read_bytes() hand over a byte at a time. The bytes go to
+ * the byte parser directly, restarting the frame scanner for each of them
+ * would cost more than it saves; the drop table is left to the policies.
+ */
+static bool
+pipeline_parse_bytes(struct pipeline_t* pipeline, struct source_t* src)
+{
+    struct frame_parser_t* parser = &src->parser;
+    struct message_t*      msg;
+    struct message_t*      batch[PIPELINE_BATCH];
+    size_t                 n        = 0;
+    bool                   has_load = false;
+
+    while (src->has_more(src))
+    {
+        uint8_t byte = (uint8_t)src->read_byte(src);
+        has_load     = true;
+        src->rx_bytes++;
+
+        msg = pipeline_rx(src);
+        if (frame_parser_char(parser, byte, &msg->msg, &src->cur.status)
+            == MAVLINK_FRAMING_OK)
+        {
+            pipeline_collect(pipeline, src, msg, batch, &n);
+        }
+        /* frames recovered from the bytes of a rejected one, in resync */
+        for (;;)
+        {
+            msg = pipeline_rx(src);
+            if (frame_parser_replay(parser, &msg->msg, &src->cur.status)
+                != MAVLINK_FRAMING_OK)
+            {
+                break;
+            }
+            pipeline_collect(pipeline, src, msg, batch, &n);
+        }
+    }
+    frame_parser_flush(parser);
+    if (n > 0)
+    {
+        pipeline_deliver(pipeline, src, batch, n);
+    }
+    return has_load;
+}
+
+/**
+ * Drain everything a source has buffered. Sources that implement
+ * read_bytes() hand over whole chunks (one call, and for the threaded
+ * sources one lock, per chunk) that the frame scanner works through in
+ * blocks; has_more()/read_byte() remain as the per-byte fallback.
+ */
+bool
+pipeline_drain_source(struct pipeline_t* pipeline, struct source_t* src)
+{
+    bool has_load = false;
+
+    if (src->read_bytes != NULL)
+    {
+        uint8_t chunk[PIPELINE_READ_CHUNK];
+        size_t  n;
+
+        while ((n = src->read_bytes(src, chunk, sizeof(chunk))) > 0)
+        {
+            has_load = true;
+            src->rx_bytes += n;
+            pipeline_scan(pipeline, src, chunk, n);
+        }
+        return has_load;
+    }
+
+    ASSERT(src->has_more != NULL && "has_more() is not implemented");
+    ASSERT(src->read_byte != NULL && "read_byte() is not implemented");
+
+    return pipeline_parse_bytes(pipeline, src);
+}
+
 int
 pipeline_spin(struct pipeline_t* pipeline)
 {
-    int     rv = 0;
-    size_t  i;
-    uint8_t byte;
+    size_t          i;
+    struct bitmap_t ready;
+
+#ifdef _STD_LIBC_
+    /* blocks until there is work to do (or the timeout expires) */
+    if (pipeline->mode == PIPELINE_MODE_EVENT)
+    {
+        pipeline_event_wait(pipeline, &ready);
+    }
+    else if (pipeline->mode == PIPELINE_MODE_THREADED)
+    {
+        pipeline_ingest_wait(pipeline);
+    }
+#endif
 
 #ifdef PROFILING
     bool    has_load = false;
@@ -134,8 +661,17 @@ pipeline_spin(struct pipeline_t* pipeline)
     tstart = time_us();
 #endif
 
-    static size_t total_bytes = 0;
-
+#ifdef _STD_LIBC_
+    if (pipeline->mode == PIPELINE_MODE_THREADED)
+    {
+#ifdef PROFILING
+        has_load = pipeline_ingest_dispatch(pipeline);
+#else
+        pipeline_ingest_dispatch(pipeline);
+#endif
+    }
+    else
+#endif
     for (i = 0; i < MAX_SOURCES; i++)
     {
         struct source_t* src = &pipeline->sources.sources[i];
@@ -143,55 +679,17 @@ pipeline_spin(struct pipeline_t* pipeline)
         {
             continue;
         }
-        ASSERT(src != NULL && "source is NULL");
-        ASSERT(src->has_more != NULL && "has_more() is not implemented");
-        ASSERT(src->read_byte != NULL && "read_byte() is not implemented");
-
-        struct message_t* msg = &src->cur;
-        while (src->has_more(src))
+        if (pipeline->mode == PIPELINE_MODE_EVENT && !bitmap_test(&ready, i))
         {
-            byte = src->read_byte(src);
-            total_bytes += 1;
-
-#ifdef PROFILING
-            has_load = true;
-#endif
+            continue;
+        }
+        ASSERT(src != NULL && "source is NULL");
 
-            rv = mavlink_parse_char(i, byte, &msg->msg, &msg->status);
-            if (rv == MAVLINK_FRAMING_INCOMPLETE)
-            {
-#ifdef DEBUG
-                if (msg->status.packet_rx_drop_count > 0 || msg->status.parse_error)
-                {
-                    INFO("MAVLink source %d: parser error=%u state=%u dropped %i (total=%zu).\n",
-                        src->source_id,
-                        msg->status.parse_error,
-                        msg->status.parse_state,
-                        msg->status.packet_rx_drop_count,
-                        total_bytes);
-                }
-#endif
-            }
-            else if (rv == MAVLINK_FRAMING_OK)
-            {
-                msg->source = src->source_id;
 #ifdef PROFILING
-                perf_port_unit_update(&perf_secure_gateway, PERF_PORT_UNIT_TYPE_SOURCE,
-                    i, msg);
+        has_load |= pipeline_drain_source(pipeline, src);
+#else
+        pipeline_drain_source(pipeline, src);
 #endif
-                if (pipeline->transform_enabled && src->transform != NULL)
-                {
-                    src->transform(msg);
-                }
-                pipeline->push(pipeline, msg);
-            }
-            else
-            {
-                /* error */
-                WARN("MAVLink source %lu: error parsing msg, error: %d\n",
-                    src->source_id, rv);
-            }
-        }
     }
 
 #ifdef USE_CONSOLE
@@ -220,17 +718,56 @@ route_table_route(struct route_table_t* route_table, struct message_t* msg)
 
 static void pipeline_inspect(struct pipeline_t* pipeline, struct message_t* msg)
 {
-    size_t i;
+    size_t   i;
+    int      index;
+    uint64_t applicable;
 
     if (pipeline->policy_enabled == false)
     {
         return;
     }
 
-    for (i = 0; i < pipeline->policies.count; i++)
+    /*
+     * authenticate first, so that forged frames cannot drain the buckets
+     * of the sysids they spoof
+     */
+    struct source_t* src = &pipeline->sources.sources[msg->source];
+    if (src->signing != NULL)
+    {
+        enum signing_result_t result
+            = signing_verify(src->signing, msg, time_us());
+        if (result != SIGNING_OK)
+        {
+            src->rx_unsigned++;
+            WARN("MAVLink source %lu: %s frame rejected\n", msg->source,
+                signing_result_name(result));
+            bitmap_set(&msg->sinks, SINK_TYPE_DISCARD);
+            return;
+        }
+    }
+
+    /* a flood must not cost the policies, nor the autopilot link */
+    if (pipeline->policer != NULL
+        && !policer_admit(pipeline->policer, msg, time_us()))
+    {
+        src->rx_policed++;
+#ifdef PROFILING
+        perf_port_unit_police(&perf_secure_gateway, msg->source);
+#endif
+        bitmap_set(&msg->sinks, SINK_TYPE_DISCARD);
+        return;
+    }
+
+    index      = msg_index(msg->msg.msgid);
+    applicable = pipeline->policies.table[msg->source]
+        [index == MSG_INDEX_NONE ? POLICY_TABLE_UNKNOWN : (size_t)index];
+    while (applicable != 0)
     {
+        i = __builtin_ctzll(applicable);
+        applicable &= applicable - 1;
+
         struct security_policy_t* policy = &pipeline->policies.policies[i];
-        if (!policy->match(policy, msg))
+        if (policy->match != NULL && !policy->match(policy, msg))
         {
             continue;
         }
@@ -249,58 +786,318 @@ static void pipeline_inspect(struct pipeline_t* pipeline, struct message_t* msg)
     }
 }
 
-int
-pipeline_push(struct pipeline_t* pipeline, struct message_t* msg)
+/* at most PIPELINE_BATCH messages */
+static void
+pipeline_route(
+    struct pipeline_t* pipeline, struct message_t* const* msgs, size_t n)
 {
-    int    rv;
-    size_t i;
-
-    ASSERT(pipeline != NULL && "pipeline is NULL");
-    ASSERT(msg != NULL && "message is NULL");
-
-    rv = route_table_route(&pipeline->route_table, msg);
-
-    //static int msg_index = 0;
-    //printf("msg %d: source %lu, msg id %d, seq %d, sys %d, comp %d, len %d\n",
-    //    msg_index++, msg->source, msg->msg.msgid, msg->msg.seq, msg->msg.sysid,
-    //    msg->msg.compid, msg->msg.len);
+    struct message_t* views[PIPELINE_BATCH];
+    int               rv[PIPELINE_BATCH];
+    size_t            i, k, m;
 
-    pipeline_inspect(pipeline, msg);
-
-    if (bitmap_test(&msg->sinks, SINK_TYPE_DISCARD))
+    for (k = 0; k < n; k++)
     {
+        ASSERT(msgs[k] != NULL && "message is NULL");
+        route_table_route(&pipeline->route_table, msgs[k]);
+        pipeline_inspect(pipeline, msgs[k]);
 #ifdef DEBUG
-        struct sink_t* sink = pipeline->get_sink(pipeline, SINK_TYPE_DISCARD);
-        if (sink != NULL && sink->route != NULL)
+        if (bitmap_test(&msgs[k]->sinks, SINK_TYPE_DISCARD))
         {
-            sink->route(sink, msg);
+            struct sink_t* sink
+                = pipeline->get_sink(pipeline, SINK_TYPE_DISCARD);
+            if (sink != NULL && sink->route != NULL)
+            {
+                sink->route(sink, msgs[k]);
+            }
         }
 #endif
-        return rv;
     }
 
+    /* sink by sink, so a sink transforms all its messages in one go */
     for (i = 0; i < MAX_SINKS; i++)
     {
-        if (bitmap_test(&msg->sinks, i))
+        struct sink_t* sink = pipeline->get_sink(pipeline, i);
+        if (sink->route == NULL)
         {
-            struct sink_t* sink = pipeline->get_sink(pipeline, i);
-            if (sink->route != NULL)
+            continue;
+        }
+
+        /*
+         * sinks without a transform or signing share the original
+         * messages, the others work on private copies so nothing leaks
+         * into the sinks that follow
+         */
+        bool transform = pipeline->transform_enabled
+            && (sink->transform != NULL || sink->transform_batch != NULL);
+        bool copy      = transform || sink->signing != NULL;
+        for (k = 0, m = 0; k < n; k++)
+        {
+            struct message_t* msg = msgs[k];
+            if (!bitmap_test(&msg->sinks, i)
+                || bitmap_test(&msg->sinks, SINK_TYPE_DISCARD))
+            {
+                continue;
+            }
+            if (copy)
             {
-                if (pipeline->transform_enabled && sink->transform != NULL)
+                msg = message_cow(msg);
+                if (msg == NULL)
                 {
-                    sink->transform(msg);
+                    WARN("sink %lu: message pool exhausted, message dropped\n",
+                        i);
+                    continue;
                 }
+                msg->sink = i;
+            }
+            views[m++] = msg;
+        }
+        if (m > 0 && transform)
+        {
+            pipeline_transform(sink->transform, sink->transform_batch,
+                &sink->status, views, m, rv);
+        }
+
+        for (k = 0; k < m; k++)
+        {
+            struct message_t* view      = views[k];
+            int               delivered = SUCC;
+            if (transform && rv[k] != SUCC)
+            {
+                message_put(view);
+                continue;
+            }
+            /* MAVLink 1 frames cannot be signed, and go out as they are */
+            if (sink->signing != NULL)
+            {
+                signing_sign(
+                    sink->signing, view, sink->signing_link_id, time_us());
+            }
 
-                sink->route(sink, msg);
+#ifdef _STD_LIBC_
+            if (sink->egress != NULL)
+            {
+                delivered = sink_egress_enqueue(sink, view);
+            }
+            else
+#endif
+            {
+                sink->route(sink, view);
+            }
 #ifdef PROFILING
-                perf_port_unit_update(&perf_secure_gateway, PERF_PORT_UNIT_TYPE_SINK,
-                    i, msg);
+            if (delivered == SUCC)
+            {
+                perf_port_unit_update(&perf_secure_gateway,
+                    PERF_PORT_UNIT_TYPE_SINK, i, view);
+            }
 #endif
+            if (copy)
+            {
+                message_put(view);
             }
         }
     }
+}
 
-    return rv;
+/**
+ * Route, inspect and deliver messages borrowed from the caller. Every sink
+ * gets its messages in order, and its transform runs over up to
+ * PIPELINE_BATCH of them at a time.
+ */
+int
+pipeline_push_batch(
+    struct pipeline_t* pipeline, struct message_t* const* msgs, size_t n)
+{
+    ASSERT(pipeline != NULL && "pipeline is NULL");
+    ASSERT((msgs != NULL || n == 0) && "messages are NULL");
+
+    while (n > 0)
+    {
+        size_t m = n < PIPELINE_BATCH ? n : PIPELINE_BATCH;
+        pipeline_route(pipeline, msgs, m);
+        msgs += m;
+        n -= m;
+    }
+    return SUCC;
+}
+
+int
+pipeline_push(struct pipeline_t* pipeline, struct message_t* msg)
+{
+    ASSERT(msg != NULL && "message is NULL");
+    return pipeline_push_batch(pipeline, &msg, 1);
+}
+
+/**
+ * Drop a message from a source before it is checksummed, parsed or routed.
+ * Only for messages that the policies would reject anyway: the scanner
+ * trusts the length field of such frames, and skips them unchecked.
+ */
+int
+pipeline_drop_msgid(
+    struct pipeline_t* pipeline, size_t source_id, uint32_t msgid)
+{
+    ASSERT(pipeline != NULL && "pipeline is NULL");
+    ASSERT(source_id < MAX_SOURCES && "source id is out of range");
+
+    int i = msg_index(msgid);
+    if (i == MSG_INDEX_NONE)
+    {
+        return SEC_GATEWAY_INVALID_INDEX;
+    }
+
+    pipeline->drop_table.table[source_id][i / 64] |= 1ULL << (i % 64);
+    return SUCC;
+}
+
+/* keep the rest of a torn frame, with its CRC broken */
+static void
+pipeline_cut_through_owe(struct cut_through_t* ct,
+    struct cut_through_sink_t* cs, const uint8_t* buf, size_t len, size_t at)
+{
+    for (size_t k = 0; k < len && cs->owed_len < sizeof(cs->owed); k++)
+    {
+        uint8_t c                = buf[k];
+        cs->owed[cs->owed_len++] = at + k == ct->crc_at ? (uint8_t)~c : c;
+    }
+}
+
+/*
+ * Write what is owed of a torn frame, so the receiver rejects it and the
+ * next frame starts on a frame boundary. False if some is still owed.
+ */
+static bool
+pipeline_cut_through_repay(struct sink_t* sink, struct cut_through_sink_t* cs)
+{
+    size_t written;
+
+    if (cs->owed_pos == cs->owed_len)
+    {
+        return true;
+    }
+    int rv = sink->write_bytes(sink, &cs->owed[cs->owed_pos],
+        cs->owed_len - cs->owed_pos, &written);
+    cs->owed_pos += (uint16_t)written;
+    if (rv == SEC_GATEWAY_NO_CLIENT)
+    {
+        /* the stream it was owed to is gone */
+        cs->owed_pos = cs->owed_len;
+    }
+    return cs->owed_pos == cs->owed_len;
+}
+
+static void
+pipeline_cut_through_tap(void* arg, const uint8_t* buf, size_t len, size_t at)
+{
+    struct cut_through_t* ct       = arg;
+    struct pipeline_t*    pipeline = ct->pipeline;
+
+    if (at == 0)
+    {
+        /* the first bytes of a frame hold its header */
+        size_t hdr = buf[0] == MAVLINK_STX_MAVLINK1 ? FRAME_V1_HEADER_LEN
+                                                    : FRAME_V2_HEADER_LEN;
+        ct->crc_at = hdr + buf[1] + 1;
+    }
+
+    for (size_t i = 0; i < MAX_SINKS; i++)
+    {
+        if (!bitmap_test(&ct->sinks, i))
+        {
+            continue;
+        }
+        struct sink_t*             sink = pipeline->get_sink(pipeline, i);
+        struct cut_through_sink_t* cs   = &ct->sink[i];
+        size_t                     written;
+
+        if (at == 0)
+        {
+            /* a sink still behind on a torn frame skips the next one */
+            cs->owing = false;
+            cs->skip  = !pipeline_cut_through_repay(sink, cs);
+        }
+        if (cs->skip)
+        {
+            if (cs->owing)
+            {
+                pipeline_cut_through_owe(ct, cs, buf, len, at);
+            }
+            continue;
+        }
+
+        int rv = sink->write_bytes(sink, buf, len, &written);
+        if (rv == SUCC)
+        {
+            continue;
+        }
+        /* never wait for the sink, drop the rest of the frame */
+        cs->skip = true;
+        if (rv != SEC_GATEWAY_NO_CLIENT && at + written > 0)
+        {
+            cs->owing    = true;
+            cs->owed_pos = 0;
+            cs->owed_len = 0;
+            pipeline_cut_through_owe(
+                ct, cs, buf + written, len - written, at + written);
+        }
+    }
+}
+
+/**
+ * Stream the frames of a trusted source to a sink as they arrive, instead
+ * of store-and-forward: the sink gets the bytes of a frame once its header
+ * is in, and the frame is neither inspected by the policies nor
+ * transformed. A frame that fails its CRC is completed with the CRC as
+ * received, so the receiver rejects it.
+ *
+ * The sink has to support write_bytes(), which does not block, have no
+ * transform, egress queue or signing, and the source has to be the only
+ * one routed to it, as partial frames must not interleave. The source
+ * cannot have a transform either, its frames would go out untransformed.
+ * Neither can the source check signatures. Call after the source and sink
+ * are hooked.
+ *
+ * A sink that cannot take a frame right away, or has no client, skips the
+ * frame instead of holding up the source. If part of the frame went out,
+ * the rest follows before the next frame with its CRC broken, so the
+ * receiver drops it and the stream stays on frame boundaries.
+ */
+int
+pipeline_cut_through(
+    struct pipeline_t* pipeline, size_t source_id, enum sink_type_t type)
+{
+    ASSERT(pipeline != NULL && "pipeline is NULL");
+    ASSERT(source_id < MAX_SOURCES && "source id is out of range");
+    ASSERT(type < MAX_SINKS && "sink id is out of range");
+
+    struct source_t* src  = &pipeline->sources.sources[source_id];
+    struct sink_t*   sink = pipeline->get_sink(pipeline, type);
+    if (!src->is_connected || !sink->is_connected || sink->write_bytes == NULL
+        || src->transform != NULL || src->transform_batch != NULL
+        || sink->transform != NULL || sink->transform_batch != NULL
+        || sink->egress_depth > 0
+        || sink->signing != NULL || src->signing != NULL
+        || !bitmap_test(&pipeline->route_table.table[source_id], type))
+    {
+        return SEC_GATEWAY_INVALID_STATE;
+    }
+
+    for (size_t i = 0; i < MAX_SOURCES; i++)
+    {
+        if (i != source_id
+            && bitmap_test(&pipeline->route_table.table[i], type))
+        {
+            WARN("sink %s is shared with source %s, no cut-through\n",
+                sink_name(type), source_name(i));
+            return SEC_GATEWAY_INVALID_STATE;
+        }
+    }
+
+    /* the sink leaves the routed path */
+    bitmap_unset(&pipeline->route_table.table[source_id], type);
+    bitmap_set(&pipeline->cut_through[source_id].sinks, type);
+    src->parser.tap     = pipeline_cut_through_tap;
+    src->parser.tap_arg = &pipeline->cut_through[source_id];
+    return SUCC;
 }
 
 struct sink_t*
@@ -332,50 +1129,95 @@ void add_transformer(struct pipeline_t* pipeline, enum port_type_t type,
     }
 }
 
+/**
+ * Like add_transformer(), for a transform that takes a batch of frames at
+ * a time. It is preferred over the transform_t of the port, if both are
+ * set.
+ */
+void add_batch_transformer(struct pipeline_t* pipeline, enum port_type_t type,
+    size_t id, transform_batch_t transform_batch)
+{
+    if (type == PORT_TYPE_SOURCE)
+    {
+        ASSERT(id < MAX_SOURCES && "source id is out of range");
+        pipeline->sources.sources[id].transform_batch = transform_batch;
+    }
+    else if (type == PORT_TYPE_SINK)
+    {
+        ASSERT(id < MAX_SINKS && "sink id is out of range");
+        sink_get(&pipeline->sinks, id)->transform_batch = transform_batch;
+    }
+}
+
 
 void perf_init(struct perf_t* perf)
 {
     memset(perf, 0, sizeof(struct perf_t));
 }
 
+/*
+ * In threaded mode the ingest threads account for their source (and its
+ * cut-through sinks) while the spin thread routes, polices and queries,
+ * so the counters are only touched atomically. prev_seq belongs to the
+ * thread of its source.
+ */
+static inline void
+perf_count(uint64_t* counter, uint64_t n)
+{
+    __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
 void perf_port_unit_update(struct perf_t * perf, enum perf_port_unit_type_t unit,
     size_t id, struct message_t * msg)
 {
+    struct perf_port_unit_t* port = &perf->port_units[unit][id];
+
     if (unit == PERF_PORT_UNIT_TYPE_SOURCE)
     {
         ASSERT(id <= MAX_SOURCES && "source id is out of range");
         int drop_count = 0;
         if (msg->msg.compid == 1)
         {
-            drop_count = msg->msg.seq - perf->port_units[unit][id].prev_seq - 1;
-            perf->port_units[unit][id].prev_seq = msg->msg.seq;
+            drop_count = msg->msg.seq - port->prev_seq - 1;
+            port->prev_seq = msg->msg.seq;
             drop_count = drop_count < 0 ? 256 + drop_count : drop_count;
         }
 
-        perf->port_units[unit][id].succ_count ++;
-        perf->port_units[unit][id].drop_count += drop_count;
-        perf->port_units[unit][id].succ_bytes += msg->msg.len + MAVLINK_NUM_NON_PAYLOAD_BYTES;
+        perf_count(&port->succ_count, 1);
+        perf_count(&port->drop_count, drop_count);
+        perf_count(&port->succ_bytes, msg->msg.len + MAVLINK_NUM_NON_PAYLOAD_BYTES);
     }
     else if (unit == PERF_PORT_UNIT_TYPE_SINK)
     {
         ASSERT(id <= MAX_SINKS && "sink id is out of range");
-        perf->port_units[unit][id].succ_count ++;
-        perf->port_units[unit][id].succ_bytes += msg->msg.len + MAVLINK_NUM_NON_PAYLOAD_BYTES;
+        perf_count(&port->succ_count, 1);
+        perf_count(&port->succ_bytes, msg->msg.len + MAVLINK_NUM_NON_PAYLOAD_BYTES);
     }
 }
 
+void perf_port_unit_police(struct perf_t* perf, size_t id)
+{
+    ASSERT(id < MAX_PERF_PORT_UNITS && "source id is out of range");
+    perf_count(&perf->port_units[PERF_PORT_UNIT_TYPE_SOURCE][id].policed_count, 1);
+}
+
 void perf_port_unit_query(struct perf_t * perf, enum perf_port_unit_type_t unit,
     size_t id, uint64_t now, struct perf_port_unit_result_t * result)
 {
-    result->duration = now - perf->port_units[unit][id].last_query;
-    result->succ_count = perf->port_units[unit][id].succ_count - perf->port_units[unit][id].last_succ_count;
-    result->drop_count = perf->port_units[unit][id].drop_count - perf->port_units[unit][id].last_drop_count;
-    result->succ_bytes = perf->port_units[unit][id].succ_bytes - perf->port_units[unit][id].last_succ_bytes;
+    struct perf_port_unit_t* port = &perf->port_units[unit][id];
+    uint64_t succ_count = __atomic_load_n(&port->succ_count, __ATOMIC_RELAXED);
+    uint64_t drop_count = __atomic_load_n(&port->drop_count, __ATOMIC_RELAXED);
+    uint64_t succ_bytes = __atomic_load_n(&port->succ_bytes, __ATOMIC_RELAXED);
+
+    result->duration = now - port->last_query;
+    result->succ_count = succ_count - port->last_succ_count;
+    result->drop_count = drop_count - port->last_drop_count;
+    result->succ_bytes = succ_bytes - port->last_succ_bytes;
 
-    perf->port_units[unit][id].last_query = now;
-    perf->port_units[unit][id].last_succ_count = perf->port_units[unit][id].succ_count;
-    perf->port_units[unit][id].last_drop_count = perf->port_units[unit][id].drop_count;
-    perf->port_units[unit][id].last_succ_bytes = perf->port_units[unit][id].succ_bytes;
+    port->last_query = now;
+    port->last_succ_count = succ_count;
+    port->last_drop_count = drop_count;
+    port->last_succ_bytes = succ_bytes;
 }
 
 void perf_exec_unit_update(struct perf_t * perf, uint64_t duration, bool has_load)
@@ -402,6 +1244,7 @@ static struct perf_result_t perf_results = {
     .select = {
         [PERF_PORT_UNIT_TYPE_SOURCE] = {
             [SOURCE_TYPE_VMC] = true,
+            [SOURCE_TYPE_LEGACY] = true,
         },
         [PERF_PORT_UNIT_TYPE_SINK] = {
             [SINK_TYPE_VMC] = true,
@@ -441,12 +1284,13 @@ void perf_show(struct perf_t * perf)
             }
             uint64_t total_count = perf_results.port_units[j][i].succ_count + perf_results.port_units[j][i].drop_count;
             uint64_t duration = perf_results.port_units[j][i].duration;
-            pipeline_log_printf("| %8s %4s total=(pkt:%lu drp:%lu) %lu/s %luB/s (loss %lu.%02lu%%)\n",
+            pipeline_log_printf("| %8s %4s total=(pkt:%lu drp:%lu pol:%lu) %lu/s %luB/s (loss %lu.%02lu%%)\n",
                 j == PERF_PORT_UNIT_TYPE_SOURCE
                     ? source_name(i) : perf_results.select[0][i] ? "" : sink_name(i),
                 j == PERF_PORT_UNIT_TYPE_SOURCE ? "down" : "up",
-                perf[0].port_units[j][i].succ_count,
-                perf[0].port_units[j][i].drop_count,
+                perf[0].port_units[j][i].last_succ_count,
+                perf[0].port_units[j][i].last_drop_count,
+                __atomic_load_n(&perf[0].port_units[j][i].policed_count, __ATOMIC_RELAXED),
                 perf_results.port_units[j][i].succ_count * 1000000 / duration,
                 perf_results.port_units[j][i].succ_bytes * 1000000 / duration,
                 total_count == 0 ? 0 : perf_results.port_units[j][i].drop_count * 100 / total_count,
@@ -4,6 +4,7 @@
 #include "context.h"
 
 #define MAVLINK_USE_MESSAGE_INFO
+#include "msg_index.h"
 #include <mavlink.h>
 
 #define PROFILING
@@ -91,20 +92,213 @@ enum port_type_t
     MAX_PORT_TYPE
 };
 
+/* the v2 header fields of mavlink_message_t are in wire order */
+static_assert(offsetof(mavlink_message_t, payload64)
+            - offsetof(mavlink_message_t, magic)
+        == MAVLINK_CORE_HEADER_LEN + 1,
+    "mavlink_message_t header is not in wire order");
+
+/*
+ * Decoded payloads of the messages the policies look into. A message keeps
+ * the one decoded last, see message_view().
+ */
+union message_view_t
+{
+    mavlink_command_long_t     command_long;
+    mavlink_command_int_t      command_int;
+    mavlink_param_set_t        param_set;
+    mavlink_mission_count_t    mission_count;
+    mavlink_mission_item_t     mission_item;
+    mavlink_mission_item_int_t mission_item_int;
+    mavlink_mission_request_t  mission_request;
+    mavlink_mission_request_int_t mission_request_int;
+    mavlink_mission_ack_t      mission_ack;
+    mavlink_set_position_target_local_ned_t set_position_target_local_ned;
+    mavlink_set_position_target_global_int_t set_position_target_global_int;
+};
+
+#define MESSAGE_VIEW_NONE UINT32_MAX
+
+/* attributes, set by the policies */
+#define MESSAGE_ATTRIBUTE_POLICED (1ul << 0) /* above its rate, see policer.h */
+
 struct message_t
 {
     mavlink_message_t msg;
     mavlink_status_t  status;
     struct bitmap_t   sinks;
     size_t            source;
+    size_t            sink; /* of a private copy, see pipeline_push() */
     size_t            attribute;
+    uint32_t          refs; /* only meaningful for pooled messages */
+    uint32_t          view_msgid; /* msgid decoded in view, or NONE */
+    union message_view_t view;
 };
 
+/*
+ * receives the raw bytes of the frames a parser accepts, see cut-through;
+ * buf is at offset at of its frame
+ */
+typedef void (*frame_tap_t)(
+    void* arg, const uint8_t* buf, size_t len, size_t at);
+
+/*
+ * MAVLink parser state of one byte stream. It replaces the per-channel
+ * globals of mavlink_parse_char(), so every source (or connection) carries
+ * its own parser and may be parsed on its own thread.
+ */
+struct frame_parser_t
+{
+    mavlink_message_t rxmsg;  /* frame being received, kept first: packed */
+    mavlink_status_t  status; /* framing state */
+
+    /*
+     * resync mode: the bytes of a rejected frame are rescanned for a frame
+     * that started inside it, instead of being discarded
+     */
+    bool              resync;
+    size_t            resync_frames; /* frames recovered by rescanning */
+    size_t            resync_bytes;  /* bytes of the recovered frames */
+
+    /*
+     * cut-through: the bytes of a frame are handed to tap() as soon as its
+     * header is in, the rest follows as it arrives; a frame that fails its
+     * CRC is finished with the CRC as received, so the receiver drops it
+     */
+    frame_tap_t       tap;
+    void*             tap_arg;
+    uint16_t          tapped; /* bytes of raw[] already handed to tap() */
+
+    bool              raw_replayed;  /* the frame in raw[] starts in replay[] */
+    uint16_t          raw_len;
+    uint16_t          replay_pos, replay_len;
+    uint8_t           raw[MAVLINK_MAX_PACKET_LEN]; /* bytes of this frame */
+    uint8_t           replay[MAVLINK_MAX_PACKET_LEN]; /* bytes to rescan */
+};
+
+/* message pool */
+#ifndef MESSAGE_POOL_SIZE
+#ifdef _STD_LIBC_
+#define MESSAGE_POOL_SIZE 2048
+#else
+#define MESSAGE_POOL_SIZE 64
+#endif
+#endif
+
+#ifdef MAVLINK_USE_MESSAGE_INFO
+const mavlink_message_info_t* message_info(uint32_t msgid);
+const mavlink_message_info_t* message_info_by_name(const char* name);
+#endif
+
+void              message_pool_init(void);
+struct message_t* message_alloc(void);
+struct message_t* message_copy(const struct message_t* msg);
+struct message_t* message_cow(const struct message_t* msg);
+struct message_t* message_ref(struct message_t* msg);
+void              message_put(struct message_t* msg);
+uint16_t          message_finalize(struct message_t* msg, uint8_t system_id,
+             uint8_t component_id, uint8_t min_length, uint8_t length,
+             uint8_t crc_extra);
+uint16_t          message_crc_delta(const struct message_t* msg, size_t offset,
+             const uint8_t* delta, size_t len);
+bool              message_patch(struct message_t* msg, uint16_t crc_delta);
+size_t            message_pool_available(void);
+size_t            message_pool_exhausted(void);
+
+const void* message_view(const struct message_t* msg, uint32_t msgid);
+
+/* the payload changed (a transform ran), drop the decoded view */
+static inline void
+message_view_invalidate(struct message_t* msg)
+{
+    msg->view_msgid = MESSAGE_VIEW_NONE;
+}
+
+static inline const mavlink_command_long_t*
+message_command_long(const struct message_t* msg)
+{
+    return message_view(msg, MAVLINK_MSG_ID_COMMAND_LONG);
+}
+
+static inline const mavlink_command_int_t*
+message_command_int(const struct message_t* msg)
+{
+    return message_view(msg, MAVLINK_MSG_ID_COMMAND_INT);
+}
+
+static inline const mavlink_param_set_t*
+message_param_set(const struct message_t* msg)
+{
+    return message_view(msg, MAVLINK_MSG_ID_PARAM_SET);
+}
+
+static inline const mavlink_mission_count_t*
+message_mission_count(const struct message_t* msg)
+{
+    return message_view(msg, MAVLINK_MSG_ID_MISSION_COUNT);
+}
+
+static inline const mavlink_mission_item_t*
+message_mission_item(const struct message_t* msg)
+{
+    return message_view(msg, MAVLINK_MSG_ID_MISSION_ITEM);
+}
+
+static inline const mavlink_mission_item_int_t*
+message_mission_item_int(const struct message_t* msg)
+{
+    return message_view(msg, MAVLINK_MSG_ID_MISSION_ITEM_INT);
+}
+
+static inline const mavlink_mission_request_t*
+message_mission_request(const struct message_t* msg)
+{
+    return message_view(msg, MAVLINK_MSG_ID_MISSION_REQUEST);
+}
+
+static inline const mavlink_mission_request_int_t*
+message_mission_request_int(const struct message_t* msg)
+{
+    return message_view(msg, MAVLINK_MSG_ID_MISSION_REQUEST_INT);
+}
+
+static inline const mavlink_mission_ack_t*
+message_mission_ack(const struct message_t* msg)
+{
+    return message_view(msg, MAVLINK_MSG_ID_MISSION_ACK);
+}
+
+static inline const mavlink_set_position_target_local_ned_t*
+message_set_position_target_local_ned(const struct message_t* msg)
+{
+    return message_view(msg, MAVLINK_MSG_ID_SET_POSITION_TARGET_LOCAL_NED);
+}
+
+static inline const mavlink_set_position_target_global_int_t*
+message_set_position_target_global_int(const struct message_t* msg)
+{
+    return message_view(msg, MAVLINK_MSG_ID_SET_POSITION_TARGET_GLOBAL_INT);
+}
+
 struct source_t;
 
 typedef int (*has_more_t)(struct source_t* src);
 typedef int (*read_byte_t)(struct source_t* src);
-typedef void (*transform_t)(struct message_t* msg);
+typedef size_t (*read_bytes_t)(struct source_t* src, uint8_t* buf, size_t max);
+typedef int (*poll_fd_t)(struct source_t* src);
+/* SUCC, or the message is dropped */
+typedef int (*transform_t)(struct message_t* msg);
+
+/* frames a batch transform is handed at most */
+#define PIPELINE_BATCH 16
+
+/*
+ * A transform over independent frames of a port, in order: rv[i] is what
+ * transform_t would return for msgs[i]. Frames it finalizes are numbered
+ * from the tx sequence of the port, the i-th one as if it came i-th.
+ */
+typedef void (*transform_batch_t)(
+    struct message_t* const* msgs, size_t n, int* rv);
 typedef int (*init_t)(void* obj);
 typedef void (*cleanup_t)(void* obj);
 
@@ -130,17 +324,31 @@ source_name(enum source_type_t src)
     }
 }
 
+struct signing_t;
+
 struct source_t
 {
     bool             is_connected;
     size_t           source_id;
-    struct message_t cur;
+    size_t           rx_bytes;
+    size_t           rx_dropped; /* frames lost to an empty message pool */
+    size_t           rx_filtered; /* frames skipped at the header stage */
+    size_t           rx_policed; /* frames dropped above their rate */
+    size_t           rx_unsigned; /* frames failing signature checks */
+    size_t           rx_rejected; /* frames the transform rejected */
+    struct signing_t* signing;   /* optional, see source_set_signing() */
+    struct frame_parser_t parser;
+    struct message_t cur;        /* reported parser status, scratch frame */
+    struct message_t* rx;        /* pooled frame being received */
     void*            opaque;
 
     /* operations */
     has_more_t       has_more;
     read_byte_t      read_byte;
+    read_bytes_t     read_bytes; /* optional, preferred over read_byte() */
+    poll_fd_t        poll_fd;    /* optional, readable when data is buffered */
     transform_t      transform;
+    transform_batch_t transform_batch; /* optional, preferred */
     init_t           init;
     cleanup_t        cleanup;
 };
@@ -153,18 +361,52 @@ struct source_mgmt_t
 struct source_t* source_allocate(
     struct source_mgmt_t* src_mgmt, size_t source_id);
 
+struct pipeline_t;
+int source_set_resync(struct pipeline_t* pipeline, size_t source_id,
+    bool enable);
+int source_set_signing(struct pipeline_t* pipeline, size_t source_id,
+    struct signing_t* signing);
+
 struct sink_t;
 
 typedef int (*route_t)(struct sink_t* sink, struct message_t* msg);
 
+/*
+ * never blocks: writes what the sink takes now, *written bytes, and fails
+ * with SEC_GATEWAY_NO_RESOURCE if that is not all of them
+ */
+typedef int (*write_bytes_t)(
+    struct sink_t* sink, const uint8_t* buf, size_t len, size_t* written);
+
+/* what an egress queue does when its sink cannot keep up */
+enum sink_overflow_t
+{
+    SINK_OVERFLOW_BLOCK = 0, /* wait for the worker, stalls the pipeline */
+    SINK_OVERFLOW_DROP_OLDEST,
+    SINK_OVERFLOW_DROP_NEWEST,
+};
+
 struct sink_t
 {
     bool        is_connected;
     void*       opaque;
+    /* tx sequence state of the transform, it works on private copies */
+    mavlink_status_t status;
+
+    /* optional egress queue, see sink_set_egress() */
+    size_t               egress_depth;
+    enum sink_overflow_t egress_overflow;
+    void*                egress;
+
+    /* optional signing, see sink_set_signing() */
+    struct signing_t* signing;
+    uint8_t           signing_link_id;
 
     /* operations */
     route_t     route;
+    write_bytes_t write_bytes; /* optional, non-blocking, for cut-through */
     transform_t transform;
+    transform_batch_t transform_batch; /* optional, preferred */
     init_t      init;
     cleanup_t   cleanup;
 };
@@ -204,6 +446,8 @@ struct sink_mgmt_t
 
 struct sink_t* sink_allocate(
     struct sink_mgmt_t* sink_mgmt, enum sink_type_t type);
+int sink_set_signing(struct pipeline_t* pipeline, enum sink_type_t type,
+    struct signing_t* signing, uint8_t link_id);
 
 struct security_policy_t;
 
@@ -217,40 +461,104 @@ struct security_policy_t
     size_t  policy_id;
 
     /* operations */
-    match_t match;
+    match_t match; /* optional for scoped policies */
     check_t check;
+
+    const void* arg; /* private to check, e.g. a compiled rule */
 };
 
-#define MAX_POLICIES 16
+#define MAX_POLICIES 64
+static_assert(MAX_POLICIES <= 64, "policy sets are 64-bit masks");
+
+/*
+ * Policies are compiled at registration into a decision table: for every
+ * source and msg_index() (plus one slot for messages outside the dialect),
+ * the set of policies that apply, in registration order. Messages no policy
+ * is scoped to skip inspection altogether.
+ */
+#define POLICY_TABLE_UNKNOWN MAVLINK_MSG_INDEX_COUNT
 struct security_policy_mgmt_t
 {
     struct security_policy_t policies[MAX_POLICIES];
     size_t                   count;
+    uint64_t table[MAX_SOURCES][MAVLINK_MSG_INDEX_COUNT + 1];
 };
 
-int policy_register(struct security_policy_mgmt_t* policy_mgmt,
+void policy_reset(struct security_policy_mgmt_t* policy_mgmt);
+int  policy_register(struct security_policy_mgmt_t* policy_mgmt,
     size_t policy_id, match_t match, check_t check);
+int  policy_register_scoped(struct security_policy_mgmt_t* policy_mgmt,
+    size_t policy_id, match_t match, check_t check, struct bitmap_t sources,
+    const uint32_t* msgids, size_t msgid_count);
 
 struct route_table_t
 {
     struct bitmap_t table[MAX_SOURCES];
 };
 
+/*
+ * Messages that the policies reject unconditionally for a source, one bit
+ * per msg_index(). The frame scanner skips them before the CRC check.
+ */
+#define DROP_TABLE_WORDS (MAVLINK_MSG_INDEX_COUNT / 64 + 1)
+struct drop_table_t
+{
+    uint64_t table[MAX_SOURCES][DROP_TABLE_WORDS];
+};
+
 struct pipeline_t;
 
-typedef int (*push_t)(struct pipeline_t* pipeline, struct message_t* msg);
+/* a cut-through sink's share of the frame in progress */
+struct cut_through_sink_t
+{
+    bool     skip;    /* the rest of the frame does not go out */
+    bool     owing;   /* the frame went out in part, its rest is owed */
+    uint16_t owed_pos, owed_len;
+    uint8_t  owed[MAVLINK_MAX_PACKET_LEN]; /* rest of a torn frame, poisoned */
+};
+
+/*
+ * Sinks that a trusted source feeds byte by byte, bypassing parsing,
+ * policies and transforms, see pipeline_cut_through().
+ */
+struct cut_through_t
+{
+    struct pipeline_t*        pipeline;
+    struct bitmap_t           sinks;
+    size_t                    crc_at; /* last CRC byte of the frame */
+    struct cut_through_sink_t sink[MAX_SINKS];
+};
+
+typedef int (*push_t)(
+    struct pipeline_t* pipeline, struct message_t* const* msgs, size_t n);
 typedef struct sink_t* (*get_sink_t)(
     struct pipeline_t* pipeline, enum sink_type_t type);
 
+struct policer_t;
+
+enum pipeline_mode_t
+{
+    PIPELINE_MODE_POLL = 0, /* busy-poll every source */
+    PIPELINE_MODE_EVENT,    /* block in epoll until a source is ready */
+    PIPELINE_MODE_THREADED, /* parse per source thread, route on spin */
+};
+
 struct pipeline_t
 {
     bool                          terminated;
     bool                          policy_enabled;
     bool                          transform_enabled;
+    enum pipeline_mode_t          mode;
+    int                           epoll_fd;
+    int                           epoll_fds[MAX_SOURCES]; /* -1: polled */
+    void*                         ingest;
     struct source_mgmt_t          sources;
     struct sink_mgmt_t            sinks;
     struct route_table_t          route_table;
+    struct drop_table_t           drop_table;
+    struct cut_through_t          cut_through[MAX_SOURCES];
     struct security_policy_mgmt_t policies;
+    struct policer_t*             policer; /* optional, runs before policies */
 
     /* operations */
     push_t                        push;
@@ -292,6 +600,7 @@ struct perf_port_unit_t
     uint64_t succ_count;
     uint64_t drop_count;
     uint64_t succ_bytes;
+    uint64_t policed_count;
     uint64_t last_succ_count;
     uint64_t last_drop_count;
     uint64_t last_succ_bytes;
@@ -332,6 +641,7 @@ struct perf_t
 void perf_init(struct perf_t* perf);
 void perf_port_unit_update(struct perf_t* perf, enum perf_port_unit_type_t unit,
     size_t id, struct message_t* msg);
+void perf_port_unit_police(struct perf_t* perf, size_t id);
 void perf_port_unit_query(struct perf_t* perf, enum perf_port_unit_type_t unit,
     size_t id, uint64_t now, struct perf_port_unit_result_t* result);
 void perf_exec_unit_update(struct perf_t* perf, uint64_t duration, bool empty);
@@ -340,20 +650,65 @@ void perf_exec_unit_query(
 void perf_show(struct perf_t* perf);
 
 /* secure gateway */
+struct geofence_t;
+struct mission_tracker_t;
 void security_policy_init(struct pipeline_t* pipeline);
+int  security_policy_protected_params(struct pipeline_t* pipeline);
+int  security_policy_geofence(
+     struct pipeline_t* pipeline, const struct geofence_t* fence);
+int  security_policy_mission(
+     struct pipeline_t* pipeline, struct mission_tracker_t* tracker);
+int  security_policy_check_accept(const struct security_policy_t* policy,
+     const struct message_t* msg, size_t* attribute);
 
 void pipeline_init(struct pipeline_t* pipline);
 void pipeline_connect(struct pipeline_t* pipeline);
 int  pipeline_spin(struct pipeline_t* pipeline);
+bool pipeline_drain_source(struct pipeline_t* pipeline, struct source_t* src);
 int  pipeline_push(struct pipeline_t* pipeline, struct message_t* msg);
+int  pipeline_push_batch(
+     struct pipeline_t* pipeline, struct message_t* const* msgs, size_t n);
+int  pipeline_drop_msgid(
+     struct pipeline_t* pipeline, size_t source_id, uint32_t msgid);
+int  pipeline_cut_through(
+     struct pipeline_t* pipeline, size_t source_id, enum sink_type_t type);
 struct sink_t* pipeline_get_sink(
     struct pipeline_t* pipeline, enum sink_type_t type);
 void pipeline_disconnect(struct pipeline_t* pipeline);
 
+#ifdef _STD_LIBC_
+int  pipeline_event_init(struct pipeline_t* pipeline);
+void pipeline_event_wait(struct pipeline_t* pipeline, struct bitmap_t* ready);
+void pipeline_event_cleanup(struct pipeline_t* pipeline);
+
+int  pipeline_ingest_start(struct pipeline_t* pipeline);
+void pipeline_ingest_wait(struct pipeline_t* pipeline);
+bool pipeline_ingest_dispatch(struct pipeline_t* pipeline);
+void pipeline_ingest_stop(struct pipeline_t* pipeline);
+#endif
+
 void add_transformer(struct pipeline_t* pipeline, enum port_type_t type,
     size_t id, transform_t transform);
+void add_batch_transformer(struct pipeline_t* pipeline, enum port_type_t type,
+    size_t id, transform_batch_t transform_batch);
 
 #ifdef _STD_LIBC_
+struct sink_egress_stats_t
+{
+    size_t queued;
+    size_t dropped_oldest;
+    size_t dropped_newest;
+    size_t dropped_policed; /* marked by the policer, shed first */
+    size_t blocked;
+};
+
+int  sink_set_egress(struct pipeline_t* pipeline, enum sink_type_t type,
+     size_t depth, enum sink_overflow_t overflow);
+int  sink_egress_start(struct sink_t* sink);
+int  sink_egress_enqueue(struct sink_t* sink, struct message_t* msg);
+void sink_egress_stats(struct sink_t* sink, struct sink_egress_stats_t* stats);
+void sink_egress_stop(struct sink_t* sink);
+
 int hook_tcp(struct pipeline_t* pipeline, int port, size_t source_id,
     enum sink_type_t sink_type);
 int hook_udp(struct pipeline_t* pipeline, int port, size_t source_id,
@@ -381,10 +736,13 @@ int hook_ringleader_tcp(struct pipeline_t* pipeline, int port,
 #endif
 
 void hook_stdio_sink(struct pipeline_t* pipeline, enum sink_type_t sink_type);
+#ifdef _STD_LIBC_
+int  hook_stdio_source(struct pipeline_t* pipeline, size_t source_id);
+#endif
 
 #ifdef USE_XOR
-void xor_encode(struct message_t* msg);
-void xor_decode(struct message_t* msg);
+int xor_encode(struct message_t* msg);
+int xor_decode(struct message_t* msg);
 #endif
 
 #ifdef USE_CONSOLE
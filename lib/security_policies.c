@@ -1,4 +1,7 @@
 #include "secure_gateway.h"
+#include "geofence.h"
+#include "mission_tracker.h"
+#include "param_index.h"
 #include <ardupilotmega/ardupilotmega.h>
 
 int
@@ -52,13 +55,11 @@ security_policy_reject_mavlink_cmd_waypoint(
     const struct security_policy_t* policy, const struct message_t* msg,
     size_t* attribute)
 {
-    if (msg->msg.msgid != MAVLINK_MSG_ID_COMMAND_LONG)
+    const mavlink_command_long_t* cmd = message_command_long(msg);
+    if (cmd == NULL)
         return true;
 
-    mavlink_command_long_t cmd;
-    mavlink_msg_command_long_decode(&msg->msg, &cmd);
-
-    if (cmd.command != MAV_CMD_NAV_WAYPOINT)
+    if (cmd->command != MAV_CMD_NAV_WAYPOINT)
         return true;
 
     return false;
@@ -69,23 +70,195 @@ security_policy_reject_mavlink_cmd_disable_geofence(
     const struct security_policy_t* policy, const struct message_t* msg,
     size_t* attribute)
 {
-    if (msg->msg.msgid == MAVLINK_MSG_ID_COMMAND_LONG)
+    const mavlink_command_long_t* cmd = message_command_long(msg);
+    if (cmd == NULL)
+        return true;
+
+    if (cmd->command == MAV_CMD_DO_FENCE_ENABLE && cmd->param1 == 0)
+        return false;
+
+    return true;
+}
+
+/* FENCE_ENABLE and the like, see protected_params.txt */
+int
+security_policy_reject_protected_param(
+    const struct security_policy_t* policy, const struct message_t* msg,
+    size_t* attribute)
+{
+    const mavlink_param_set_t* param = message_param_set(msg);
+    if (param == NULL)
+        return true;
+
+    const struct protected_param_t* rule = protected_param(param->param_id);
+    if (rule == NULL)
+        return true;
+
+    return protected_param_allows(rule, param->param_value);
+}
+
+static bool
+security_policy_frame_global(uint8_t frame)
+{
+    switch (frame)
     {
-        mavlink_command_long_t cmd;
-        mavlink_msg_command_long_decode(&msg->msg, &cmd);
+    case MAV_FRAME_GLOBAL:
+    case MAV_FRAME_GLOBAL_RELATIVE_ALT:
+    case MAV_FRAME_GLOBAL_INT:
+    case MAV_FRAME_GLOBAL_RELATIVE_ALT_INT:
+    case MAV_FRAME_GLOBAL_TERRAIN_ALT:
+    case MAV_FRAME_GLOBAL_TERRAIN_ALT_INT:
+        return true;
+    default:
+        return false;
+    }
+}
 
-        if (cmd.command == MAV_CMD_DO_FENCE_ENABLE && cmd.param1 == 0)
-            return false;
+/* degrees to degE7, out of range saturates (and is outside any fence) */
+static int32_t
+security_policy_deg_e7(float deg, float limit)
+{
+    deg = deg < -limit ? -limit : deg > limit ? limit : deg;
+    return (int32_t)(deg * 1e7);
+}
+
+/* where a message sends the vehicle, see security_policy_target() */
+enum security_policy_target_t
+{
+    SECURITY_POLICY_TARGET_NONE,   /* nowhere, or where it is */
+    SECURITY_POLICY_TARGET_GLOBAL, /* lat, lon */
+    SECURITY_POLICY_TARGET_LOCAL,  /* a position the fence cannot place */
+};
+
+/* x, y in frame: 0, 0 is the current position (or none) */
+static enum security_policy_target_t
+security_policy_position(
+    uint8_t frame, int32_t x, int32_t y, int32_t* lat, int32_t* lon)
+{
+    if (x == 0 && y == 0)
+        return SECURITY_POLICY_TARGET_NONE;
+    if (!security_policy_frame_global(frame))
+        return SECURITY_POLICY_TARGET_LOCAL;
+    *lat = x;
+    *lon = y;
+    return SECURITY_POLICY_TARGET_GLOBAL;
+}
+
+/*
+ * The position (degE7) a message sends the vehicle to. Other commands,
+ * ignored coordinates and 0, 0 name none. Positions in local or body
+ * frames are relative to an origin the gateway does not know, so they
+ * cannot be placed on the fence.
+ */
+static enum security_policy_target_t
+security_policy_target(const struct message_t* msg, int32_t* lat, int32_t* lon)
+{
+    switch (msg->msg.msgid)
+    {
+    case MAVLINK_MSG_ID_MISSION_ITEM_INT:
+    {
+        const mavlink_mission_item_int_t* m = message_mission_item_int(msg);
+        if (m->mission_type != MAV_MISSION_TYPE_MISSION
+            || m->command >= MAV_CMD_NAV_LAST)
+            return SECURITY_POLICY_TARGET_NONE;
+        return security_policy_position(m->frame, m->x, m->y, lat, lon);
     }
-    else if (msg->msg.msgid == MAVLINK_MSG_ID_PARAM_SET)
+    case MAVLINK_MSG_ID_MISSION_ITEM:
     {
-        mavlink_param_set_t param;
-        mavlink_msg_param_set_decode(&msg->msg, &param);
+        /* degrees in global frames, meters in the others */
+        const mavlink_mission_item_t* m = message_mission_item(msg);
+        if (m->mission_type != MAV_MISSION_TYPE_MISSION
+            || m->command >= MAV_CMD_NAV_LAST)
+            return SECURITY_POLICY_TARGET_NONE;
+        if (m->x != m->x || m->y != m->y)
+            return SECURITY_POLICY_TARGET_LOCAL;
+        return security_policy_position(m->frame,
+            security_policy_deg_e7(m->x, 90),
+            security_policy_deg_e7(m->y, 180), lat, lon);
+    }
+    case MAVLINK_MSG_ID_SET_POSITION_TARGET_GLOBAL_INT:
+    {
+        const mavlink_set_position_target_global_int_t* m
+            = message_set_position_target_global_int(msg);
+        if (m->type_mask
+            & (POSITION_TARGET_TYPEMASK_X_IGNORE
+                | POSITION_TARGET_TYPEMASK_Y_IGNORE))
+            return SECURITY_POLICY_TARGET_NONE;
+        return security_policy_position(
+            m->coordinate_frame, m->lat_int, m->lon_int, lat, lon);
+    }
+    case MAVLINK_MSG_ID_SET_POSITION_TARGET_LOCAL_NED:
+    {
+        /* velocity and acceleration setpoints are not checked */
+        const mavlink_set_position_target_local_ned_t* m
+            = message_set_position_target_local_ned(msg);
+        if (m->type_mask
+            & (POSITION_TARGET_TYPEMASK_X_IGNORE
+                | POSITION_TARGET_TYPEMASK_Y_IGNORE))
+            return SECURITY_POLICY_TARGET_NONE;
+        return SECURITY_POLICY_TARGET_LOCAL;
+    }
+    case MAVLINK_MSG_ID_COMMAND_INT:
+    {
+        const mavlink_command_int_t* m = message_command_int(msg);
+        if (m->command >= MAV_CMD_NAV_LAST
+            && m->command != MAV_CMD_DO_REPOSITION)
+            return SECURITY_POLICY_TARGET_NONE;
+        return security_policy_position(m->frame, m->x, m->y, lat, lon);
+    }
+    case MAVLINK_MSG_ID_COMMAND_LONG:
+    {
+        /* always global */
+        const mavlink_command_long_t* m = message_command_long(msg);
+        if (m->command >= MAV_CMD_NAV_LAST
+            && m->command != MAV_CMD_DO_REPOSITION)
+            return SECURITY_POLICY_TARGET_NONE;
+        /* NaN leaves the position as it is */
+        if (m->param5 != m->param5 || m->param6 != m->param6)
+            return SECURITY_POLICY_TARGET_NONE;
+        return security_policy_position(MAV_FRAME_GLOBAL,
+            security_policy_deg_e7(m->param5, 90),
+            security_policy_deg_e7(m->param6, 180), lat, lon);
+    }
+    default:
+        return SECURITY_POLICY_TARGET_NONE;
+    }
+}
 
-        if (strncmp(param.param_id, "FENCE_ENABLE", 12u) == 0 && param.param_value == 0)
-            return false;
+int
+security_policy_reject_outside_geofence(
+    const struct security_policy_t* policy, const struct message_t* msg,
+    size_t* attribute)
+{
+    int32_t lat, lon;
+    switch (security_policy_target(msg, &lat, &lon))
+    {
+    case SECURITY_POLICY_TARGET_GLOBAL:
+        return geofence_allows(policy->arg, lat, lon);
+    case SECURITY_POLICY_TARGET_LOCAL:
+        return false;
+    default:
+        return true;
     }
+}
 
+int
+security_policy_track_mission_upload(
+    const struct security_policy_t* policy, const struct message_t* msg,
+    size_t* attribute)
+{
+    /* the tracker is state, the arg of a policy is const to the others */
+    return mission_tracker_gcs(
+        (struct mission_tracker_t*)policy->arg, msg, time_us());
+}
+
+int
+security_policy_track_mission_vehicle(
+    const struct security_policy_t* policy, const struct message_t* msg,
+    size_t* attribute)
+{
+    mission_tracker_vehicle(
+        (struct mission_tracker_t*)policy->arg, msg, time_us());
     return true;
 }
 
@@ -95,19 +268,133 @@ enum policy_id_t
     POLICY_ID_REJECT_NAV_WAYPOINT,
     POLICY_ID_REJECT_DISABLE_GEOFENCE,
     POLICY_ID_REJECT_MEMINFO,
+    POLICY_ID_REJECT_OUTSIDE_GEOFENCE,
+    POLICY_ID_TRACK_MISSION_UPLOAD,
+    POLICY_ID_TRACK_MISSION_VEHICLE,
+    POLICY_ID_REJECT_PROTECTED_PARAM,
 };
 
+static const struct bitmap_t security_policy_vmc
+    = BITMAP_CONST(BIT_OF(SOURCE_TYPE_VMC));
+static const struct bitmap_t security_policy_mmc = BITMAP_CONST(
+    BIT_OF(SOURCE_TYPE_LEGACY) | BIT_OF(SOURCE_TYPE_ENCLAVE));
+
+static const uint32_t security_policy_msgids_geofence[]
+    = { MAVLINK_MSG_ID_COMMAND_LONG };
+static const uint32_t security_policy_msgids_param[]
+    = { MAVLINK_MSG_ID_PARAM_SET };
+static const uint32_t security_policy_msgids_meminfo[]
+    = { MAVLINK_MSG_ID_MEMINFO };
+static const uint32_t security_policy_msgids_target[]
+    = { MAVLINK_MSG_ID_MISSION_ITEM_INT, MAVLINK_MSG_ID_MISSION_ITEM,
+          MAVLINK_MSG_ID_SET_POSITION_TARGET_GLOBAL_INT,
+          MAVLINK_MSG_ID_SET_POSITION_TARGET_LOCAL_NED,
+          MAVLINK_MSG_ID_COMMAND_INT, MAVLINK_MSG_ID_COMMAND_LONG };
+static const uint32_t security_policy_msgids_mission_upload[]
+    = { MAVLINK_MSG_ID_MISSION_COUNT, MAVLINK_MSG_ID_MISSION_ITEM_INT,
+          MAVLINK_MSG_ID_MISSION_ITEM };
+static const uint32_t security_policy_msgids_mission_vehicle[]
+    = { MAVLINK_MSG_ID_MISSION_REQUEST_INT, MAVLINK_MSG_ID_MISSION_REQUEST,
+          MAVLINK_MSG_ID_MISSION_ACK };
+
+#define MSGIDS(a) (a), (sizeof(a) / sizeof((a)[0]))
+
+/**
+ * Keep the mission computers from writing the parameters of
+ * protected_params.txt. Policy rules cannot name the list, so they keep
+ * this policy when they replace the others.
+ */
+int
+security_policy_protected_params(struct pipeline_t* pipeline)
+{
+    return policy_register_scoped(&pipeline->policies,
+        POLICY_ID_REJECT_PROTECTED_PARAM, NULL,
+        security_policy_reject_protected_param, security_policy_mmc,
+        MSGIDS(security_policy_msgids_param));
+}
+
 void
 security_policy_init(struct pipeline_t* pipeline)
 {
-    policy_register(&pipeline->policies, POLICY_ID_ACCEPT_VMC,
-        security_policy_match_vmc, security_policy_check_accept);
-    //policy_register(&pipeline->policies, POLICY_ID_REJECT_NAV_WAYPOINT,
-    //    security_policy_match_mmc, security_policy_reject_mavlink_cmd_waypoint);
-    policy_register(&pipeline->policies, POLICY_ID_REJECT_DISABLE_GEOFENCE,
-        security_policy_match_mmc,
-        security_policy_reject_mavlink_cmd_disable_geofence);
-    policy_register(&pipeline->policies, POLICY_ID_REJECT_MEMINFO,
-        security_policy_match_mmc, security_policy_reject_mavlink_cmd_meminfo);
+    /* enclave sources are numbered from SOURCE_TYPE_ENCLAVE up */
+    static_assert(SOURCE_TYPE_ENCLAVE + 1 == MAX_SOURCES,
+        "security_policy_mmc misses enclave sources");
+
+    policy_register_scoped(&pipeline->policies, POLICY_ID_ACCEPT_VMC, NULL,
+        security_policy_check_accept, security_policy_vmc, NULL, 0);
+    //policy_register_scoped(&pipeline->policies, POLICY_ID_REJECT_NAV_WAYPOINT,
+    //    NULL, security_policy_reject_mavlink_cmd_waypoint, security_policy_mmc,
+    //    (const uint32_t[]) { MAVLINK_MSG_ID_COMMAND_LONG }, 1);
+    policy_register_scoped(&pipeline->policies,
+        POLICY_ID_REJECT_DISABLE_GEOFENCE, NULL,
+        security_policy_reject_mavlink_cmd_disable_geofence,
+        security_policy_mmc, MSGIDS(security_policy_msgids_geofence));
+    security_policy_protected_params(pipeline);
+    policy_register_scoped(&pipeline->policies, POLICY_ID_REJECT_MEMINFO, NULL,
+        security_policy_reject_mavlink_cmd_meminfo, security_policy_mmc,
+        MSGIDS(security_policy_msgids_meminfo));
+    /* no other policy accepts MEMINFO first, skip it before the CRC */
+    pipeline_drop_msgid(pipeline, SOURCE_TYPE_LEGACY, MAVLINK_MSG_ID_MEMINFO);
+    for (size_t s = SOURCE_TYPE_ENCLAVE; s < MAX_SOURCES; s++)
+    {
+        pipeline_drop_msgid(pipeline, s, MAVLINK_MSG_ID_MEMINFO);
+    }
     /* ... */
 }
+
+/**
+ * Reject positions outside the fence that the mission computers command,
+ * and positions in local frames, which the fence cannot place. The fence
+ * must be built, and outlive the pipeline. Policy rules replace the other
+ * policies, load them first.
+ */
+int
+security_policy_geofence(
+    struct pipeline_t* pipeline, const struct geofence_t* fence)
+{
+    ASSERT(fence != NULL && fence->built && "geofence is not built");
+
+    int rv = policy_register_scoped(&pipeline->policies,
+        POLICY_ID_REJECT_OUTSIDE_GEOFENCE, NULL,
+        security_policy_reject_outside_geofence, security_policy_mmc,
+        MSGIDS(security_policy_msgids_target));
+    if (rv != SUCC)
+    {
+        return rv;
+    }
+    pipeline->policies.policies[pipeline->policies.count - 1].arg = fence;
+    return SUCC;
+}
+
+/**
+ * Only let mission items through that the vehicle asked for in an upload,
+ * see mission_tracker.h. The tracker must outlive the pipeline. Register it
+ * last: policies run in order, so it only tracks messages the others accept.
+ */
+int
+security_policy_mission(
+    struct pipeline_t* pipeline, struct mission_tracker_t* tracker)
+{
+    ASSERT(tracker != NULL && "mission tracker is NULL");
+
+    int rv = policy_register_scoped(&pipeline->policies,
+        POLICY_ID_TRACK_MISSION_UPLOAD, NULL,
+        security_policy_track_mission_upload, security_policy_mmc,
+        MSGIDS(security_policy_msgids_mission_upload));
+    if (rv != SUCC)
+    {
+        return rv;
+    }
+    pipeline->policies.policies[pipeline->policies.count - 1].arg = tracker;
+
+    rv = policy_register_scoped(&pipeline->policies,
+        POLICY_ID_TRACK_MISSION_VEHICLE, NULL,
+        security_policy_track_mission_vehicle, security_policy_vmc,
+        MSGIDS(security_policy_msgids_mission_vehicle));
+    if (rv != SUCC)
+    {
+        return rv;
+    }
+    pipeline->policies.policies[pipeline->policies.count - 1].arg = tracker;
+    return SUCC;
+}
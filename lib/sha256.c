@@ -0,0 +1,349 @@
+#include "sha256.h"
+#include "secure_gateway.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SHA256_HAS_SHANI
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__GNUC__) && defined(_STD_LIBC_)
+#define SHA256_HAS_ARMV8
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#ifndef HWCAP_SHA2
+#define HWCAP_SHA2 (1 << 6)
+#endif
+#endif
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static void sha256_portable(
+    uint32_t state[8], const uint8_t* blocks, size_t count);
+static sha256_blocks_fn_t sha256_impl    = sha256_portable;
+static enum sha256_impl_t sha256_impl_id = SHA256_IMPL_PORTABLE;
+
+static inline uint32_t
+sha256_ror(uint32_t x, unsigned n)
+{
+    return (x >> n) | (x << (32 - n));
+}
+
+static inline uint32_t
+sha256_be32(const uint8_t* p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8
+        | p[3];
+}
+
+static void
+sha256_portable(uint32_t state[8], const uint8_t* blocks, size_t count)
+{
+    uint32_t w[64];
+
+    while (count--)
+    {
+        for (unsigned t = 0; t < 16; t++)
+        {
+            w[t] = sha256_be32(&blocks[t * 4]);
+        }
+        for (unsigned t = 16; t < 64; t++)
+        {
+            uint32_t s0 = sha256_ror(w[t - 15], 7) ^ sha256_ror(w[t - 15], 18)
+                ^ (w[t - 15] >> 3);
+            uint32_t s1 = sha256_ror(w[t - 2], 17) ^ sha256_ror(w[t - 2], 19)
+                ^ (w[t - 2] >> 10);
+            w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (unsigned t = 0; t < 64; t++)
+        {
+            uint32_t s1 = sha256_ror(e, 6) ^ sha256_ror(e, 11)
+                ^ sha256_ror(e, 25);
+            uint32_t ch = (e & f) ^ (~e & g);
+            uint32_t t1 = h + s1 + ch + sha256_k[t] + w[t];
+            uint32_t s0 = sha256_ror(a, 2) ^ sha256_ror(a, 13)
+                ^ sha256_ror(a, 22);
+            uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+            h            = g;
+            g            = f;
+            f            = e;
+            e            = d + t1;
+            d            = c;
+            c            = b;
+            b            = a;
+            a            = t1 + s0 + maj;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+        blocks += SHA256_BLOCK_LEN;
+    }
+}
+
+#ifdef SHA256_HAS_SHANI
+/*
+ * SHA extensions. The state is kept as ABEF and CDGH, the order
+ * SHA256RNDS2 wants it in; every step does four rounds, and the message
+ * schedule of the next four words is computed twelve rounds ahead.
+ */
+__attribute__((target("sha,sse4.1"))) static void
+sha256_shani(uint32_t state[8], const uint8_t* blocks, size_t count)
+{
+    const __m128i bswap
+        = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    __m128i tmp    = _mm_loadu_si128((const __m128i*)&state[0]);
+    __m128i state1 = _mm_loadu_si128((const __m128i*)&state[4]);
+    tmp            = _mm_shuffle_epi32(tmp, 0xB1);       /* CDAB */
+    state1         = _mm_shuffle_epi32(state1, 0x1B);    /* EFGH */
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);    /* ABEF */
+    state1         = _mm_blend_epi16(state1, tmp, 0xF0); /* CDGH */
+
+    while (count--)
+    {
+        __m128i abef = state0;
+        __m128i cdgh = state1;
+        __m128i w[4];
+
+        for (unsigned i = 0; i < 4; i++)
+        {
+            w[i] = _mm_shuffle_epi8(
+                _mm_loadu_si128((const __m128i*)&blocks[i * 16]), bswap);
+        }
+        for (unsigned i = 0; i < 16; i++)
+        {
+            __m128i wk = _mm_add_epi32(
+                w[i & 3], _mm_loadu_si128((const __m128i*)&sha256_k[i * 4]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+            state0 = _mm_sha256rnds2_epu32(
+                state0, state1, _mm_shuffle_epi32(wk, 0x0E));
+            if (i < 12)
+            {
+                __m128i next = _mm_sha256msg1_epu32(w[i & 3], w[(i + 1) & 3]);
+                next         = _mm_add_epi32(next,
+                            _mm_alignr_epi8(w[(i + 3) & 3], w[(i + 2) & 3], 4));
+                w[i & 3] = _mm_sha256msg2_epu32(next, w[(i + 3) & 3]);
+            }
+        }
+
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+        blocks += SHA256_BLOCK_LEN;
+    }
+
+    tmp    = _mm_shuffle_epi32(state0, 0x1B);       /* FEBA */
+    state1 = _mm_shuffle_epi32(state1, 0xB1);       /* DCHG */
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);    /* DCBA */
+    state1 = _mm_alignr_epi8(state1, tmp, 8);       /* HGFE */
+    _mm_storeu_si128((__m128i*)&state[0], state0);
+    _mm_storeu_si128((__m128i*)&state[4], state1);
+}
+
+static bool
+sha256_accel_supported(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1");
+}
+#endif /* SHA256_HAS_SHANI */
+
+#ifdef SHA256_HAS_ARMV8
+/* ARMv8 cryptography extension, four rounds per step as above */
+__attribute__((target("+crypto"))) static void
+sha256_armv8(uint32_t state[8], const uint8_t* blocks, size_t count)
+{
+    uint32x4_t state0 = vld1q_u32(&state[0]);
+    uint32x4_t state1 = vld1q_u32(&state[4]);
+
+    while (count--)
+    {
+        uint32x4_t abcd = state0;
+        uint32x4_t efgh = state1;
+        uint32x4_t w[4];
+
+        for (unsigned i = 0; i < 4; i++)
+        {
+            w[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(&blocks[i * 16])));
+        }
+        for (unsigned i = 0; i < 16; i++)
+        {
+            uint32x4_t wk = vaddq_u32(w[i & 3], vld1q_u32(&sha256_k[i * 4]));
+            if (i < 12)
+            {
+                w[i & 3] = vsha256su1q_u32(
+                    vsha256su0q_u32(w[i & 3], w[(i + 1) & 3]), w[(i + 2) & 3],
+                    w[(i + 3) & 3]);
+            }
+            uint32x4_t prev = state0;
+            state0          = vsha256hq_u32(state0, state1, wk);
+            state1          = vsha256h2q_u32(state1, prev, wk);
+        }
+
+        state0 = vaddq_u32(state0, abcd);
+        state1 = vaddq_u32(state1, efgh);
+        blocks += SHA256_BLOCK_LEN;
+    }
+
+    vst1q_u32(&state[0], state0);
+    vst1q_u32(&state[4], state1);
+}
+
+static bool
+sha256_accel_supported(void)
+{
+    return (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+}
+#endif /* SHA256_HAS_ARMV8 */
+
+void
+sha256_setup(void)
+{
+#if defined(SHA256_HAS_SHANI)
+    if (sha256_accel_supported())
+    {
+        sha256_impl    = sha256_shani;
+        sha256_impl_id = SHA256_IMPL_SHANI;
+    }
+#elif defined(SHA256_HAS_ARMV8)
+    if (sha256_accel_supported())
+    {
+        sha256_impl    = sha256_armv8;
+        sha256_impl_id = SHA256_IMPL_ARMV8;
+    }
+#endif
+}
+
+void
+sha256_init(struct sha256_t* ctx)
+{
+    static const uint32_t iv[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    memcpy(ctx->state, iv, sizeof(iv));
+    ctx->count = 0;
+}
+
+void
+sha256_update(struct sha256_t* ctx, const void* data, size_t len)
+{
+    const uint8_t* p    = data;
+    size_t         used = ctx->count % SHA256_BLOCK_LEN;
+
+    ctx->count += len;
+    if (used > 0)
+    {
+        size_t n = SHA256_BLOCK_LEN - used;
+        if (len < n)
+        {
+            memcpy(&ctx->buf[used], p, len);
+            return;
+        }
+        memcpy(&ctx->buf[used], p, n);
+        sha256_impl(ctx->state, ctx->buf, 1);
+        p += n;
+        len -= n;
+    }
+    if (len >= SHA256_BLOCK_LEN)
+    {
+        sha256_impl(ctx->state, p, len / SHA256_BLOCK_LEN);
+        p += len & ~(size_t)(SHA256_BLOCK_LEN - 1);
+        len %= SHA256_BLOCK_LEN;
+    }
+    memcpy(ctx->buf, p, len);
+}
+
+void
+sha256_final(struct sha256_t* ctx, uint8_t digest[SHA256_DIGEST_LEN])
+{
+    size_t   used = ctx->count % SHA256_BLOCK_LEN;
+    uint64_t bits = ctx->count * 8;
+
+    ctx->buf[used++] = 0x80;
+    if (used > SHA256_BLOCK_LEN - 8)
+    {
+        memset(&ctx->buf[used], 0, SHA256_BLOCK_LEN - used);
+        sha256_impl(ctx->state, ctx->buf, 1);
+        used = 0;
+    }
+    memset(&ctx->buf[used], 0, SHA256_BLOCK_LEN - 8 - used);
+    for (unsigned i = 0; i < 8; i++)
+    {
+        ctx->buf[SHA256_BLOCK_LEN - 1 - i] = (uint8_t)(bits >> (i * 8));
+    }
+    sha256_impl(ctx->state, ctx->buf, 1);
+
+    for (unsigned i = 0; i < 8; i++)
+    {
+        digest[i * 4]     = (uint8_t)(ctx->state[i] >> 24);
+        digest[i * 4 + 1] = (uint8_t)(ctx->state[i] >> 16);
+        digest[i * 4 + 2] = (uint8_t)(ctx->state[i] >> 8);
+        digest[i * 4 + 3] = (uint8_t)ctx->state[i];
+    }
+}
+
+sha256_blocks_fn_t
+sha256_get_impl(enum sha256_impl_t impl)
+{
+    switch (impl)
+    {
+    case SHA256_IMPL_PORTABLE: return sha256_portable;
+#ifdef SHA256_HAS_SHANI
+    case SHA256_IMPL_SHANI:
+        return sha256_accel_supported() ? sha256_shani : NULL;
+#endif
+#ifdef SHA256_HAS_ARMV8
+    case SHA256_IMPL_ARMV8:
+        return sha256_accel_supported() ? sha256_armv8 : NULL;
+#endif
+    default: return NULL;
+    }
+}
+
+/* for benchmarks: hash with impl from now on, if the CPU supports it */
+void
+sha256_set_impl(enum sha256_impl_t impl)
+{
+    sha256_blocks_fn_t fn = sha256_get_impl(impl);
+    if (fn != NULL)
+    {
+        sha256_impl    = fn;
+        sha256_impl_id = impl;
+    }
+}
+
+enum sha256_impl_t
+sha256_active_impl(void)
+{
+    return sha256_impl_id;
+}
+
+const char*
+sha256_impl_name(enum sha256_impl_t impl)
+{
+    switch (impl)
+    {
+    case SHA256_IMPL_PORTABLE: return "portable";
+    case SHA256_IMPL_SHANI: return "sha-ni";
+    case SHA256_IMPL_ARMV8: return "armv8";
+    default: return "unknown";
+    }
+}
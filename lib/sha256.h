@@ -0,0 +1,52 @@
+#ifndef _SHA256_H_
+#define _SHA256_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * SHA-256 (FIPS 180-4), for MAVLink 2 message signing.
+ *
+ *     struct sha256_t ctx;
+ *     sha256_init(&ctx);
+ *     sha256_update(&ctx, buf, len);
+ *     sha256_final(&ctx, digest);
+ *
+ * sha256_setup() picks the fastest block function the CPU supports (the
+ * SHA extensions on x86-64, the ARMv8 cryptography extension on AArch64,
+ * portable C otherwise); it is called from pipeline_init().
+ */
+
+#define SHA256_BLOCK_LEN  64
+#define SHA256_DIGEST_LEN 32
+
+enum sha256_impl_t
+{
+    SHA256_IMPL_PORTABLE = 0,
+    SHA256_IMPL_SHANI,
+    SHA256_IMPL_ARMV8,
+
+    MAX_SHA256_IMPLS
+};
+
+struct sha256_t
+{
+    uint32_t state[8];
+    uint64_t count; /* bytes hashed */
+    uint8_t  buf[SHA256_BLOCK_LEN];
+};
+
+void sha256_setup(void);
+void sha256_init(struct sha256_t* ctx);
+void sha256_update(struct sha256_t* ctx, const void* data, size_t len);
+void sha256_final(struct sha256_t* ctx, uint8_t digest[SHA256_DIGEST_LEN]);
+
+/* for benchmarks and tests, returns NULL if not supported on this CPU */
+typedef void (*sha256_blocks_fn_t)(
+    uint32_t state[8], const uint8_t* blocks, size_t count);
+sha256_blocks_fn_t sha256_get_impl(enum sha256_impl_t impl);
+void               sha256_set_impl(enum sha256_impl_t impl);
+enum sha256_impl_t sha256_active_impl(void);
+const char*        sha256_impl_name(enum sha256_impl_t impl);
+
+#endif /* _SHA256_H_ */
@@ -0,0 +1,331 @@
+#include "signing.h"
+#include "crc_x25.h"
+#include "sha256.h"
+
+#ifdef _STD_LIBC_
+#include <time.h>
+#endif
+
+#define SIGNING_TIMESTAMP_LEN 6
+#define SIGNING_MAC_LEN       6
+#define SIGNING_WINDOW        (SIGNING_WINDOW_US / 10) /* in timestamps */
+#define SIGNING_EPOCH         1420070400ull /* 2015-01-01, in Unix time */
+
+/**
+ * The wall clock as a MAVLink signing timestamp, 0 if there is none.
+ */
+uint64_t
+signing_wall_clock(void)
+{
+#ifdef _STD_LIBC_
+    struct timespec ts;
+    if (clock_gettime(CLOCK_REALTIME, &ts) == 0
+        && (uint64_t)ts.tv_sec > SIGNING_EPOCH)
+    {
+        return ((uint64_t)ts.tv_sec - SIGNING_EPOCH) * 100000
+            + (uint64_t)ts.tv_nsec / 10000;
+    }
+#endif
+    return 0;
+}
+
+void
+signing_init(struct signing_t* signing)
+{
+    memset(signing->keys, 0, sizeof(signing->keys));
+    memset(signing->results, 0, sizeof(signing->results));
+    signing->signed_count = 0;
+    signing->timestamp    = signing_wall_clock();
+    signing->timestamp_us = time_us();
+    link_table_init(&signing->streams, signing->stream_slots,
+        sizeof(struct signing_stream_t), SIGNING_STREAMS, SIGNING_WINDOW_US);
+}
+
+int
+signing_set_key(struct signing_t* signing, uint8_t link_id,
+    const uint8_t secret[SIGNING_KEY_LEN])
+{
+    ASSERT(signing != NULL && "key store is NULL");
+
+    memcpy(signing->keys[link_id].secret, secret, SIGNING_KEY_LEN);
+    signing->keys[link_id].valid = true;
+    return SUCC;
+}
+
+static uint64_t
+signing_now(const struct signing_t* signing, uint64_t now)
+{
+    return signing->timestamp + (now - signing->timestamp_us) / 10;
+}
+
+static void
+signing_advance(struct signing_t* signing, uint64_t timestamp, uint64_t now)
+{
+    if (timestamp > signing_now(signing, now))
+    {
+        signing->timestamp    = timestamp;
+        signing->timestamp_us = now;
+    }
+}
+
+/* the first 6 bytes of the digest, over the frame and signature[0..6] */
+static void
+signing_mac(const struct signing_key_t* key, const mavlink_message_t* m,
+    uint8_t mac[SIGNING_MAC_LEN])
+{
+    struct sha256_t ctx;
+    uint8_t         digest[SHA256_DIGEST_LEN];
+    uint8_t         crc[2] = { m->checksum & 0xFF, m->checksum >> 8 };
+
+    sha256_init(&ctx);
+    sha256_update(&ctx, key->secret, SIGNING_KEY_LEN);
+    sha256_update(&ctx, &m->magic, MAVLINK_NUM_HEADER_BYTES);
+    sha256_update(&ctx, _MAV_PAYLOAD(m), m->len);
+    sha256_update(&ctx, crc, sizeof(crc));
+    sha256_update(&ctx, m->signature, 1 + SIGNING_TIMESTAMP_LEN);
+    sha256_final(&ctx, digest);
+    memcpy(mac, digest, SIGNING_MAC_LEN);
+}
+
+/**
+ * Check the signature of msg, and that it is not a replay. Only a frame
+ * that passes advances its stream and the current time.
+ */
+enum signing_result_t
+signing_verify(
+    struct signing_t* signing, const struct message_t* msg, uint64_t now)
+{
+    const mavlink_message_t* m = &msg->msg;
+    enum signing_result_t    result;
+    uint8_t                  mac[SIGNING_MAC_LEN];
+    uint8_t                  diff = 0;
+
+    if (m->magic != MAVLINK_STX || !(m->incompat_flags & MAVLINK_IFLAG_SIGNED))
+    {
+        result = SIGNING_UNSIGNED;
+        goto out;
+    }
+
+    const struct signing_key_t* key = &signing->keys[m->signature[0]];
+    if (!key->valid)
+    {
+        result = SIGNING_UNKNOWN_KEY;
+        goto out;
+    }
+
+    signing_mac(key, m, mac);
+    for (size_t i = 0; i < SIGNING_MAC_LEN; i++)
+    {
+        diff |= mac[i] ^ m->signature[1 + SIGNING_TIMESTAMP_LEN + i];
+    }
+    if (diff != 0)
+    {
+        result = SIGNING_BAD_SIGNATURE;
+        goto out;
+    }
+
+    uint64_t timestamp = 0;
+    for (size_t i = SIGNING_TIMESTAMP_LEN; i > 0; i--)
+    {
+        timestamp = timestamp << 8 | m->signature[i];
+    }
+
+    uint32_t key_id = (uint32_t)m->signature[0] << 16
+        | link_key(m->sysid, m->compid);
+    struct signing_stream_t* stream
+        = link_table_find(&signing->streams, key_id, now);
+    if (stream != NULL)
+    {
+        if (timestamp <= stream->timestamp)
+        {
+            result = SIGNING_REPLAYED;
+            goto out;
+        }
+    }
+    else
+    {
+        /*
+         * a new stream may be up to a window old; one that evicted a live
+         * stream must be newer than the current time, or the frames of the
+         * evicted stream could be replayed
+         */
+        uint64_t current = signing_now(signing, now);
+        size_t   evicted = signing->streams.evicted;
+        if (timestamp + SIGNING_WINDOW < current)
+        {
+            result = SIGNING_EXPIRED;
+            goto out;
+        }
+        stream = link_table_insert(&signing->streams, key_id, now);
+        if (signing->streams.evicted != evicted && timestamp <= current)
+        {
+            link_table_remove(&signing->streams, stream);
+            result = SIGNING_EXPIRED;
+            goto out;
+        }
+    }
+
+    stream->timestamp = timestamp;
+    signing_advance(signing, timestamp, now);
+    result = SIGNING_OK;
+
+out:
+    signing->results[result]++;
+    return result;
+}
+
+/**
+ * Sign msg, a MAVLink 2 frame, with the key of link_id. The frame gets a
+ * new CRC, as the signed flag is part of it.
+ */
+int
+signing_sign(struct signing_t* signing, struct message_t* msg,
+    uint8_t link_id, uint64_t now)
+{
+    mavlink_message_t*          m   = &msg->msg;
+    const struct signing_key_t* key = &signing->keys[link_id];
+
+    if (m->magic != MAVLINK_STX || !key->valid)
+    {
+        return SEC_GATEWAY_INVALID_PARAM;
+    }
+
+    m->incompat_flags |= MAVLINK_IFLAG_SIGNED;
+    uint16_t crc
+        = crc_x25_update(X25_INIT_CRC, &m->len, MAVLINK_CORE_HEADER_LEN);
+    crc = crc_x25_update(crc, (const uint8_t*)_MAV_PAYLOAD(m), m->len);
+    crc_accumulate(mavlink_get_crc_extra(m), &crc);
+    m->checksum     = crc;
+    mavlink_ck_a(m) = (uint8_t)(crc & 0xFF);
+    mavlink_ck_b(m) = (uint8_t)(crc >> 8);
+
+    /* timestamps never repeat, whatever the clock does */
+    uint64_t timestamp = signing_now(signing, now);
+    if (timestamp <= signing->timestamp)
+    {
+        timestamp = signing->timestamp + 1;
+    }
+    signing->timestamp    = timestamp;
+    signing->timestamp_us = now;
+
+    m->signature[0] = link_id;
+    for (size_t i = 1; i <= SIGNING_TIMESTAMP_LEN; i++)
+    {
+        m->signature[i] = (uint8_t)timestamp;
+        timestamp >>= 8;
+    }
+    signing_mac(key, m, &m->signature[1 + SIGNING_TIMESTAMP_LEN]);
+    signing->signed_count++;
+    return SUCC;
+}
+
+const char*
+signing_result_name(enum signing_result_t result)
+{
+    switch (result)
+    {
+    case SIGNING_OK: return "signed";
+    case SIGNING_UNSIGNED: return "unsigned";
+    case SIGNING_UNKNOWN_KEY: return "unknown key";
+    case SIGNING_BAD_SIGNATURE: return "bad signature";
+    case SIGNING_REPLAYED: return "replayed";
+    case SIGNING_EXPIRED: return "expired";
+    default: return "unknown";
+    }
+}
+
+static int
+signing_hex(char c)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F')
+    {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/**
+ * Parse a key of SIGNING_KEY_LEN bytes from 2 * SIGNING_KEY_LEN hex digits.
+ */
+bool
+signing_parse_key(const char* hex, uint8_t key[SIGNING_KEY_LEN])
+{
+    if (strlen(hex) != 2 * SIGNING_KEY_LEN)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < SIGNING_KEY_LEN; i++)
+    {
+        int hi = signing_hex(hex[2 * i]), lo = signing_hex(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0)
+        {
+            return false;
+        }
+        key[i] = (uint8_t)(hi << 4 | lo);
+    }
+    return true;
+}
+
+#ifdef _STD_LIBC_
+int
+signing_load_keys(struct signing_t* signing, const char* path)
+{
+    ASSERT(signing != NULL && "key store is NULL");
+    ASSERT(path != NULL && "path is NULL");
+
+    FILE* f = fopen(path, "r");
+    if (f == NULL)
+    {
+        WARN("cannot open key file %s\n", path);
+        return SEC_GATEWAY_IO_FAULT;
+    }
+
+    char   line[256];
+    size_t lineno = 0, keys = 0;
+    int    rv     = SUCC;
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        lineno++;
+        char* comment = strchr(line, '#');
+        if (comment != NULL)
+        {
+            *comment = '\0';
+        }
+
+        unsigned link_id;
+        char     hex[2 * SIGNING_KEY_LEN + 2];
+        char     extra;
+        int      n = sscanf(line, "%u %65s %c", &link_id, hex, &extra);
+        if (n <= 0)
+        {
+            continue;
+        }
+
+        uint8_t secret[SIGNING_KEY_LEN];
+        if (n != 2 || link_id > UINT8_MAX || !signing_parse_key(hex, secret))
+        {
+            WARN("%s:%lu: expected a link id and %d hex digits\n", path,
+                lineno, 2 * SIGNING_KEY_LEN);
+            rv = SEC_GATEWAY_INVALID_PARAM;
+            break;
+        }
+        signing_set_key(signing, (uint8_t)link_id, secret);
+        keys++;
+    }
+    fclose(f);
+
+    if (rv == SUCC)
+    {
+        INFO("%lu signing keys loaded from %s\n", keys, path);
+    }
+    return rv;
+}
+#endif
@@ -0,0 +1,94 @@
+#ifndef _SIGNING_H_
+#define _SIGNING_H_
+
+#include "link_table.h"
+
+/*
+ * MAVLink 2 message signing.
+ *
+ * The signature of a frame is the first 6 bytes of
+ * SHA-256(secret key, header, payload, CRC, link id, timestamp), with the
+ * key picked by the link id the frame carries. Keys are kept in a table
+ * indexed by link id.
+ *
+ * A source with a key store accepts only signed frames with a valid
+ * signature and a timestamp newer than the last one of the same stream
+ * (link id, sysid, compid); a stream not seen for SIGNING_WINDOW_US is
+ * new again, and has to be within that window of the current time. A sink
+ * with a key store signs every MAVLink 2 frame it sends with the key of its
+ * link id. Timestamps count 10 us since 2015-01-01 (GMT); the current time
+ * follows the newest timestamp seen, and starts at the wall clock on Linux.
+ *
+ * Not thread-safe: verification and signing run on the pipeline thread.
+ */
+
+#ifndef SIGNING_STREAMS
+#ifdef _STD_LIBC_
+#define SIGNING_STREAMS 256
+#else
+#define SIGNING_STREAMS 32
+#endif
+#endif
+
+#define SIGNING_KEY_LEN   32
+#define SIGNING_WINDOW_US 60000000ull /* as the MAVLink reference */
+
+struct signing_key_t
+{
+    bool    valid;
+    uint8_t secret[SIGNING_KEY_LEN];
+};
+
+struct signing_stream_t
+{
+    struct link_slot_t slot;
+    uint64_t           timestamp; /* newest accepted */
+};
+
+enum signing_result_t
+{
+    SIGNING_OK = 0,
+    SIGNING_UNSIGNED,      /* MAVLink 1, or no signature */
+    SIGNING_UNKNOWN_KEY,   /* no key for the link id */
+    SIGNING_BAD_SIGNATURE,
+    SIGNING_REPLAYED,      /* timestamp not newer than the stream's */
+    SIGNING_EXPIRED,       /* timestamp out of the window */
+
+    MAX_SIGNING_RESULTS
+};
+
+struct signing_t
+{
+    struct signing_key_t keys[256]; /* by link id */
+
+    /* current time, advanced by time_us() since it was set */
+    uint64_t timestamp;
+    uint64_t timestamp_us;
+
+    struct link_table_t     streams;
+    struct signing_stream_t stream_slots[SIGNING_STREAMS];
+
+    /* statistics */
+    size_t results[MAX_SIGNING_RESULTS];
+    size_t signed_count;
+};
+
+void signing_init(struct signing_t* signing);
+int  signing_set_key(struct signing_t* signing, uint8_t link_id,
+     const uint8_t secret[SIGNING_KEY_LEN]);
+enum signing_result_t signing_verify(
+    struct signing_t* signing, const struct message_t* msg, uint64_t now);
+int  signing_sign(struct signing_t* signing, struct message_t* msg,
+     uint8_t link_id, uint64_t now);
+const char* signing_result_name(enum signing_result_t result);
+
+/* shared with transformer_aead.c */
+uint64_t signing_wall_clock(void);
+bool     signing_parse_key(const char* hex, uint8_t key[SIGNING_KEY_LEN]);
+
+#ifdef _STD_LIBC_
+/* one key per line: link id and 64 hex digits; '#' starts a comment */
+int signing_load_keys(struct signing_t* signing, const char* path);
+#endif
+
+#endif /* _SIGNING_H_ */
@@ -0,0 +1,269 @@
+#ifndef _STD_LIBC_
+#error "This file requires threads!"
+#endif
+
+#include "secure_gateway.h"
+#include <stdlib.h>
+#include <threads.h>
+
+/*
+ * Per-sink egress stage: pipeline_push() hands the (already transformed)
+ * message to a bounded queue and a worker thread calls sink->route(). A
+ * blocking send() or write() on one sink then only delays that sink. Queued
+ * messages are pool references, not copies.
+ *
+ * A full queue sheds messages the policer let through marked
+ * (MESSAGE_ATTRIBUTE_POLICED) before it applies its overflow policy.
+ */
+
+struct sink_egress_t
+{
+    struct sink_t*       sink;
+    enum sink_overflow_t overflow;
+    thrd_t               worker;
+    mtx_t                lock;
+    cnd_t                not_empty;
+    cnd_t                not_full;
+    bool                 terminated;
+
+    struct message_t**   ring;
+    size_t               depth;
+    size_t               head;
+    size_t               count;
+
+    struct sink_egress_stats_t stats;
+};
+
+int
+sink_set_egress(struct pipeline_t* pipeline, enum sink_type_t type,
+    size_t depth, enum sink_overflow_t overflow)
+{
+    ASSERT(pipeline != NULL && "pipeline is NULL");
+    ASSERT(type < MAX_SINKS && "sink id is out of range");
+
+    struct sink_t* sink = pipeline->get_sink(pipeline, type);
+    if (!sink->is_connected || sink->egress != NULL)
+    {
+        return SEC_GATEWAY_INVALID_STATE;
+    }
+
+    sink->egress_depth    = depth;
+    sink->egress_overflow = overflow;
+    return SUCC;
+}
+
+static int
+sink_egress_worker(void* arg)
+{
+    struct sink_egress_t* q = arg;
+    struct message_t*     msg;
+
+    mtx_lock(&q->lock);
+    for (;;)
+    {
+        while (q->count == 0 && !q->terminated)
+        {
+            cnd_wait(&q->not_empty, &q->lock);
+        }
+        /* drain everything before honoring termination */
+        if (q->count == 0)
+        {
+            break;
+        }
+
+        msg     = q->ring[q->head];
+        q->head = (q->head + 1) % q->depth;
+        q->count--;
+        cnd_signal(&q->not_full);
+
+        mtx_unlock(&q->lock);
+        q->sink->route(q->sink, msg);
+        message_put(msg);
+        mtx_lock(&q->lock);
+    }
+    mtx_unlock(&q->lock);
+
+    return 0;
+}
+
+int
+sink_egress_start(struct sink_t* sink)
+{
+    ASSERT(sink != NULL && "sink is NULL");
+    ASSERT(sink->egress == NULL && "egress queue already started");
+
+    if (sink->route == NULL || sink->egress_depth == 0)
+    {
+        return SEC_GATEWAY_INVALID_STATE;
+    }
+
+    struct sink_egress_t* q = calloc(1, sizeof(*q));
+    if (q == NULL)
+    {
+        return SEC_GATEWAY_NO_MEMORY;
+    }
+    q->ring = calloc(sink->egress_depth, sizeof(struct message_t*));
+    if (q->ring == NULL)
+    {
+        free(q);
+        return SEC_GATEWAY_NO_MEMORY;
+    }
+    q->sink     = sink;
+    q->depth    = sink->egress_depth;
+    q->overflow = sink->egress_overflow;
+
+    if (mtx_init(&q->lock, mtx_plain) != thrd_success
+        || cnd_init(&q->not_empty) != thrd_success
+        || cnd_init(&q->not_full) != thrd_success)
+    {
+        free(q->ring);
+        free(q);
+        return SEC_GATEWAY_THREAD_ERROR;
+    }
+
+    if (thrd_create(&q->worker, sink_egress_worker, q) != thrd_success)
+    {
+        mtx_destroy(&q->lock);
+        cnd_destroy(&q->not_empty);
+        cnd_destroy(&q->not_full);
+        free(q->ring);
+        free(q);
+        return SEC_GATEWAY_THREAD_ERROR;
+    }
+
+    sink->egress = q;
+    return SUCC;
+}
+
+/* drop the oldest policed message of a full queue, false if there is none */
+static bool
+sink_egress_evict_policed(struct sink_egress_t* q)
+{
+    for (size_t k = 0; k < q->count; k++)
+    {
+        struct message_t** slot = &q->ring[(q->head + k) % q->depth];
+        if (!((*slot)->attribute & MESSAGE_ATTRIBUTE_POLICED))
+        {
+            continue;
+        }
+        message_put(*slot);
+        /* keep the order of the ones behind it */
+        for (k++; k < q->count; k++)
+        {
+            struct message_t** next = &q->ring[(q->head + k) % q->depth];
+            *slot                   = *next;
+            slot                    = next;
+        }
+        q->count--;
+        q->stats.dropped_policed++;
+        return true;
+    }
+    return false;
+}
+
+int
+sink_egress_enqueue(struct sink_t* sink, struct message_t* msg)
+{
+    struct sink_egress_t* q = sink->egress;
+    ASSERT(q != NULL && "egress queue is not started");
+
+    struct message_t* ref = message_ref(msg);
+
+    mtx_lock(&q->lock);
+    if (ref == NULL)
+    {
+        q->stats.dropped_newest++;
+        mtx_unlock(&q->lock);
+        return SEC_GATEWAY_NO_MEMORY;
+    }
+
+    if (q->count == q->depth && (ref->attribute & MESSAGE_ATTRIBUTE_POLICED))
+    {
+        q->stats.dropped_policed++;
+        mtx_unlock(&q->lock);
+        message_put(ref);
+        return SEC_GATEWAY_NO_RESOURCE;
+    }
+
+    if (q->count == q->depth && !sink_egress_evict_policed(q))
+    {
+        switch (q->overflow)
+        {
+        case SINK_OVERFLOW_DROP_NEWEST:
+            q->stats.dropped_newest++;
+            mtx_unlock(&q->lock);
+            message_put(ref);
+            return SEC_GATEWAY_NO_RESOURCE;
+        case SINK_OVERFLOW_DROP_OLDEST:
+            message_put(q->ring[q->head]);
+            q->head = (q->head + 1) % q->depth;
+            q->count--;
+            q->stats.dropped_oldest++;
+            break;
+        default:
+            q->stats.blocked++;
+            while (q->count == q->depth)
+            {
+                cnd_wait(&q->not_full, &q->lock);
+            }
+            break;
+        }
+    }
+
+    q->ring[(q->head + q->count) % q->depth] = ref;
+    q->count++;
+    q->stats.queued++;
+    cnd_signal(&q->not_empty);
+    mtx_unlock(&q->lock);
+
+    return SUCC;
+}
+
+void
+sink_egress_stats(struct sink_t* sink, struct sink_egress_stats_t* stats)
+{
+    struct sink_egress_t* q = sink->egress;
+
+    if (q == NULL)
+    {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+
+    mtx_lock(&q->lock);
+    memcpy(stats, &q->stats, sizeof(*stats));
+    mtx_unlock(&q->lock);
+}
+
+void
+sink_egress_stop(struct sink_t* sink)
+{
+    struct sink_egress_t* q = sink->egress;
+
+    if (q == NULL)
+    {
+        return;
+    }
+
+    mtx_lock(&q->lock);
+    q->terminated = true;
+    cnd_signal(&q->not_empty);
+    mtx_unlock(&q->lock);
+    thrd_join(q->worker, NULL);
+
+    if (q->stats.dropped_oldest > 0 || q->stats.dropped_newest > 0
+        || q->stats.dropped_policed > 0)
+    {
+        INFO("egress queue dropped %zu oldest / %zu newest / %zu policed of "
+             "%zu messages\n",
+            q->stats.dropped_oldest, q->stats.dropped_newest,
+            q->stats.dropped_policed, q->stats.queued);
+    }
+
+    sink->egress = NULL;
+    mtx_destroy(&q->lock);
+    cnd_destroy(&q->not_empty);
+    cnd_destroy(&q->not_full);
+    free(q->ring);
+    free(q);
+}
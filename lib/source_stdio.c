@@ -25,6 +25,22 @@ stdio_cleanup(void* opaque)
 #endif
 }
 
+#ifdef _STD_LIBC_
+/* stdin is non-blocking once stdio_init() has run */
+static size_t
+stdio_read_bytes(struct source_t* src, uint8_t* buf, size_t max)
+{
+    ssize_t n = read(STDIN_FILENO, buf, max);
+    return n > 0 ? (size_t)n : 0;
+}
+
+static int
+stdio_poll_fd(struct source_t* src)
+{
+    return STDIN_FILENO;
+}
+#endif
+
 static int
 stdio_route(struct sink_t* sink, struct message_t* msg)
 {
@@ -40,7 +56,7 @@ stdio_route(struct sink_t* sink, struct message_t* msg)
     }
     printf("]: attr 0x%lx ", msg->attribute);
 
-    const mavlink_message_info_t* info = mavlink_get_message_info(&msg->msg);
+    const mavlink_message_info_t* info = message_info(msg->msg.msgid);
     if (info != NULL)
     {
         printf("%s (%d) comp: %u seq: %u {", info->name, info->msgid, msg->msg.compid, msg->msg.seq);
@@ -112,3 +128,24 @@ hook_stdio_sink(struct pipeline_t* pipeline, enum sink_type_t sink_type)
     sink->cleanup       = stdio_cleanup;
     sink->route         = stdio_route;
 }
+
+#ifdef _STD_LIBC_
+/* frames piped into stdin, e.g. a capture replayed by the test scripts */
+int
+hook_stdio_source(struct pipeline_t* pipeline, size_t source_id)
+{
+    ASSERT(pipeline != NULL);
+
+    struct source_t* source = source_allocate(&pipeline->sources, source_id);
+    if (source == NULL)
+    {
+        WARN("Failed to allocate source!\n");
+        return SEC_GATEWAY_IO_FAULT;
+    }
+    source->read_bytes = stdio_read_bytes;
+    source->poll_fd    = stdio_poll_fd;
+    source->init       = stdio_init;
+    source->cleanup    = stdio_cleanup;
+    return SUCC;
+}
+#endif
@@ -3,8 +3,10 @@
 #endif
 
 #include "secure_gateway.h"
+#include "message_io.h"
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <errno.h>
 #include <stdatomic.h>
 #include <sys/socket.h>
 #include <threads.h>
@@ -22,10 +24,10 @@ struct tcp_socket_t
     thrd_t        thread;
     mtx_t         lock;
     cnd_t         buffer_empty;
+    int           event_fd;
 #endif
     uint8_t buffer[4096];
     ssize_t cur_read, buffer_size;
-    uint8_t output_buffer[4096];
 };
 
 static void
@@ -36,6 +38,7 @@ tcp_state_init(struct tcp_socket_t* tcp)
     cnd_init(&tcp->buffer_empty);
     tcp->thread = (thrd_t)-1;
     atomic_init(&tcp->terminate, false);
+    tcp->event_fd = event_create();
 #endif
 
     tcp->cur_read    = 0;
@@ -56,6 +59,8 @@ tcp_cleanup(struct tcp_socket_t* tcp)
     cnd_destroy(&tcp->buffer_empty);
     if (tcp->thread != (thrd_t)-1)
         thrd_join(tcp->thread, NULL);
+    if (tcp->event_fd != -1)
+        close(tcp->event_fd);
 #endif
 
     if (tcp->fd != -1)
@@ -189,6 +194,7 @@ tcp_server(void* arg)
 
         tcp->cur_read    = 0;
         tcp->buffer_size = read;
+        event_notify(tcp->event_fd);
 
         while (tcp->cur_read < tcp->buffer_size)
         {
@@ -325,6 +331,89 @@ tcp_read_byte_mt(struct source_t* source)
     return byte;
 }
 
+static size_t
+tcp_read_bytes(struct source_t* source, uint8_t* buf, size_t max)
+{
+    ASSERT(source != NULL && "source is NULL");
+    ASSERT(source->opaque != NULL && "source->opaque is NULL");
+    struct tcp_socket_t* tcp = (struct tcp_socket_t*)source->opaque;
+
+    if (!tcp->initialized)
+    {
+        int rv = tcp_init(tcp);
+        if (rv != SUCC)
+        {
+            return 0;
+        }
+    }
+
+    if (tcp->buffer_size > 0 && tcp->cur_read < tcp->buffer_size)
+    {
+        size_t n = (size_t)(tcp->buffer_size - tcp->cur_read);
+        n        = n < max ? n : max;
+        memcpy(buf, &tcp->buffer[tcp->cur_read], n);
+        tcp->cur_read += n;
+        return n;
+    }
+
+    /* nothing left over, receive straight into the caller's buffer */
+    tcp->cur_read    = 0;
+    tcp->buffer_size = 0;
+    ssize_t read     = recv(tcp->connection, buf, max, 0);
+    if (read < 0)
+    {
+        perror("Failed to read from socket!");
+        return 0;
+    }
+    return (size_t)read;
+}
+
+static size_t
+tcp_read_bytes_mt(struct source_t* source, uint8_t* buf, size_t max)
+{
+    ASSERT(source != NULL && "source is NULL");
+    ASSERT(source->opaque != NULL && "source->opaque is NULL");
+    struct tcp_socket_t* tcp = (struct tcp_socket_t*)source->opaque;
+
+    if (!tcp->initialized)
+    {
+        int rv = tcp_init_mt(tcp);
+        if (rv != SUCC)
+        {
+            return 0;
+        }
+    }
+
+    size_t n = 0;
+    mtx_lock(&tcp->lock);
+    if (tcp->cur_read < tcp->buffer_size)
+    {
+        n = (size_t)(tcp->buffer_size - tcp->cur_read);
+        n = n < max ? n : max;
+        memcpy(buf, &tcp->buffer[tcp->cur_read], n);
+        tcp->cur_read += n;
+    }
+    if (tcp->cur_read >= tcp->buffer_size)
+    {
+        cnd_signal(&tcp->buffer_empty);
+    }
+    if (n == 0)
+    {
+        event_clear(tcp->event_fd);
+    }
+    mtx_unlock(&tcp->lock);
+    return n;
+}
+
+static int
+tcp_poll_fd_mt(struct source_t* source)
+{
+    ASSERT(source != NULL && "source is NULL");
+    ASSERT(source->opaque != NULL && "source->opaque is NULL");
+    struct tcp_socket_t* tcp = (struct tcp_socket_t*)source->opaque;
+    return tcp->initialized ? tcp->event_fd : -1;
+}
+
 static int
 tcp_route_to(struct sink_t* sink, struct message_t* msg)
 {
@@ -341,18 +430,18 @@ tcp_route_to(struct sink_t* sink, struct message_t* msg)
         }
     }
 
-    size_t  len = mavlink_msg_length(&msg->msg);
-    ssize_t rv  = send(tcp->connection, &msg->msg, len, 0);
+    struct message_wire_t wire;
+    message_wire(msg, &wire);
+    ssize_t rv = writev(tcp->connection, wire.iov, wire.iovcnt);
     if (rv < 0)
     {
         perror("Failed to send message!");
         return SEC_GATEWAY_IO_FAULT;
     }
 
-    if (rv < msg->msg.len)
+    if ((size_t)rv < wire.len)
     {
-        WARN(
-            "Failed to send entire message! sent (%ld / %d)", rv, msg->msg.len);
+        WARN("Failed to send entire message! sent (%zd / %zu)", rv, wire.len);
         return SEC_GATEWAY_IO_FAULT;
     }
 
@@ -381,23 +470,62 @@ tcp_route_to_mt(struct sink_t* sink, struct message_t* msg)
         return SUCC;
     }
 
-    int len = mavlink_msg_to_send_buffer(tcp->output_buffer, &msg->msg);
-    int rv  = send(tcp->connection, tcp->output_buffer, len, 0);
+    struct message_wire_t wire;
+    message_wire(msg, &wire);
+    ssize_t rv = writev(tcp->connection, wire.iov, wire.iovcnt);
     if (rv < 0)
     {
         perror("Failed to send message!");
         return SEC_GATEWAY_IO_FAULT;
     }
 
-    if (rv < len)
+    if ((size_t)rv < wire.len)
     {
-        WARN("Failed to send entire message! sent (%d / %d)", rv, msg->msg.len);
+        WARN("Failed to send entire message! sent (%zd / %zu)", rv, wire.len);
         return SEC_GATEWAY_IO_FAULT;
     }
 
     return SUCC;
 }
 
+static int
+tcp_write_bytes_mt(
+    struct sink_t* sink, const uint8_t* buf, size_t len, size_t* written)
+{
+    ASSERT(sink != NULL && "sink is NULL");
+    ASSERT(sink->opaque != NULL && "sink->opaque is NULL");
+    struct tcp_socket_t* tcp = (struct tcp_socket_t*)sink->opaque;
+
+    if (!tcp->initialized)
+    {
+        int rv = tcp_init_mt(tcp);
+        if (rv != 0)
+        {
+            return SEC_GATEWAY_IO_FAULT;
+        }
+    }
+
+    *written = 0;
+    if (tcp->connection == -1)
+    {
+        return SEC_GATEWAY_NO_CLIENT;
+    }
+
+    ssize_t rv = send(tcp->connection, buf, len, MSG_DONTWAIT);
+    if (rv < 0)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            return SEC_GATEWAY_NO_RESOURCE;
+        }
+        perror("Failed to send bytes!");
+        return SEC_GATEWAY_IO_FAULT;
+    }
+
+    *written = (size_t)rv;
+    return *written < len ? SEC_GATEWAY_NO_RESOURCE : SUCC;
+}
+
 int
 hook_tcp(struct pipeline_t* pipeline, int port, size_t source_id,
     enum sink_type_t sink_type)
@@ -424,13 +552,16 @@ hook_tcp(struct pipeline_t* pipeline, int port, size_t source_id,
     source->opaque = tcp;
 
 #ifdef __STDC_NO_THREADS__
-    source->has_more  = tcp_has_more;
-    source->read_byte = tcp_read_byte;
-    source->init      = (init_t)tcp_init;
+    source->has_more   = tcp_has_more;
+    source->read_byte  = tcp_read_byte;
+    source->read_bytes = tcp_read_bytes;
+    source->init       = (init_t)tcp_init;
 #else
-    source->has_more  = tcp_has_more_mt;
-    source->read_byte = tcp_read_byte_mt;
-    source->init      = (init_t)tcp_init_mt;
+    source->has_more   = tcp_has_more_mt;
+    source->read_byte  = tcp_read_byte_mt;
+    source->read_bytes = tcp_read_bytes_mt;
+    source->poll_fd    = tcp_poll_fd_mt;
+    source->init       = (init_t)tcp_init_mt;
 #endif
     source->cleanup = (cleanup_t)tcp_cleanup;
 
@@ -448,6 +579,7 @@ hook_tcp(struct pipeline_t* pipeline, int port, size_t source_id,
     sink->init  = (init_t)tcp_init;
 #else
     sink->route       = tcp_route_to_mt;
+    sink->write_bytes = tcp_write_bytes_mt;
     sink->init        = (init_t)tcp_init_mt;
 #endif
     sink->cleanup = (cleanup_t)tcp_cleanup;
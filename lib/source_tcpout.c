@@ -3,7 +3,9 @@
 #endif
 
 #include "secure_gateway.h"
+#include "message_io.h"
 #include <arpa/inet.h>
+#include <errno.h>
 #include <netinet/in.h>
 #include <stdatomic.h>
 #include <sys/socket.h>
@@ -21,9 +23,9 @@ struct tcpout_socket_t
     thrd_t      thread;
     mtx_t       lock;
     cnd_t       buffer_empty;
+    int         event_fd;
     uint8_t     buffer[4096];
     ssize_t     cur_read, buffer_size;
-    uint8_t     output_buffer[4096];
 };
 
 static void
@@ -33,6 +35,7 @@ tcp_state_init(struct tcpout_socket_t* tcp)
     cnd_init(&tcp->buffer_empty);
     tcp->thread = (thrd_t)-1;
     atomic_init(&tcp->terminate, false);
+    tcp->event_fd = event_create();
 
     tcp->cur_read    = 0;
     tcp->buffer_size = 0;
@@ -52,6 +55,9 @@ tcp_cleanup(struct tcpout_socket_t* tcp)
     if (tcp->thread != (thrd_t)-1)
         thrd_join(tcp->thread, NULL);
 
+    if (tcp->event_fd != -1)
+        close(tcp->event_fd);
+
     if (tcp->fd != -1)
         close(tcp->fd);
 
@@ -138,6 +144,7 @@ tcp_server(void* arg)
 
         tcp->cur_read    = 0;
         tcp->buffer_size = read;
+        event_notify(tcp->event_fd);
 
         while (tcp->cur_read < tcp->buffer_size)
         {
@@ -219,6 +226,52 @@ tcp_read_byte(struct source_t* source)
     return byte;
 }
 
+static size_t
+tcp_read_bytes(struct source_t* source, uint8_t* buf, size_t max)
+{
+    ASSERT(source != NULL && "source is NULL");
+    ASSERT(source->opaque != NULL && "source->opaque is NULL");
+    struct tcpout_socket_t* tcp = (struct tcpout_socket_t*)source->opaque;
+
+    if (!tcp->initialized)
+    {
+        int rv = tcp_init(tcp);
+        if (rv != SUCC)
+        {
+            return 0;
+        }
+    }
+
+    size_t n = 0;
+    mtx_lock(&tcp->lock);
+    if (tcp->cur_read < tcp->buffer_size)
+    {
+        n = (size_t)(tcp->buffer_size - tcp->cur_read);
+        n = n < max ? n : max;
+        memcpy(buf, &tcp->buffer[tcp->cur_read], n);
+        tcp->cur_read += n;
+    }
+    if (tcp->cur_read >= tcp->buffer_size)
+    {
+        cnd_signal(&tcp->buffer_empty);
+    }
+    if (n == 0)
+    {
+        event_clear(tcp->event_fd);
+    }
+    mtx_unlock(&tcp->lock);
+    return n;
+}
+
+static int
+tcp_poll_fd(struct source_t* source)
+{
+    ASSERT(source != NULL && "source is NULL");
+    ASSERT(source->opaque != NULL && "source->opaque is NULL");
+    struct tcpout_socket_t* tcp = (struct tcpout_socket_t*)source->opaque;
+    return tcp->initialized ? tcp->event_fd : -1;
+}
+
 static int
 tcp_route_to(struct sink_t* sink, struct message_t* msg)
 {
@@ -241,23 +294,62 @@ tcp_route_to(struct sink_t* sink, struct message_t* msg)
         return SUCC;
     }
 
-    int     len = mavlink_msg_to_send_buffer(tcp->output_buffer, &msg->msg);
-    ssize_t rv  = send(tcp->fd, tcp->output_buffer, len, 0);
+    struct message_wire_t wire;
+    message_wire(msg, &wire);
+    ssize_t rv = writev(tcp->fd, wire.iov, wire.iovcnt);
     if (rv < 0)
     {
         perror("Failed to send message!");
         return SEC_GATEWAY_IO_FAULT;
     }
 
-    if (rv < len)
+    if ((size_t)rv < wire.len)
     {
-        WARN("Failed to send entire message! sent (%zd / %d)", rv, msg->msg.len);
+        WARN("Failed to send entire message! sent (%zd / %zu)", rv, wire.len);
         return SEC_GATEWAY_IO_FAULT;
     }
 
     return SUCC;
 }
 
+static int
+tcp_write_bytes(
+    struct sink_t* sink, const uint8_t* buf, size_t len, size_t* written)
+{
+    ASSERT(sink != NULL && "sink is NULL");
+    ASSERT(sink->opaque != NULL && "sink->opaque is NULL");
+    struct tcpout_socket_t* tcp = (struct tcpout_socket_t*)sink->opaque;
+
+    if (!tcp->initialized)
+    {
+        int rv = tcp_init(tcp);
+        if (rv != 0)
+        {
+            return SEC_GATEWAY_IO_FAULT;
+        }
+    }
+
+    *written = 0;
+    if (tcp->fd == -1)
+    {
+        return SEC_GATEWAY_NO_CLIENT;
+    }
+
+    ssize_t rv = send(tcp->fd, buf, len, MSG_DONTWAIT);
+    if (rv < 0)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            return SEC_GATEWAY_NO_RESOURCE;
+        }
+        perror("Failed to send bytes!");
+        return SEC_GATEWAY_IO_FAULT;
+    }
+
+    *written = (size_t)rv;
+    return *written < len ? SEC_GATEWAY_NO_RESOURCE : SUCC;
+}
+
 int
 hook_tcpout(struct pipeline_t* pipeline, const char * ip, int port, size_t source_id,
     enum sink_type_t sink_type)
@@ -284,10 +376,12 @@ hook_tcpout(struct pipeline_t* pipeline, const char * ip, int port, size_t sourc
     }
     source->opaque = tcp;
 
-    source->has_more  = tcp_has_more;
-    source->read_byte = tcp_read_byte;
-    source->init      = (init_t)tcp_init;
-    source->cleanup   = (cleanup_t)tcp_cleanup;
+    source->has_more   = tcp_has_more;
+    source->read_byte  = tcp_read_byte;
+    source->read_bytes = tcp_read_bytes;
+    source->poll_fd    = tcp_poll_fd;
+    source->init       = (init_t)tcp_init;
+    source->cleanup    = (cleanup_t)tcp_cleanup;
 
     struct sink_t* sink = sink_allocate(&pipeline->sinks, sink_type);
     if (sink == NULL)
@@ -298,9 +392,10 @@ hook_tcpout(struct pipeline_t* pipeline, const char * ip, int port, size_t sourc
     }
     sink->opaque = tcp;
 
-    sink->route   = tcp_route_to;
-    sink->init    = (init_t)tcp_init;
-    sink->cleanup = (cleanup_t)tcp_cleanup;
+    sink->route       = tcp_route_to;
+    sink->write_bytes = tcp_write_bytes;
+    sink->init        = (init_t)tcp_init;
+    sink->cleanup     = (cleanup_t)tcp_cleanup;
 
     return SUCC;
 }
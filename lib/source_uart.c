@@ -4,6 +4,7 @@
 
 #include "ring_buffer.h"
 #include "secure_gateway.h"
+#include "message_io.h"
 #include <stdatomic.h>
 #include <threads.h>
 
@@ -21,9 +22,10 @@ struct uart_connection_t
     thrd_t               thread;
     mtx_t                lock;
     cnd_t                buffer_not_full;
+    int                  event_fd;
     struct termios       options;
     struct ring_buffer_t input_buffer;
-    uint8_t              output_buffer[4096];
+    uint8_t              input_storage[4096];
 };
 
 static uint8_t uart_input[256];
@@ -45,6 +47,7 @@ uart_server(void* arg)
 
         mtx_lock(&uart->lock);
         ring_buffer_copy_from(&uart->input_buffer, uart_input, bytes_read);
+        event_notify(uart->event_fd);
         while (ring_buffer_is_full(&uart->input_buffer))
         {
             cnd_wait(&uart->buffer_not_full, &uart->lock);
@@ -104,8 +107,9 @@ uart_state_init(struct uart_connection_t* uart)
     cnd_init(&uart->buffer_not_full);
     uart->thread = (thrd_t)-1;
     atomic_init(&uart->terminate, false);
+    uart->event_fd = event_create();
     ring_buffer_init(
-        &uart->input_buffer, uart->output_buffer, sizeof(uart->output_buffer));
+        &uart->input_buffer, uart->input_storage, sizeof(uart->input_storage));
     return SUCC;
 }
 
@@ -158,6 +162,10 @@ uart_cleanup(struct uart_connection_t* uart)
     {
         close(uart->fd);
     }
+    if (uart->event_fd != -1)
+    {
+        close(uart->event_fd);
+    }
     free(uart);
 }
 
@@ -197,6 +205,45 @@ uart_read_byte(struct source_t* source)
     return byte;
 }
 
+static size_t
+uart_read_bytes(struct source_t* source, uint8_t* buf, size_t max)
+{
+    ASSERT(source != NULL && "source is NULL!");
+    ASSERT(source->opaque != NULL && "source->opaque is NULL!");
+    struct uart_connection_t* uart = (struct uart_connection_t*)source->opaque;
+    if (!uart->initialized)
+    {
+        if (uart_init(uart) != SUCC)
+        {
+            return 0;
+        }
+    }
+
+    size_t n = 0;
+    mtx_lock(&uart->lock);
+    if (!ring_buffer_is_empty(&uart->input_buffer))
+    {
+        n = ring_buffer_copy_to(&uart->input_buffer, buf, max);
+        cnd_signal(&uart->buffer_not_full);
+    }
+    else
+    {
+        event_clear(uart->event_fd);
+    }
+    mtx_unlock(&uart->lock);
+
+    return n;
+}
+
+static int
+uart_poll_fd(struct source_t* source)
+{
+    ASSERT(source != NULL && "source is NULL!");
+    ASSERT(source->opaque != NULL && "source->opaque is NULL!");
+    struct uart_connection_t* uart = (struct uart_connection_t*)source->opaque;
+    return uart->initialized ? uart->event_fd : -1;
+}
+
 static int
 uart_route_to(struct sink_t* sink, struct message_t* msg)
 {
@@ -212,15 +259,16 @@ uart_route_to(struct sink_t* sink, struct message_t* msg)
         }
     }
 
-    int len = mavlink_msg_to_send_buffer(uart->output_buffer, &msg->msg);
-    int bytes_written = write(uart->fd, uart->output_buffer, len);
+    struct message_wire_t wire;
+    message_wire(msg, &wire);
+    ssize_t bytes_written = writev(uart->fd, wire.iov, wire.iovcnt);
     if (bytes_written == -1)
     {
         WARN("Failed to write to UART device! %s\n", strerror(errno));
         return SEC_GATEWAY_IO_FAULT;
     }
 
-    if (bytes_written < len)
+    if ((size_t)bytes_written < wire.len)
     {
         WARN("Failed to write all bytes to UART device! %s\n", strerror(errno));
         return SEC_GATEWAY_IO_FAULT;
@@ -255,10 +303,12 @@ hook_uart(struct pipeline_t* pipeline, char* device, size_t source_id,
     }
     source->opaque = uart;
 
-    source->init      = (init_t)uart_init;
-    source->has_more  = uart_has_more;
-    source->read_byte = uart_read_byte;
-    source->cleanup   = (cleanup_t)uart_cleanup;
+    source->init       = (init_t)uart_init;
+    source->has_more   = uart_has_more;
+    source->read_byte  = uart_read_byte;
+    source->read_bytes = uart_read_bytes;
+    source->poll_fd    = uart_poll_fd;
+    source->cleanup    = (cleanup_t)uart_cleanup;
 
     struct sink_t* sink = sink_allocate(&pipeline->sinks, sink_type);
     if (sink == NULL)
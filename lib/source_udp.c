@@ -3,6 +3,7 @@
 #endif
 
 #include "secure_gateway.h"
+#include "message_io.h"
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <stdatomic.h>
@@ -30,9 +31,9 @@ struct udp_socket_t
     struct sockaddr clt_addr;
     socklen_t       clt_addr_len;
     cnd_t           buffer_empty;
+    int             event_fd;
     uint8_t         buffer[4096];
     ssize_t         cur_read, buffer_size;
-    uint8_t         output_buffer[4096];
 };
 
 static int
@@ -74,6 +75,7 @@ udp_server(void* arg)
         mtx_lock(&udp->lock);
         udp->cur_read    = 0;
         udp->buffer_size = bytes_read;
+        event_notify(udp->event_fd);
 
         while (udp->cur_read < udp->buffer_size)
         {
@@ -101,6 +103,7 @@ udp_init(struct udp_socket_t* udp)
     udp->has_client  = false;
     udp->cur_read    = 0;
     udp->buffer_size = 0;
+    udp->event_fd    = event_create();
 
     udp->fd = socket(AF_INET, SOCK_DGRAM, 0);
     if (udp->fd == -1)
@@ -153,6 +156,10 @@ udp_cleanup(struct udp_socket_t* udp)
     {
         close(udp->fd);
     }
+    if (udp->event_fd != -1)
+    {
+        close(udp->event_fd);
+    }
     free(udp);
     udp = NULL;
 }
@@ -207,6 +214,52 @@ udp_read_byte(struct source_t* source)
     return byte;
 }
 
+static size_t
+udp_read_bytes(struct source_t* source, uint8_t* buf, size_t max)
+{
+    ASSERT(source != NULL && "source is NULL!");
+    ASSERT(source->opaque != NULL && "source->opaque is NULL!");
+    struct udp_socket_t* udp = (struct udp_socket_t*)source->opaque;
+
+    if (!udp->initialized)
+    {
+        int rv = udp_init(udp);
+        if (rv != SUCC)
+        {
+            return 0;
+        }
+    }
+
+    size_t n = 0;
+    mtx_lock(&udp->lock);
+    if (udp->cur_read < udp->buffer_size)
+    {
+        n = (size_t)(udp->buffer_size - udp->cur_read);
+        n = n < max ? n : max;
+        memcpy(buf, &udp->buffer[udp->cur_read], n);
+        udp->cur_read += n;
+    }
+    if (udp->cur_read >= udp->buffer_size)
+    {
+        cnd_signal(&udp->buffer_empty);
+    }
+    if (n == 0)
+    {
+        event_clear(udp->event_fd);
+    }
+    mtx_unlock(&udp->lock);
+    return n;
+}
+
+static int
+udp_poll_fd(struct source_t* source)
+{
+    ASSERT(source != NULL && "source is NULL!");
+    ASSERT(source->opaque != NULL && "source->opaque is NULL!");
+    struct udp_socket_t* udp = (struct udp_socket_t*)source->opaque;
+    return udp->initialized ? udp->event_fd : -1;
+}
+
 static int
 udp_route_to(struct sink_t* sink, struct message_t* msg)
 {
@@ -229,9 +282,15 @@ udp_route_to(struct sink_t* sink, struct message_t* msg)
         return SEC_GATEWAY_NO_CLIENT;
     }
 
-    size_t  len = mavlink_msg_to_send_buffer(udp->output_buffer, &msg->msg);
-    ssize_t rv  = sendto(udp->fd, udp->output_buffer, len, MSG_DONTWAIT,
-                        &udp->clt_addr, udp->clt_addr_len);
+    struct message_wire_t wire;
+    message_wire(msg, &wire);
+    struct msghdr hdr = {
+        .msg_name    = &udp->clt_addr,
+        .msg_namelen = udp->clt_addr_len,
+        .msg_iov     = wire.iov,
+        .msg_iovlen  = wire.iovcnt,
+    };
+    ssize_t rv = sendmsg(udp->fd, &hdr, MSG_DONTWAIT);
     if (rv < 0)
     {
         perror("Failed to send message!");
@@ -264,11 +323,13 @@ hook_udp(struct pipeline_t* pipeline, int port, size_t source_id,
         free(udp);
         return SEC_GATEWAY_IO_FAULT;
     }
-    source->opaque    = udp;
-    source->has_more  = udp_has_more;
-    source->read_byte = udp_read_byte;
-    source->init      = (init_t)udp_init;
-    source->cleanup   = (cleanup_t)udp_cleanup;
+    source->opaque     = udp;
+    source->has_more   = udp_has_more;
+    source->read_byte  = udp_read_byte;
+    source->read_bytes = udp_read_bytes;
+    source->poll_fd    = udp_poll_fd;
+    source->init       = (init_t)udp_init;
+    source->cleanup    = (cleanup_t)udp_cleanup;
 
     struct sink_t* sink = sink_allocate(&pipeline->sinks, sink_type);
     if (sink == NULL)
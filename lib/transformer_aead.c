@@ -0,0 +1,426 @@
+#include "transformer_aead.h"
+#include "signing.h"
+
+#define AEAD_AD_LEN    5 /* sysid, compid, msgid */
+#define AEAD_FRESHNESS (SIGNING_WINDOW_US / 10) /* in counter ticks */
+
+static struct aead_link_t aead_sources[MAX_SOURCES];
+static struct aead_link_t aead_sinks[MAX_SINKS];
+
+struct aead_link_t*
+aead_link(enum port_type_t type, size_t id)
+{
+    if (type == PORT_TYPE_SOURCE && id < MAX_SOURCES)
+    {
+        return &aead_sources[id];
+    }
+    if (type == PORT_TYPE_SINK && id < MAX_SINKS)
+    {
+        return &aead_sinks[id];
+    }
+    return NULL;
+}
+
+/**
+ * Install key as key_id of a link, from any thread. The slot of key_id
+ * must not hold the key a sink is sending with.
+ */
+int
+aead_set_key(enum port_type_t type, size_t id, uint8_t key_id,
+    const uint8_t key[AEAD_KEY_LEN])
+{
+    struct aead_link_t* link = aead_link(type, id);
+    if (link == NULL || key_id == 0)
+    {
+        return SEC_GATEWAY_INVALID_PARAM;
+    }
+
+    struct aead_key_t* slot = &link->keys[key_id % AEAD_KEY_SLOTS];
+    uint8_t active = __atomic_load_n(&link->active, __ATOMIC_ACQUIRE);
+    if (active != 0 && active != key_id
+        && active % AEAD_KEY_SLOTS == key_id % AEAD_KEY_SLOTS)
+    {
+        return SEC_GATEWAY_INVALID_STATE;
+    }
+
+    /* a seqlock: readers retry, or give up, while seq is odd */
+    uint32_t seq = slot->seq;
+    __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->id = key_id;
+    memcpy(slot->key, key, AEAD_KEY_LEN);
+    __atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+    return SUCC;
+}
+
+/**
+ * Send with key_id on a sink from now on, from any thread.
+ */
+int
+aead_use_key(enum sink_type_t type, uint8_t key_id)
+{
+    struct aead_link_t* link = aead_link(PORT_TYPE_SINK, type);
+    if (link == NULL || key_id == 0
+        || link->keys[key_id % AEAD_KEY_SLOTS].id != key_id)
+    {
+        return SEC_GATEWAY_INVALID_PARAM;
+    }
+    __atomic_store_n(&link->active, key_id, __ATOMIC_RELEASE);
+    return SUCC;
+}
+
+/* a consistent copy of key key_id, and the seq it was read at */
+static bool
+aead_key_read(const struct aead_key_t* slot, uint8_t key_id,
+    uint8_t key[AEAD_KEY_LEN], uint32_t* seq)
+{
+    uint32_t before = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    if (before % 2 != 0 || slot->id != key_id)
+    {
+        return false;
+    }
+    memcpy(key, slot->key, AEAD_KEY_LEN);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    *seq = before;
+    return __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == before;
+}
+
+static void
+aead_ad(const mavlink_message_t* m, uint8_t ad[AEAD_AD_LEN])
+{
+    ad[0] = m->sysid;
+    ad[1] = m->compid;
+    ad[2] = (uint8_t)m->msgid;
+    ad[3] = (uint8_t)(m->msgid >> 8);
+    ad[4] = (uint8_t)(m->msgid >> 16);
+}
+
+static void
+aead_nonce(uint64_t counter, uint8_t nonce[CHACHA20POLY1305_NONCE_LEN])
+{
+    memset(nonce, 0, CHACHA20POLY1305_NONCE_LEN);
+    for (size_t i = 0; i < AEAD_COUNTER_LEN; i++)
+    {
+        nonce[i] = (uint8_t)(counter >> (8 * i));
+    }
+}
+
+/**
+ * Batch sink transform: encrypt the payload of every message with the
+ * active key of its sink, the frames side by side.
+ */
+void
+aead_encode_batch(struct message_t* const* msgs, size_t n, int* rv)
+{
+    struct chacha20poly1305_job_t jobs[PIPELINE_BATCH];
+    uint8_t                       keys[PIPELINE_BATCH][AEAD_KEY_LEN];
+    uint8_t                       ads[PIPELINE_BATCH][AEAD_AD_LEN];
+    uint8_t  nonces[PIPELINE_BATCH][CHACHA20POLY1305_NONCE_LEN];
+    size_t   sealed[PIPELINE_BATCH], jobs_n = 0;
+    uint32_t seq;
+
+    ASSERT(n <= PIPELINE_BATCH && "batch is too long");
+    for (size_t k = 0; k < n; k++)
+    {
+        struct message_t*   msg  = msgs[k];
+        struct aead_link_t* link = &aead_sinks[msg->sink];
+        mavlink_message_t*  m    = &msg->msg;
+        uint8_t*            p    = (uint8_t*)_MAV_PAYLOAD_NON_CONST(m);
+        uint8_t             len  = m->len;
+
+        uint8_t key_id = __atomic_load_n(&link->active, __ATOMIC_ACQUIRE);
+        if (key_id == 0
+            || !aead_key_read(&link->keys[key_id % AEAD_KEY_SLOTS], key_id,
+                keys[jobs_n], &seq))
+        {
+            WARN("sink %lu: no key, frame dropped\n", msg->sink);
+            rv[k] = SEC_GATEWAY_INVALID_STATE;
+            continue;
+        }
+        if (len > AEAD_MAX_PLAINTEXT)
+        {
+            WARN("sink %lu: message %u too long to encrypt, dropped\n",
+                msg->sink, m->msgid);
+            rv[k] = SEC_GATEWAY_INVALID_PARAM;
+            continue;
+        }
+
+        /* never twice the same nonce, whatever the clock does */
+        uint64_t counter = signing_wall_clock();
+        if (counter <= link->counter)
+        {
+            counter = link->counter + 1;
+        }
+        link->counter = counter;
+
+        aead_ad(m, ads[jobs_n]);
+        aead_nonce(counter, nonces[jobs_n]);
+        memcpy(&p[len], nonces[jobs_n], AEAD_COUNTER_LEN);
+        p[len + AEAD_OVERHEAD - 1] = key_id;
+        jobs[jobs_n] = (struct chacha20poly1305_job_t) {
+            .key    = keys[jobs_n],
+            .nonce  = nonces[jobs_n],
+            .ad     = ads[jobs_n],
+            .ad_len = AEAD_AD_LEN,
+            .buf    = p,
+            .len    = len,
+            .tag    = &p[len + AEAD_COUNTER_LEN],
+        };
+        sealed[jobs_n++] = k;
+        rv[k]            = SUCC;
+    }
+
+    chacha20poly1305_seal_batch(jobs, jobs_n);
+    for (size_t j = 0; j < jobs_n; j++)
+    {
+        struct message_t*  msg = msgs[sealed[j]];
+        mavlink_message_t* m   = &msg->msg;
+        uint8_t            len = m->len + AEAD_OVERHEAD;
+
+        aead_sinks[msg->sink].sealed++;
+        /* the key id ends the payload, so there is nothing to trim */
+        message_finalize(
+            msg, m->sysid, m->compid, len, len, mavlink_get_crc_extra(m));
+    }
+}
+
+/**
+ * Sink transform: encrypt the payload of msg with the active key of its
+ * sink.
+ */
+int
+aead_encode(struct message_t* msg)
+{
+    int rv;
+    aead_encode_batch(&msg, 1, &rv);
+    return rv;
+}
+
+/* false if counter is a replay, or too old to tell */
+static bool
+aead_window_check(const struct aead_window_t* window, uint64_t counter)
+{
+    if (window->seen == 0)
+    {
+        /* counters are never behind the clock of the sender */
+        uint64_t now = signing_wall_clock();
+        return now == 0 || counter + AEAD_FRESHNESS >= now;
+    }
+    if (counter > window->top)
+    {
+        return true;
+    }
+    uint64_t age = window->top - counter;
+    return age < AEAD_REPLAY_WINDOW && !(window->seen & (1ull << age));
+}
+
+static void
+aead_window_update(struct aead_window_t* window, uint64_t counter)
+{
+    if (window->seen == 0)
+    {
+        window->top  = counter;
+        window->seen = 1;
+    }
+    else if (counter > window->top)
+    {
+        uint64_t shift = counter - window->top;
+        window->seen   = shift < AEAD_REPLAY_WINDOW
+              ? window->seen << shift | 1
+              : 1;
+        window->top    = counter;
+    }
+    else
+    {
+        window->seen |= 1ull << (window->top - counter);
+    }
+}
+
+/**
+ * Batch source transform: check and decrypt the payload of every message
+ * with the key it names, and drop those that fail or are replays.
+ */
+void
+aead_decode_batch(struct message_t* const* msgs, size_t n, int* rv)
+{
+    struct chacha20poly1305_job_t jobs[PIPELINE_BATCH];
+    uint8_t                       keys[PIPELINE_BATCH][AEAD_KEY_LEN];
+    uint8_t                       ads[PIPELINE_BATCH][AEAD_AD_LEN];
+    uint8_t  nonces[PIPELINE_BATCH][CHACHA20POLY1305_NONCE_LEN];
+    uint64_t counters[PIPELINE_BATCH];
+    size_t   opened[PIPELINE_BATCH], jobs_n = 0;
+    uint32_t seq;
+
+    ASSERT(n <= PIPELINE_BATCH && "batch is too long");
+    for (size_t k = 0; k < n; k++)
+    {
+        struct message_t*   msg  = msgs[k];
+        struct aead_link_t* link = &aead_sources[msg->source];
+        mavlink_message_t*  m    = &msg->msg;
+        uint8_t*            p    = (uint8_t*)_MAV_PAYLOAD_NON_CONST(m);
+
+        rv[k] = SEC_GATEWAY_INVALID_PARAM;
+        if (m->len < AEAD_OVERHEAD)
+        {
+            WARN("source %lu: message %u not encrypted, dropped\n",
+                msg->source, m->msgid);
+            link->rejected++;
+            continue;
+        }
+        uint8_t len    = m->len - AEAD_OVERHEAD;
+        uint8_t key_id = p[m->len - 1];
+        size_t  slot   = key_id % AEAD_KEY_SLOTS;
+        if (key_id == 0
+            || !aead_key_read(&link->keys[slot], key_id, keys[jobs_n], &seq))
+        {
+            WARN("source %lu: no key %u, frame dropped\n", msg->source,
+                key_id);
+            link->rejected++;
+            rv[k] = SEC_GATEWAY_INVALID_STATE;
+            continue;
+        }
+
+        /* a new key in the slot starts a new window */
+        struct aead_window_t* window = &link->windows[slot];
+        if (window->seq != seq)
+        {
+            memset(window, 0, sizeof(*window));
+            window->seq = seq;
+        }
+
+        uint64_t counter = 0;
+        for (size_t i = AEAD_COUNTER_LEN; i > 0; i--)
+        {
+            counter = counter << 8 | p[len + i - 1];
+        }
+        /* replays across batches are not worth opening */
+        if (!aead_window_check(window, counter))
+        {
+            WARN("source %lu: message %u replayed, dropped\n", msg->source,
+                m->msgid);
+            link->rejected++;
+            continue;
+        }
+
+        aead_ad(m, ads[jobs_n]);
+        aead_nonce(counter, nonces[jobs_n]);
+        jobs[jobs_n] = (struct chacha20poly1305_job_t) {
+            .key    = keys[jobs_n],
+            .nonce  = nonces[jobs_n],
+            .ad     = ads[jobs_n],
+            .ad_len = AEAD_AD_LEN,
+            .buf    = p,
+            .len    = len,
+            .tag    = &p[len + AEAD_COUNTER_LEN],
+        };
+        counters[jobs_n] = counter;
+        opened[jobs_n++] = k;
+    }
+
+    chacha20poly1305_open_batch(jobs, jobs_n);
+    for (size_t j = 0; j < jobs_n; j++)
+    {
+        struct message_t*   msg  = msgs[opened[j]];
+        struct aead_link_t* link = &aead_sources[msg->source];
+        mavlink_message_t*  m    = &msg->msg;
+        uint8_t*            p    = (uint8_t*)_MAV_PAYLOAD_NON_CONST(m);
+        uint8_t             len  = m->len - AEAD_OVERHEAD;
+        struct aead_window_t* window
+            = &link->windows[p[m->len - 1] % AEAD_KEY_SLOTS];
+
+        /* in order, which also catches replays within the batch */
+        if (!jobs[j].ok || !aead_window_check(window, counters[j]))
+        {
+            WARN("source %lu: message %u forged or replayed, dropped\n",
+                msg->source, m->msgid);
+            link->rejected++;
+            continue;
+        }
+        aead_window_update(window, counters[j]);
+        link->opened++;
+
+        /* the trailer is not an extension field */
+        memset(&p[len], 0, AEAD_OVERHEAD);
+        message_finalize(
+            msg, m->sysid, m->compid, len, len, mavlink_get_crc_extra(m));
+        rv[opened[j]] = SUCC;
+    }
+}
+
+/**
+ * Source transform: check and decrypt the payload of msg with the key it
+ * names, and drop it if it fails or is a replay.
+ */
+int
+aead_decode(struct message_t* msg)
+{
+    int rv;
+    aead_decode_batch(&msg, 1, &rv);
+    return rv;
+}
+
+#ifdef _STD_LIBC_
+int
+aead_load_keys(const char* path, size_t source_id, enum sink_type_t type)
+{
+    ASSERT(path != NULL && "path is NULL");
+
+    FILE* f = fopen(path, "r");
+    if (f == NULL)
+    {
+        WARN("cannot open key file %s\n", path);
+        return SEC_GATEWAY_IO_FAULT;
+    }
+
+    char    line[256];
+    size_t  lineno = 0, keys = 0;
+    uint8_t tx     = 0;
+    int     rv     = SUCC;
+    while (rv == SUCC && fgets(line, sizeof(line), f) != NULL)
+    {
+        lineno++;
+        char* comment = strchr(line, '#');
+        if (comment != NULL)
+        {
+            *comment = '\0';
+        }
+
+        char     dir[4];
+        unsigned key_id;
+        char     hex[2 * AEAD_KEY_LEN + 2];
+        char     extra;
+        int      n
+            = sscanf(line, "%3s %u %65s %c", dir, &key_id, hex, &extra);
+        if (n <= 0)
+        {
+            continue;
+        }
+
+        uint8_t key[AEAD_KEY_LEN];
+        bool    is_tx = strcmp(dir, "tx") == 0;
+        if (n != 3 || (!is_tx && strcmp(dir, "rx") != 0) || key_id == 0
+            || key_id > UINT8_MAX || !signing_parse_key(hex, key))
+        {
+            WARN("%s:%lu: expected rx or tx, a key id and %d hex digits\n",
+                path, lineno, 2 * AEAD_KEY_LEN);
+            rv = SEC_GATEWAY_INVALID_PARAM;
+            break;
+        }
+        rv = is_tx ? aead_set_key(PORT_TYPE_SINK, type, key_id, key)
+                   : aead_set_key(PORT_TYPE_SOURCE, source_id, key_id, key);
+        tx = is_tx ? (uint8_t)key_id : tx;
+        keys++;
+    }
+    fclose(f);
+
+    if (rv == SUCC && tx != 0)
+    {
+        rv = aead_use_key(type, tx);
+    }
+    if (rv == SUCC)
+    {
+        INFO("%lu link keys loaded from %s\n", keys, path);
+    }
+    return rv;
+}
+#endif
@@ -0,0 +1,95 @@
+#ifndef _TRANSFORMER_AEAD_H_
+#define _TRANSFORMER_AEAD_H_
+
+#include "chacha20poly1305.h"
+#include "secure_gateway.h"
+
+/*
+ * Authenticated encryption of the link to a peer that runs the same
+ * transform, in place of xor_encode() / xor_decode():
+ *
+ *     add_transformer(pipeline, PORT_TYPE_SINK, SINK_TYPE_VMC, aead_encode);
+ *     add_transformer(pipeline, PORT_TYPE_SOURCE, SOURCE_TYPE_VMC,
+ *         aead_decode);
+ *
+ * or aead_encode_batch() / aead_decode_batch() with add_batch_transformer(),
+ * which encrypt the frames of a batch side by side.
+ *
+ * aead_encode() seals the payload with ChaCha20-Poly1305 and appends
+ *
+ *     counter (6 bytes) | tag (16 bytes) | key id
+ *
+ * with sysid, compid and msgid authenticated along. The counter is the
+ * nonce: it starts at the wall clock in 10 us since 2015 (like MAVLink
+ * signing timestamps) and grows with every frame of the sink, so it does
+ * not repeat across restarts or keys; without a wall clock (baremetal), a
+ * key must not outlive a boot. Frames longer than AEAD_MAX_PLAINTEXT do not
+ * fit and are dropped.
+ *
+ * aead_decode() drops frames it cannot open, and frames whose counter it
+ * has seen or that fall behind a window of AEAD_REPLAY_WINDOW frames. The
+ * first frame under a key has to be less than a minute behind the wall
+ * clock, if there is one.
+ *
+ * Keys are installed per link and picked by a nonzero key id, kept in
+ * AEAD_KEY_SLOTS slots by key id modulo the number of slots. To rotate,
+ * install the next key on both ends, then aead_use_key() on the sending
+ * end; frames still in flight under the previous key open as long as its
+ * slot is not reused. Keys are published with atomic stores, so rotation
+ * never stalls the pipeline, from whatever thread one at a time. Each
+ * direction needs a key of its own.
+ */
+
+#define AEAD_KEY_LEN       CHACHA20POLY1305_KEY_LEN
+#define AEAD_COUNTER_LEN   6
+#define AEAD_OVERHEAD      (AEAD_COUNTER_LEN + CHACHA20POLY1305_TAG_LEN + 1)
+#define AEAD_MAX_PLAINTEXT (MAVLINK_MAX_PAYLOAD_LEN - AEAD_OVERHEAD)
+#define AEAD_KEY_SLOTS     4
+#define AEAD_REPLAY_WINDOW 64
+
+struct aead_key_t
+{
+    uint32_t seq; /* odd while the key is being written */
+    uint8_t  id;  /* 0 if empty */
+    uint8_t  key[AEAD_KEY_LEN];
+};
+
+/* replay state of a key slot, owned by the decoding side */
+struct aead_window_t
+{
+    uint32_t seq; /* of the key it belongs to */
+    uint64_t top; /* highest counter accepted */
+    uint64_t seen; /* bit i: top - i accepted */
+};
+
+struct aead_link_t
+{
+    struct aead_key_t    keys[AEAD_KEY_SLOTS];
+    uint8_t              active; /* key id aead_encode() uses */
+    uint64_t             counter;
+    struct aead_window_t windows[AEAD_KEY_SLOTS];
+
+    /* statistics */
+    size_t sealed;
+    size_t opened;
+    size_t rejected;
+};
+
+int  aead_encode(struct message_t* msg);
+int  aead_decode(struct message_t* msg);
+void aead_encode_batch(struct message_t* const* msgs, size_t n, int* rv);
+void aead_decode_batch(struct message_t* const* msgs, size_t n, int* rv);
+int  aead_set_key(enum port_type_t type, size_t id, uint8_t key_id,
+     const uint8_t key[AEAD_KEY_LEN]);
+int  aead_use_key(enum sink_type_t type, uint8_t key_id);
+struct aead_link_t* aead_link(enum port_type_t type, size_t id);
+
+#ifdef _STD_LIBC_
+/*
+ * one key per line: "rx" or "tx", key id and 64 hex digits; rx keys go to
+ * the source, tx keys to the sink, which uses the last one
+ */
+int aead_load_keys(const char* path, size_t source_id, enum sink_type_t type);
+#endif
+
+#endif /* _TRANSFORMER_AEAD_H_ */
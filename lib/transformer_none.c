@@ -1,11 +1,13 @@
 #include <secure_gateway.h>
 
-void transformer_encode(struct message_t* msg __attribute__((unused)))
+int transformer_encode(struct message_t* msg __attribute__((unused)))
 {
     /* do nothing */
+    return SUCC;
 }
 
-void transformer_decode(struct message_t* msg __attribute__((unused)))
+int transformer_decode(struct message_t* msg __attribute__((unused)))
 {
     /* do nothing */
+    return SUCC;
 }
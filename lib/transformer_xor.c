@@ -1,9 +1,12 @@
 #include <secure_gateway.h>
+#include <crc_x25.h>
 #include <string.h>
 
+#define XOR_KEY 'X'
+
 static void xor_crypto(char* message, uint8_t len)
 {
-    char key = 'X';
+    char key = XOR_KEY;
 
     for (int i = 0; i < len; i++)
     {
@@ -11,22 +14,50 @@ static void xor_crypto(char* message, uint8_t len)
     }
 }
 
-void xor_encode(struct message_t* msg)
+/*
+ * The key is the same for every byte, so the checksum changes by an amount
+ * that only depends on the length. Computed once per length, bit 16 set
+ * once it is.
+ */
+static uint32_t xor_crc_deltas[MAVLINK_MAX_PAYLOAD_LEN + 1];
+
+static uint16_t xor_crc_delta(uint8_t len)
 {
-    int len = msg->msg.len;
+    uint32_t delta = __atomic_load_n(&xor_crc_deltas[len], __ATOMIC_RELAXED);
 
-    xor_crypto((char *) msg->msg.payload64, len);
-    mavlink_finalize_message_buffer(&msg->msg, msg->msg.sysid,
-        msg->msg.compid, &msg->status, len, len,
-        mavlink_get_crc_extra(&msg->msg));
+    if (delta == 0)
+    {
+        uint8_t key[MAVLINK_MAX_PAYLOAD_LEN];
+        memset(key, XOR_KEY, len);
+        /* crc_extra follows the payload */
+        delta = crc_x25_delta(key, len, 1) | 0x10000;
+        __atomic_store_n(&xor_crc_deltas[len], delta, __ATOMIC_RELAXED);
+    }
+    return (uint16_t)delta;
 }
 
-void xor_decode(struct message_t* msg)
+/* the header, and the sequence number, are left as they are */
+static void xor_transform(struct message_t* msg)
 {
     int len = msg->msg.len;
 
     xor_crypto((char *) msg->msg.payload64, len);
-    mavlink_finalize_message_buffer(&msg->msg, msg->msg.sysid,
-        msg->msg.compid, &msg->status, len, len,
-        mavlink_get_crc_extra(&msg->msg));
+    if (!message_patch(msg, xor_crc_delta(len)))
+    {
+        msg->status.current_tx_seq = msg->msg.seq;
+        message_finalize(msg, msg->msg.sysid, msg->msg.compid, len, len,
+            mavlink_get_crc_extra(&msg->msg));
+    }
+}
+
+int xor_encode(struct message_t* msg)
+{
+    xor_transform(msg);
+    return SUCC;
+}
+
+int xor_decode(struct message_t* msg)
+{
+    xor_transform(msg);
+    return SUCC;
 }
@@ -1,4 +1,21 @@
 #include <secure_gateway.h>
+#include <policer.h>
+#ifdef _STD_LIBC_
+#include <geofence.h>
+#include <mission_tracker.h>
+#include <policy_rules.h>
+#include <signing.h>
+#include <unistd.h>
+#ifdef USE_AEAD
+#include <transformer_aead.h>
+#endif
+
+static struct geofence_t         geofence;
+static struct mission_tracker_t mission_tracker;
+static struct signing_t          signing;
+#endif
+static struct policer_t policer;
+
 /**
  * Subsystem
  */
@@ -7,10 +24,89 @@ mavlink_system_t mavlink_system = {
     1, // Component ID
 };
 
-int main()
+int main(int argc, char** argv)
 {
     pipeline_init(&secure_gateway_pipeline);
 #ifdef _STD_LIBC_
+    /*
+     * -r rules: replace the built-in policies, -f fence: enforce it,
+     * -k keys: require signed frames from the ground station,
+     * -e keys: encrypt the VMC link (USE_AEAD),
+     * -c: stream telemetry to the ground station by cut-through
+     */
+    const char* rules_path     = NULL;
+    const char* fence_path     = NULL;
+    const char* keys_path      = NULL;
+    const char* link_keys_path = NULL;
+    bool        cut_through    = false;
+    int         opt;
+    while ((opt = getopt(argc, argv, "r:f:k:e:c")) != -1)
+    {
+        switch (opt)
+        {
+        case 'r': rules_path = optarg; break;
+        case 'f': fence_path = optarg; break;
+        case 'k': keys_path = optarg; break;
+        case 'e': link_keys_path = optarg; break;
+        case 'c': cut_through = true; break;
+        default:
+            fprintf(stderr,
+                "usage: %s [-r rules] [-f fence] [-k keys] [-e keys] [-c]\n",
+                argv[0]);
+            return 1;
+        }
+    }
+#ifndef USE_AEAD
+    if (link_keys_path != NULL)
+    {
+        WARN("-e needs a build with USE_AEAD\n");
+        return 1;
+    }
+#endif
+    /*
+     * keep floods of commands from the mission computers off the UART, police
+     * rules of the rules file replace these rates
+     */
+    policer_init(&policer);
+    for (size_t s = SOURCE_TYPE_LEGACY; s < MAX_SOURCES; s++)
+    {
+        policer_set_rate(&policer, s, MAVLINK_MSG_ID_COMMAND_LONG, 20, 20,
+            POLICER_DROP);
+        policer_set_rate(&policer, s, MAVLINK_MSG_ID_COMMAND_INT, 20, 20,
+            POLICER_DROP);
+        policer_set_rate(&policer, s, MAVLINK_MSG_ID_PARAM_SET, 50, 100,
+            POLICER_DROP);
+    }
+    secure_gateway_pipeline.policer = &policer;
+
+    if (rules_path != NULL
+        && policy_rules_load(&secure_gateway_pipeline, rules_path) != SUCC)
+    {
+        return 1;
+    }
+    if (fence_path != NULL)
+    {
+        if (geofence_load(&geofence, fence_path) != SUCC)
+        {
+            return 1;
+        }
+        if (security_policy_geofence(&secure_gateway_pipeline, &geofence)
+            != SUCC)
+        {
+            return 1;
+        }
+    }
+    mission_tracker_init(&mission_tracker, 0);
+    if (security_policy_mission(&secure_gateway_pipeline, &mission_tracker)
+        != SUCC)
+    {
+        return 1;
+    }
+    signing_init(&signing);
+    if (keys_path != NULL && signing_load_keys(&signing, keys_path) != SUCC)
+    {
+        return 1;
+    }
 
     hook_tcp(&secure_gateway_pipeline, 12001, SOURCE_TYPE_LEGACY, SINK_TYPE_LEGACY);
 //    hook_udp(&secure_gateway_pipeline, 12002, SOURCE_TYPE_LEGACY, SINK_TYPE_LEGACY);
@@ -23,6 +119,59 @@ int main()
 #ifdef USE_XOR
     add_transformer(&secure_gateway_pipeline, PORT_TYPE_SOURCE, SOURCE_TYPE_VMC, xor_decode);
     add_transformer(&secure_gateway_pipeline, PORT_TYPE_SINK, SINK_TYPE_VMC, xor_encode);
+#elif defined(USE_AEAD) && defined(_STD_LIBC_)
+    if (link_keys_path == NULL
+        || aead_load_keys(link_keys_path, SOURCE_TYPE_VMC, SINK_TYPE_VMC)
+            != SUCC)
+    {
+        WARN("the VMC link is encrypted, it needs keys (-e)\n");
+        return 1;
+    }
+    add_batch_transformer(&secure_gateway_pipeline, PORT_TYPE_SOURCE,
+        SOURCE_TYPE_VMC, aead_decode_batch);
+    add_batch_transformer(&secure_gateway_pipeline, PORT_TYPE_SINK,
+        SINK_TYPE_VMC, aead_encode_batch);
+#endif
+
+    /* the telemetry radio corrupts frames, recover the ones inside them */
+    source_set_resync(&secure_gateway_pipeline, SOURCE_TYPE_VMC, true);
+
+#ifdef _STD_LIBC_
+    secure_gateway_pipeline.mode = PIPELINE_MODE_EVENT;
+    if (cut_through)
+    {
+        /*
+         * the telemetry skips the pipeline and the egress queue, a ground
+         * station that falls behind loses frames instead of stalling it
+         */
+        if (pipeline_cut_through(&secure_gateway_pipeline, SOURCE_TYPE_VMC,
+                SINK_TYPE_LEGACY)
+            != SUCC)
+        {
+            WARN("no cut-through from the autopilot to the ground station\n");
+            return 1;
+        }
+    }
+    else
+    {
+        /* a stalled ground station must not hold up the autopilot link */
+        sink_set_egress(&secure_gateway_pipeline, SINK_TYPE_LEGACY, 256,
+            SINK_OVERFLOW_DROP_OLDEST);
+    }
+    sink_set_egress(&secure_gateway_pipeline, SINK_TYPE_VMC, 256,
+        SINK_OVERFLOW_BLOCK);
+    /* the autopilot checks the frames of link 0 with the same keys */
+    if (keys_path != NULL)
+    {
+        source_set_signing(
+            &secure_gateway_pipeline, SOURCE_TYPE_LEGACY, &signing);
+        if (sink_set_signing(
+                &secure_gateway_pipeline, SINK_TYPE_VMC, &signing, 0)
+            != SUCC)
+        {
+            WARN("no key for link 0, frames to the autopilot go unsigned\n");
+        }
+    }
 #endif
 
     pipeline_connect(&secure_gateway_pipeline);
@@ -0,0 +1,273 @@
+#include "bench.h"
+#include <transformer_aead.h>
+
+/*
+ * Checks ChaCha20-Poly1305 against RFC 8439 (2.8.2) and the VMC link
+ * transforms against tampering, replays, key rotation and frames too long
+ * to encrypt, then reports the encode and decode throughput for typical
+ * telemetry payload sizes, a frame at a time and in batches.
+ */
+
+#define BENCH_FRAMES 4096
+#define BENCH_ROUNDS 50
+
+static const char* rfc_plaintext
+    = "Ladies and Gentlemen of the class of '99: If I could offer you only "
+      "one tip for the future, sunscreen would be it.";
+static const uint8_t rfc_ciphertext[] = {
+    0xd3, 0x1a, 0x8d, 0x34, 0x64, 0x8e, 0x60, 0xdb, 0x7b, 0x86, 0xaf, 0xbc,
+    0x53, 0xef, 0x7e, 0xc2, 0xa4, 0xad, 0xed, 0x51, 0x29, 0x6e, 0x08, 0xfe,
+    0xa9, 0xe2, 0xb5, 0xa7, 0x36, 0xee, 0x62, 0xd6, 0x3d, 0xbe, 0xa4, 0x5e,
+    0x8c, 0xa9, 0x67, 0x12, 0x82, 0xfa, 0xfb, 0x69, 0xda, 0x92, 0x72, 0x8b,
+    0x1a, 0x71, 0xde, 0x0a, 0x9e, 0x06, 0x0b, 0x29, 0x05, 0xd6, 0xa5, 0xb6,
+    0x7e, 0xcd, 0x3b, 0x36, 0x92, 0xdd, 0xbd, 0x7f, 0x2d, 0x77, 0x8b, 0x8c,
+    0x98, 0x03, 0xae, 0xe3, 0x28, 0x09, 0x1b, 0x58, 0xfa, 0xb3, 0x24, 0xe4,
+    0xfa, 0xd6, 0x75, 0x94, 0x55, 0x85, 0x80, 0x8b, 0x48, 0x31, 0xd7, 0xbc,
+    0x3f, 0xf4, 0xde, 0xf0, 0x8e, 0x4b, 0x7a, 0x9d, 0xe5, 0x76, 0xd2, 0x65,
+    0x86, 0xce, 0xc6, 0x4b, 0x61, 0x16,
+};
+static const uint8_t rfc_tag[] = {
+    0x1a, 0xe1, 0x0b, 0x59, 0x4f, 0x09, 0xe2, 0x6a,
+    0x7e, 0x90, 0x2e, 0xcb, 0xd0, 0x60, 0x06, 0x91,
+};
+
+static struct message_t frames[BENCH_FRAMES];
+
+static int
+check_rfc8439(void)
+{
+    uint8_t key[CHACHA20POLY1305_KEY_LEN];
+    uint8_t nonce[CHACHA20POLY1305_NONCE_LEN]
+        = { 0x07, 0, 0, 0, 0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47 };
+    uint8_t ad[] = { 0x50, 0x51, 0x52, 0x53, 0xc0, 0xc1, 0xc2, 0xc3, 0xc4,
+        0xc5, 0xc6, 0xc7 };
+    uint8_t buf[sizeof(rfc_ciphertext)];
+    uint8_t tag[CHACHA20POLY1305_TAG_LEN];
+
+    for (size_t i = 0; i < sizeof(key); i++)
+    {
+        key[i] = (uint8_t)(0x80 + i);
+    }
+    memcpy(buf, rfc_plaintext, sizeof(buf));
+    chacha20poly1305_seal(key, nonce, ad, sizeof(ad), buf, sizeof(buf), tag);
+    if (memcmp(buf, rfc_ciphertext, sizeof(buf)) != 0
+        || memcmp(tag, rfc_tag, sizeof(tag)) != 0)
+    {
+        printf("ChaCha20-Poly1305 does not match RFC 8439\n");
+        return 1;
+    }
+
+    tag[0] ^= 1;
+    if (chacha20poly1305_open(key, nonce, ad, sizeof(ad), buf, sizeof(buf),
+            tag))
+    {
+        printf("ChaCha20-Poly1305 accepted a forged tag\n");
+        return 1;
+    }
+    tag[0] ^= 1;
+    if (!chacha20poly1305_open(key, nonce, ad, sizeof(ad), buf, sizeof(buf),
+            tag)
+        || memcmp(buf, rfc_plaintext, sizeof(buf)) != 0)
+    {
+        printf("ChaCha20-Poly1305 does not open its own output\n");
+        return 1;
+    }
+    return 0;
+}
+
+/* a frame on the VMC link */
+static void
+generate(struct message_t* msg, uint8_t len)
+{
+    bench_frame(msg, MAVLINK_MSG_ID_HEARTBEAT, len, false);
+    msg->source = SOURCE_TYPE_VMC;
+    msg->sink   = SINK_TYPE_VMC;
+}
+
+static void
+set_keys(uint8_t key_id)
+{
+    uint8_t key[AEAD_KEY_LEN];
+    memset(key, key_id, sizeof(key));
+    aead_set_key(PORT_TYPE_SINK, SINK_TYPE_VMC, key_id, key);
+    aead_set_key(PORT_TYPE_SOURCE, SOURCE_TYPE_VMC, key_id, key);
+}
+
+static int
+check_link(void)
+{
+    struct message_t msg, copy, old;
+
+    set_keys(1);
+    if (aead_use_key(SINK_TYPE_VMC, 1) != SUCC)
+    {
+        return 1;
+    }
+
+    generate(&msg, 40);
+    copy = msg;
+    if (aead_encode(&copy) != SUCC || copy.msg.len != 40 + AEAD_OVERHEAD)
+    {
+        printf("encode failed\n");
+        return 1;
+    }
+    old = copy;
+    if (aead_decode(&copy) != SUCC || copy.msg.len != 40
+        || memcmp(copy.msg.payload64, msg.msg.payload64, 40) != 0
+        || copy.msg.checksum != msg.msg.checksum)
+    {
+        printf("decode does not restore the frame\n");
+        return 1;
+    }
+
+    /* replayed, tampered with, or moved to another message */
+    copy = old;
+    if (aead_decode(&copy) == SUCC)
+    {
+        printf("replay accepted\n");
+        return 1;
+    }
+    copy = msg;
+    aead_encode(&copy);
+    _MAV_PAYLOAD_NON_CONST(&copy.msg)[3] ^= 1;
+    if (aead_decode(&copy) == SUCC)
+    {
+        printf("tampered frame accepted\n");
+        return 1;
+    }
+    copy = msg;
+    aead_encode(&copy);
+    copy.msg.msgid = MAVLINK_MSG_ID_COMMAND_LONG;
+    if (aead_decode(&copy) == SUCC)
+    {
+        printf("frame of another message accepted\n");
+        return 1;
+    }
+
+    /* rotation: frames in flight under key 1 still open after key 2 */
+    copy = msg;
+    aead_encode(&copy);
+    set_keys(2);
+    aead_use_key(SINK_TYPE_VMC, 2);
+    old = msg;
+    aead_encode(&old);
+    if (aead_decode(&old) != SUCC || aead_decode(&copy) != SUCC
+        || old.msg.payload64[0] != msg.msg.payload64[0]
+        || aead_set_key(PORT_TYPE_SINK, SINK_TYPE_VMC, 6, (uint8_t[32]) { 0 })
+            == SUCC)
+    {
+        printf("key rotation failed\n");
+        return 1;
+    }
+
+    generate(&copy, AEAD_MAX_PLAINTEXT + 1);
+    if (aead_encode(&copy) == SUCC)
+    {
+        printf("frame too long encrypted\n");
+        return 1;
+    }
+
+    /* a batch: the replay within it and the oversize frame are dropped */
+    struct message_t* batch[4] = { &frames[0], &frames[1], &frames[2],
+        &frames[3] };
+    int               rv[4];
+    for (size_t i = 0; i < 3; i++)
+    {
+        generate(batch[i], (uint8_t)(10 * i + 5));
+    }
+    generate(batch[3], AEAD_MAX_PLAINTEXT + 1);
+    aead_encode_batch(batch, 4, rv);
+    if (rv[0] != SUCC || rv[1] != SUCC || rv[2] != SUCC || rv[3] == SUCC)
+    {
+        printf("batch encode failed\n");
+        return 1;
+    }
+    frames[3] = frames[1];
+    aead_decode_batch(batch, 4, rv);
+    if (rv[0] != SUCC || rv[1] != SUCC || rv[2] != SUCC || rv[3] == SUCC
+        || frames[2].msg.len != 25)
+    {
+        printf("batch decode failed\n");
+        return 1;
+    }
+    return 0;
+}
+
+static void
+encode(size_t batch)
+{
+    int rv[PIPELINE_BATCH];
+    for (size_t i = 0; i < BENCH_FRAMES; i += batch)
+    {
+        struct message_t* msgs[PIPELINE_BATCH];
+        for (size_t k = 0; k < batch; k++)
+        {
+            msgs[k] = &frames[i + k];
+        }
+        aead_encode_batch(msgs, batch, rv);
+    }
+}
+
+static void
+decode(size_t batch)
+{
+    int rv[PIPELINE_BATCH];
+    for (size_t i = 0; i < BENCH_FRAMES; i += batch)
+    {
+        struct message_t* msgs[PIPELINE_BATCH];
+        for (size_t k = 0; k < batch; k++)
+        {
+            msgs[k] = &frames[i + k];
+        }
+        aead_decode_batch(msgs, batch, rv);
+    }
+}
+
+static void
+bench(uint8_t len, size_t batch)
+{
+    struct aead_link_t* link = aead_link(PORT_TYPE_SOURCE, SOURCE_TYPE_VMC);
+    struct message_t    msg;
+    uint64_t            encoded = 0, decoded = 0;
+    size_t              opened = link->opened;
+
+    generate(&msg, len);
+    for (size_t r = 0; r < BENCH_ROUNDS; r++)
+    {
+        for (size_t i = 0; i < BENCH_FRAMES; i++)
+        {
+            memcpy(&frames[i], &msg, sizeof(msg));
+        }
+        uint64_t start = time_us();
+        encode(batch);
+        encoded += time_us() - start;
+
+        start = time_us();
+        decode(batch);
+        decoded += time_us() - start;
+    }
+
+    double n = BENCH_ROUNDS * BENCH_FRAMES;
+    printf("%3uB x%-2lu: encode %5.0f ns %8.0f msg/s, "
+           "decode %5.0f ns %8.0f msg/s%s\n",
+        len, batch, bench_ns(encoded, n), bench_rate(encoded, n),
+        bench_ns(decoded, n), bench_rate(decoded, n),
+        link->opened - opened == n ? "" : " (frames lost)");
+}
+
+int main()
+{
+    static const uint8_t sizes[] = { 9, 28, 64, 128, AEAD_MAX_PLAINTEXT };
+
+    srand(1);
+    if (check_rfc8439() != 0 || check_link() != 0)
+    {
+        return 1;
+    }
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        bench(sizes[i], 1);
+        bench(sizes[i], PIPELINE_BATCH);
+    }
+    return 0;
+}
@@ -0,0 +1,159 @@
+#include "bench.h"
+#include <crc_x25.h>
+
+/*
+ * Checks every X.25 CRC implementation against the checksum.h reference
+ * and reports its throughput for typical MAVLink frame sizes, then checks
+ * incremental checksum updates against message_finalize() and compares
+ * their cost.
+ */
+
+#define BENCH_BYTES  (64 * 1024 * 1024)
+#define BENCH_FRAMES (1024 * 1024)
+
+static uint8_t data[4096];
+
+static void
+rewrite(struct message_t* msg, size_t offset, const uint8_t* delta, size_t n)
+{
+    uint8_t* p = (uint8_t*)_MAV_PAYLOAD_NON_CONST(&msg->msg) + offset;
+    for (size_t i = 0; i < n; i++)
+    {
+        p[i] ^= delta[i];
+    }
+}
+
+/* rewrite n payload bytes from offset on, and patch the checksum */
+static bool
+patch(struct message_t* msg, size_t offset, const uint8_t* delta, size_t n)
+{
+    rewrite(msg, offset, delta, n);
+    return message_patch(msg, message_crc_delta(msg, offset, delta, n));
+}
+
+static int
+check_patch(void)
+{
+    struct message_t msg, ref;
+
+    for (size_t i = 0; i < 100000; i++)
+    {
+        uint8_t len    = (uint8_t)(1 + rand() % MAVLINK_MAX_PAYLOAD_LEN);
+        size_t  offset = (size_t)rand() % len;
+        size_t  n      = 1 + (size_t)rand() % (len - offset);
+        bench_frame(&msg, MAVLINK_MSG_ID_COMMAND_LONG, len, i % 4 == 0);
+        if (!patch(&msg, offset, &data[i % 1024], n))
+        {
+            continue; /* now ends in zeros */
+        }
+
+        ref                        = msg;
+        ref.status.current_tx_seq  = msg.msg.seq;
+        message_finalize(&ref, 1, 1, len, len, mavlink_get_crc_extra(&ref.msg));
+        if (ref.msg.len != msg.msg.len || ref.msg.checksum != msg.msg.checksum
+            || ref.msg.ck[0] != msg.msg.ck[0] || ref.msg.ck[1] != msg.msg.ck[1])
+        {
+            printf("patch: mismatch at len %u offset %zu n %zu\n", len, offset,
+                n);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void
+bench_patch(uint8_t len, size_t n)
+{
+    struct message_t msg;
+    uint64_t         finalized, patched;
+
+    bench_frame(&msg, MAVLINK_MSG_ID_COMMAND_LONG, len, false);
+    uint64_t start = time_us();
+    for (size_t i = 0; i < BENCH_FRAMES; i++)
+    {
+        rewrite(&msg, 0, data, n);
+        message_finalize(&msg, 1, 1, len, len, 152);
+    }
+    finalized = time_us() - start;
+
+    start = time_us();
+    for (size_t i = 0; i < BENCH_FRAMES; i++)
+    {
+        patch(&msg, 0, data, n);
+    }
+    patched = time_us() - start;
+
+    printf("%3uB frame, %3zuB changed: finalize %5.1f ns, patch %5.1f ns\n",
+        len, n, bench_ns(finalized, BENCH_FRAMES),
+        bench_ns(patched, BENCH_FRAMES));
+}
+
+int main()
+{
+    static const size_t sizes[] = { 9, 21, 64, 128, 280, 4096 };
+    size_t i, j, n;
+
+    crc_x25_init();
+    srand(1);
+    for (i = 0; i < sizeof(data); i++)
+    {
+        data[i] = (uint8_t)rand();
+    }
+
+    crc_x25_fn_t ref = crc_x25_get_impl(CRC_X25_IMPL_BYTEWISE);
+    for (int impl = 0; impl < MAX_CRC_X25_IMPLS; impl++)
+    {
+        crc_x25_fn_t fn = crc_x25_get_impl(impl);
+        if (fn == NULL)
+        {
+            printf("%-10s not supported\n", crc_x25_impl_name(impl));
+            continue;
+        }
+
+        for (n = 0; n <= 512; n++)
+        {
+            for (j = 0; j < 4; j++)
+            {
+                uint16_t seed = (uint16_t)rand();
+                if (fn(seed, &data[j], n) != ref(seed, &data[j], n))
+                {
+                    printf("%s: mismatch at len %zu offset %zu\n",
+                        crc_x25_impl_name(impl), n, j);
+                    return 1;
+                }
+            }
+        }
+
+        printf("%-10s", crc_x25_impl_name(impl));
+        for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+        {
+            size_t   rounds = BENCH_BYTES / sizes[i];
+            uint16_t crc    = X25_INIT_CRC;
+            uint64_t start  = time_us();
+            for (j = 0; j < rounds; j++)
+            {
+                crc = fn(crc, data, sizes[i]);
+            }
+            uint64_t elapsed = time_us() - start;
+            printf(" %4zuB: %7.1f MB/s", sizes[i],
+                (double)(rounds * sizes[i]) / (elapsed ? elapsed : 1));
+            if (crc == 0x1234)
+            {
+                printf("*"); /* keep the loop alive */
+            }
+        }
+        printf("\n");
+    }
+
+    printf("active: %s\n", crc_x25_impl_name(crc_x25_active_impl()));
+
+    if (check_patch() != 0)
+    {
+        return 1;
+    }
+    bench_patch(33, 4);
+    bench_patch(33, 33);
+    bench_patch(255, 4);
+    bench_patch(255, 255);
+    return 0;
+}
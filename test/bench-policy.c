@@ -0,0 +1,142 @@
+#include "bench.h"
+#include <policy_rules.h>
+#include <policer.h>
+
+/*
+ * Checks that the rules of policies.rules decide like the built-in policies
+ * of security_policy_init(), and compares the time both take to inspect a
+ * typical mix of messages.
+ *
+ * usage: bench-policy [rules file]
+ */
+
+static const char* default_rules
+    = "COMMAND_LONG.command == MAV_CMD_DO_FENCE_ENABLE && param1 == 0 "
+      "from legacy, enclave -> reject\n"
+      "PARAM_SET.param_id == \"FENCE_ENABLE\" && param_value == 0 "
+      "from legacy, enclave -> reject\n"
+      "MEMINFO from legacy, enclave -> drop\n";
+
+#define BENCH_MESSAGES 1024
+#define BENCH_ROUNDS   20000
+
+static struct pipeline_t builtin, compiled;
+static struct policer_t  policer; /* for police rules, not benchmarked */
+static struct message_t  messages[BENCH_MESSAGES];
+
+/* pipeline_inspect(), without the logging */
+static int
+inspect(const struct security_policy_mgmt_t* policies, struct message_t* msg)
+{
+    int      index = msg_index(msg->msg.msgid);
+    uint64_t applicable
+        = policies->table[msg->source]
+                         [index == MSG_INDEX_NONE ? POLICY_TABLE_UNKNOWN
+                                                  : (size_t)index];
+    message_view_invalidate(msg);
+    while (applicable != 0)
+    {
+        size_t i = __builtin_ctzll(applicable);
+        applicable &= applicable - 1;
+
+        const struct security_policy_t* policy = &policies->policies[i];
+        if (policy->match != NULL && !policy->match(policy, msg))
+        {
+            continue;
+        }
+        size_t attribute = 0;
+        if (!policy->check(policy, msg, &attribute))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void
+generate(struct message_t* msg)
+{
+    static const size_t sources[]
+        = { SOURCE_TYPE_VMC, SOURCE_TYPE_LEGACY, SOURCE_TYPE_ENCLAVE };
+    mavlink_message_t* m = &msg->msg;
+
+    memset(msg, 0, sizeof(*msg));
+    msg->source = sources[rand() % 3];
+    switch (rand() % 8)
+    {
+    case 0:
+    case 1:
+        mavlink_msg_command_long_pack(1, 1, m, 1, 1,
+            rand() % 2 ? MAV_CMD_DO_FENCE_ENABLE : MAV_CMD_NAV_WAYPOINT, 0,
+            (float)(rand() % 2), 0, 0, 0, 0, 0, 0);
+        break;
+    case 2:
+    {
+        /* ARMING_CHECK is protected beyond the rules */
+        static const char* params[]
+            = { "FENCE_ENABLE", "ARMING_CHECK", "WP_YAW_BEHAVIOR" };
+        mavlink_msg_param_set_pack(1, 1, m, 1, 1, params[rand() % 3],
+            (float)(rand() % 2), MAV_PARAM_TYPE_REAL32);
+        break;
+    }
+    case 3:
+        mavlink_msg_meminfo_pack(1, 1, m, 0, 1024, 1024);
+        break;
+    default:
+        mavlink_msg_heartbeat_pack(1, 1, m, MAV_TYPE_QUADROTOR,
+            MAV_AUTOPILOT_ARDUPILOTMEGA, 0, 0, MAV_STATE_ACTIVE);
+        break;
+    }
+}
+
+static double
+bench(const struct security_policy_mgmt_t* policies, size_t* rejected)
+{
+    uint64_t start = time_us();
+    *rejected      = 0;
+    for (size_t r = 0; r < BENCH_ROUNDS; r++)
+    {
+        for (size_t i = 0; i < BENCH_MESSAGES; i++)
+        {
+            *rejected += !inspect(policies, &messages[i]);
+        }
+    }
+    uint64_t elapsed = time_us() - start;
+    return bench_ns(elapsed, BENCH_ROUNDS * BENCH_MESSAGES);
+}
+
+int main(int argc, char** argv)
+{
+    size_t i, rejected_builtin, rejected_compiled;
+
+    pipeline_init(&builtin);
+    pipeline_init(&compiled);
+    policer_init(&policer);
+    compiled.policer = &policer;
+    int rv = argc > 1 ? policy_rules_load(&compiled, argv[1])
+                      : policy_rules_compile(&compiled, "default", default_rules);
+    if (rv != SUCC)
+    {
+        return 1;
+    }
+
+    srand(1);
+    for (i = 0; i < BENCH_MESSAGES; i++)
+    {
+        generate(&messages[i]);
+        if (inspect(&builtin.policies, &messages[i])
+            != inspect(&compiled.policies, &messages[i]))
+        {
+            printf("message %zu (msgid %u, source %zu): verdicts differ\n", i,
+                messages[i].msg.msgid, messages[i].source);
+            return 1;
+        }
+    }
+
+    double ns_builtin  = bench(&builtin.policies, &rejected_builtin);
+    double ns_compiled = bench(&compiled.policies, &rejected_compiled);
+    printf("built-in %6.1f ns/msg, rules %6.1f ns/msg (%zu of %d rejected)\n",
+        ns_builtin, ns_compiled, rejected_builtin / BENCH_ROUNDS,
+        BENCH_MESSAGES);
+    return rejected_builtin != rejected_compiled;
+}
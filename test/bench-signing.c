@@ -0,0 +1,236 @@
+#include "bench.h"
+#include <sha256.h>
+#include <signing.h>
+
+/*
+ * Checks every SHA-256 implementation against the FIPS 180-4 examples and
+ * the signing round trip (tampered, replayed, unknown key), then compares
+ * the messages per second a legacy -> vmc pipeline forwards with signing
+ * off, and with the legacy source verifying and the vmc sink signing.
+ */
+
+#define BENCH_FRAMES 1024
+#define BENCH_ROUNDS 200
+#define LINK_ID      7
+
+static const struct
+{
+    const char* input;
+    const char* digest;
+} vectors[] = {
+    { "", "e3b0c44298fc1c149afbf4c8996fb924"
+          "27ae41e4649b934ca495991b7852b855" },
+    { "abc", "ba7816bf8f01cfea414140de5dae2223"
+             "b00361a396177a9cb410ff61f20015ad" },
+    { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+        "248d6a61d20638b8e5c026930c3e6039"
+        "a33ce45964ff2167f6ecedd419db06c1" },
+};
+
+static const uint8_t secret[SIGNING_KEY_LEN]
+    = "bench-signing secret 0123456789";
+
+static struct pipeline_t pipeline;
+static struct signing_t  gcs, gateway;
+static uint8_t           input[BENCH_FRAMES * MAVLINK_MAX_PACKET_LEN];
+static size_t            input_len, input_pos;
+static size_t            routed;
+
+static size_t
+bench_read(struct source_t* src, uint8_t* buf, size_t max)
+{
+    size_t n = input_len - input_pos;
+    n        = n < max ? n : max;
+    memcpy(buf, &input[input_pos], n);
+    input_pos += n;
+    return n;
+}
+
+static int
+bench_route(struct sink_t* sink, struct message_t* msg)
+{
+    routed++;
+    return SUCC;
+}
+
+static void
+generate(struct message_t* msg, size_t i)
+{
+    mavlink_message_t* m = &msg->msg;
+
+    memset(msg, 0, sizeof(*msg));
+    switch (i % 4)
+    {
+    case 0:
+        mavlink_msg_command_long_pack(255, 190, m, 1, 1,
+            MAV_CMD_NAV_WAYPOINT, 0, 0, 0, 0, 0, 0, 0, 0);
+        break;
+    case 1:
+        mavlink_msg_param_set_pack(255, 190, m, 1, 1, "WP_YAW_BEHAVIOR", 1,
+            MAV_PARAM_TYPE_REAL32);
+        break;
+    default:
+        mavlink_msg_heartbeat_pack(255, 190, m, MAV_TYPE_GCS,
+            MAV_AUTOPILOT_INVALID, 0, 0, MAV_STATE_ACTIVE);
+        break;
+    }
+}
+
+static int
+check_sha256(void)
+{
+    for (int impl = 0; impl < MAX_SHA256_IMPLS; impl++)
+    {
+        if (sha256_get_impl(impl) == NULL)
+        {
+            printf("%-10s not supported\n", sha256_impl_name(impl));
+            continue;
+        }
+        sha256_set_impl(impl);
+        for (size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++)
+        {
+            struct sha256_t ctx;
+            uint8_t         digest[SHA256_DIGEST_LEN];
+            char            hex[2 * SHA256_DIGEST_LEN + 1];
+
+            sha256_init(&ctx);
+            sha256_update(&ctx, vectors[i].input, strlen(vectors[i].input));
+            sha256_final(&ctx, digest);
+            for (size_t j = 0; j < SHA256_DIGEST_LEN; j++)
+            {
+                snprintf(&hex[2 * j], 3, "%02x", digest[j]);
+            }
+            if (strcmp(hex, vectors[i].digest) != 0)
+            {
+                printf("%s: mismatch on \"%s\"\n", sha256_impl_name(impl),
+                    vectors[i].input);
+                return 1;
+            }
+        }
+    }
+    sha256_setup();
+    return 0;
+}
+
+static int
+expect(struct message_t* msg, enum signing_result_t expected)
+{
+    enum signing_result_t result = signing_verify(&gateway, msg, time_us());
+    if (result != expected)
+    {
+        printf("expected %s, got %s\n", signing_result_name(expected),
+            signing_result_name(result));
+        return 1;
+    }
+    return 0;
+}
+
+static int
+check_signing(void)
+{
+    struct message_t msg, copy;
+
+    signing_init(&gcs);
+    signing_init(&gateway);
+    signing_set_key(&gcs, LINK_ID, secret);
+    signing_set_key(&gateway, LINK_ID, secret);
+
+    generate(&msg, 0);
+    if (expect(&msg, SIGNING_UNSIGNED) != 0
+        || signing_sign(&gcs, &msg, LINK_ID + 1, time_us()) == SUCC
+        || signing_sign(&gcs, &msg, LINK_ID, time_us()) != SUCC)
+    {
+        return 1;
+    }
+
+    copy = msg;
+    _MAV_PAYLOAD_NON_CONST(&copy.msg)[0] ^= 1;
+    if (expect(&copy, SIGNING_BAD_SIGNATURE) != 0
+        || expect(&msg, SIGNING_OK) != 0 || expect(&msg, SIGNING_REPLAYED) != 0)
+    {
+        return 1;
+    }
+
+    signing_init(&gateway);
+    if (expect(&msg, SIGNING_UNKNOWN_KEY) != 0)
+    {
+        return 1;
+    }
+    signing_set_key(&gateway, LINK_ID, secret);
+    gateway.timestamp += 2 * SIGNING_WINDOW_US / 10;
+    return expect(&msg, SIGNING_EXPIRED);
+}
+
+static double
+bench(bool signing)
+{
+    struct signing_t* store = signing ? &gateway : NULL;
+    source_set_signing(&pipeline, SOURCE_TYPE_LEGACY, store);
+    sink_set_signing(&pipeline, SINK_TYPE_VMC, store, LINK_ID);
+    routed = 0;
+
+    uint64_t start = time_us();
+    for (size_t r = 0; r < BENCH_ROUNDS; r++)
+    {
+        /* the same frames again are replays, forget the streams */
+        signing_init(&gateway);
+        signing_set_key(&gateway, LINK_ID, secret);
+        input_pos = 0;
+        pipeline_spin(&pipeline);
+    }
+    uint64_t elapsed = time_us() - start;
+
+    if (routed != BENCH_ROUNDS * BENCH_FRAMES)
+    {
+        printf("%zu of %d frames routed\n", routed / BENCH_ROUNDS,
+            BENCH_FRAMES);
+        return 0;
+    }
+    return bench_rate(elapsed, (double)routed);
+}
+
+int main()
+{
+    struct message_t msg;
+
+    pipeline_init(&pipeline);
+    if (check_sha256() != 0 || check_signing() != 0)
+    {
+        return 1;
+    }
+
+    signing_init(&gcs);
+    signing_set_key(&gcs, LINK_ID, secret);
+    for (size_t i = 0; i < BENCH_FRAMES; i++)
+    {
+        generate(&msg, i);
+        signing_sign(&gcs, &msg, LINK_ID, time_us());
+        input_len += mavlink_msg_to_send_buffer(&input[input_len], &msg.msg);
+    }
+
+    struct source_t* src = source_allocate(&pipeline.sources,
+        SOURCE_TYPE_LEGACY);
+    src->read_bytes      = bench_read;
+    struct sink_t* sink  = sink_allocate(&pipeline.sinks, SINK_TYPE_VMC);
+    sink->route          = bench_route;
+    pipeline_connect(&pipeline);
+
+    double off = bench(false);
+    printf("signing off %10.0f msg/s\n", off);
+    for (int impl = 0; impl < MAX_SHA256_IMPLS; impl++)
+    {
+        if (sha256_get_impl(impl) == NULL)
+        {
+            continue;
+        }
+        sha256_set_impl(impl);
+        double on = bench(true);
+        printf("%-11s %10.0f msg/s (%.0f%%)\n", sha256_impl_name(impl), on,
+            off > 0 ? 100.0 * on / off : 0);
+    }
+    sha256_setup();
+    printf("active: %s\n", sha256_impl_name(sha256_active_impl()));
+
+    pipeline_disconnect(&pipeline);
+    return 0;
+}
@@ -0,0 +1,45 @@
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include <secure_gateway.h>
+
+/*
+ * Fixtures of the bench-* programs, one translation unit each.
+ */
+
+/**
+ * Subsystem
+ */
+mavlink_system_t mavlink_system = {
+    1, // System ID
+    1, // Component ID
+};
+
+/* a finalized frame of msgid with len random nonzero payload bytes */
+static inline void
+bench_frame(struct message_t* msg, uint32_t msgid, uint8_t len, bool mavlink1)
+{
+    memset(msg, 0, sizeof(*msg));
+    msg->msg.msgid = msgid;
+    for (size_t i = 0; i < len; i++)
+    {
+        _MAV_PAYLOAD_NON_CONST(&msg->msg)[i] = (char)(rand() | 1);
+    }
+    msg->status.flags = mavlink1 ? MAVLINK_STATUS_FLAG_OUT_MAVLINK1 : 0;
+    message_finalize(msg, 1, 1, len, len, mavlink_get_crc_extra(&msg->msg));
+}
+
+/* nanoseconds per item, and items per second, of n items in elapsed_us */
+static inline double
+bench_ns(uint64_t elapsed_us, double n)
+{
+    return (double)elapsed_us * 1000.0 / n;
+}
+
+static inline double
+bench_rate(uint64_t elapsed_us, double n)
+{
+    return n * 1000000.0 / (double)(elapsed_us ? elapsed_us : 1);
+}
+
+#endif /* _BENCH_H_ */
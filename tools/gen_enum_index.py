@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+"""
+Generate a name -> value table of the enum entries of a mavgen C dialect,
+following the dialect includes (ardupilotmega -> common -> standard -> ...).
+
+The table is sorted by name so the gateway can look symbolic constants of
+policy rules up with a binary search. The *_ENUM_END sentinels are left out.
+
+usage: gen_enum_index.py <dialect header> <output header>
+"""
+
+import os
+import re
+import sys
+
+
+def parse_enums(path, seen, entries):
+    path = os.path.normpath(path)
+    if path in seen:
+        return
+    seen.add(path)
+
+    with open(path) as f:
+        text = f.read()
+
+    for inc in re.findall(r'#include\s+"(\.\./[^"]+\.h)"', text):
+        inc = os.path.join(os.path.dirname(path), inc)
+        if os.path.exists(inc) and os.path.basename(inc) != 'protocol.h':
+            parse_enums(inc, seen, entries)
+
+    text = re.sub(r'/\*.*?\*/', '', text, flags=re.DOTALL)
+    text = re.sub(r'//[^\n]*', '', text)
+    for body in re.findall(r'typedef\s+enum\s+\w+\s*\{(.*?)\}', text,
+                           re.DOTALL):
+        for name, value in re.findall(
+                r'\b([A-Z][A-Z0-9_]*)\s*=\s*(-?(?:0[xX][0-9a-fA-F]+|\d+))',
+                body):
+            if name.endswith('_ENUM_END'):
+                continue
+            entries.setdefault(name, int(value, 0))
+
+
+def emit(dialect, entries, out):
+    lines = [
+        '/* generated by tools/gen_enum_index.py from %s, do not edit */'
+        % os.path.basename(dialect),
+        '#ifndef _MAVLINK_ENUM_INDEX_H_',
+        '#define _MAVLINK_ENUM_INDEX_H_',
+        '',
+        '#define MAVLINK_ENUM_INDEX_COUNT %d' % len(entries),
+        '',
+        '/* { name, value } of every enum entry, sorted by name */',
+        '#define MAVLINK_ENUM_INDEX { \\',
+    ]
+    for name in sorted(entries):
+        lines.append('    { "%s", %dLL }, \\' % (name, entries[name]))
+    lines += ['}', '', '#endif /* _MAVLINK_ENUM_INDEX_H_ */', '']
+
+    tmp = out + '.tmp'
+    with open(tmp, 'w') as f:
+        f.write('\n'.join(lines))
+    os.replace(tmp, out)
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+    dialect, out = sys.argv[1], sys.argv[2]
+    entries = {}
+    parse_enums(dialect, set(), entries)
+    if not entries:
+        sys.exit('%s: no enums found' % dialect)
+    os.makedirs(os.path.dirname(os.path.abspath(out)), exist_ok=True)
+    emit(dialect, entries, out)
+
+
+if __name__ == '__main__':
+    main()
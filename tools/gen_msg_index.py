@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+"""
+Generate a dense two-level msgid -> index table for a mavgen C dialect.
+
+The index of a message is its position in MAVLINK_MESSAGE_CRCS (and, since
+mavgen emits both sorted by msgid, in MAVLINK_MESSAGE_INFO). The first level
+is indexed by msgid >> 8 and selects a 256-entry page; pages without any
+message are not emitted.
+
+usage: gen_msg_index.py <dialect header> <output header>
+"""
+
+import os
+import re
+import sys
+
+PAGE_BITS = 8
+PAGE_SIZE = 1 << PAGE_BITS
+
+
+def parse_crcs(path):
+    with open(path) as f:
+        text = f.read()
+
+    m = re.search(r'#define\s+MAVLINK_MESSAGE_CRCS\s+\{(.*)\}\s*$', text,
+                  re.MULTILINE)
+    if m is None:
+        sys.exit('%s: MAVLINK_MESSAGE_CRCS not found' % path)
+
+    msgids = [int(e) for e in re.findall(r'\{\s*(\d+)\s*,', m.group(1))]
+    if not msgids:
+        sys.exit('%s: MAVLINK_MESSAGE_CRCS is empty' % path)
+    if msgids != sorted(set(msgids)):
+        sys.exit('%s: MAVLINK_MESSAGE_CRCS is not sorted by msgid' % path)
+    if len(msgids) >= 0xFFFF:
+        sys.exit('%s: too many messages for a 16-bit index' % path)
+    return msgids
+
+
+def emit(dialect, msgids, out):
+    npages = (msgids[-1] >> PAGE_BITS) + 1
+    used = sorted({msgid >> PAGE_BITS for msgid in msgids})
+    if len(used) >= 0xFF:
+        sys.exit('too many pages for an 8-bit page table')
+
+    level1 = [0] * npages
+    for n, page in enumerate(used):
+        level1[page] = n + 1
+
+    level2 = [[0] * PAGE_SIZE for _ in used]
+    for index, msgid in enumerate(msgids):
+        level2[used.index(msgid >> PAGE_BITS)][msgid % PAGE_SIZE] = index + 1
+
+    def rows(values, width=16):
+        for i in range(0, len(values), width):
+            yield '    ' + ', '.join('%d' % v for v in values[i:i + width]) \
+                + ', \\'
+
+    lines = [
+        '/* generated by tools/gen_msg_index.py from %s, do not edit */'
+        % os.path.basename(dialect),
+        '#ifndef _MAVLINK_MSG_INDEX_H_',
+        '#define _MAVLINK_MSG_INDEX_H_',
+        '',
+        '#define MAVLINK_MSG_INDEX_COUNT %d' % len(msgids),
+        '#define MAVLINK_MSG_INDEX_PAGE_BITS %d' % PAGE_BITS,
+        '#define MAVLINK_MSG_INDEX_PAGES %d' % npages,
+        '#define MAVLINK_MSG_INDEX_USED_PAGES %d' % len(used),
+        '',
+        '/* page of msgid >> 8, plus one; 0 if the page is empty */',
+        '#define MAVLINK_MSG_INDEX_LEVEL1 { \\',
+    ]
+    lines += rows(level1)
+    lines += ['}', '']
+    lines += [
+        '/* index of msgid in MAVLINK_MESSAGE_CRCS, plus one; 0 if unknown */',
+        '#define MAVLINK_MSG_INDEX_LEVEL2 { \\',
+    ]
+    for n, page in enumerate(used):
+        lines.append('    /* msgid %d - %d */ { \\'
+                     % (page * PAGE_SIZE, page * PAGE_SIZE + PAGE_SIZE - 1))
+        lines += ['    ' + r for r in rows(level2[n])]
+        lines.append('    }, \\')
+    lines += ['}', '', '#endif /* _MAVLINK_MSG_INDEX_H_ */', '']
+
+    tmp = out + '.tmp'
+    with open(tmp, 'w') as f:
+        f.write('\n'.join(lines))
+    os.replace(tmp, out)
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+    dialect, out = sys.argv[1], sys.argv[2]
+    os.makedirs(os.path.dirname(os.path.abspath(out)), exist_ok=True)
+    emit(dialect, parse_crcs(dialect), out)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,154 @@
+#!/usr/bin/env python3
+"""
+Generate a perfect hash over the protected parameters of a parameter list.
+
+Every line of the list is "NAME readonly" or "NAME range MIN MAX"; '#'
+starts a comment. Names are PARAM_SET param_ids of up to 16 characters.
+
+The hash is hash-and-displace: the hash of a name selects a bucket, the hash
+mixed with the seed of the bucket a slot, and the seeds are chosen at build
+time so no two names share a slot. A lookup is one pass over the name, a
+mix and one name compare. The hashes must match param_index_hash() and
+param_index_mix() in lib/param_index.h.
+
+usage: gen_param_index.py <parameter list> <output header>
+"""
+
+import math
+import os
+import sys
+
+NAME_LEN = 16
+MAX_SEED = 1 << 16
+
+
+def fnv1a(name):
+    h = 2166136261
+    for c in name.encode('ascii'):
+        h = ((h ^ c) * 16777619) & 0xFFFFFFFF
+    return h
+
+
+def mix(h, seed):
+    h ^= seed
+    h ^= h >> 16
+    h = (h * 0x85EBCA6B) & 0xFFFFFFFF
+    h ^= h >> 13
+    h = (h * 0xC2B2AE35) & 0xFFFFFFFF
+    h ^= h >> 16
+    return h
+
+
+def parse(path):
+    params = {}
+    with open(path) as f:
+        for n, line in enumerate(f, 1):
+            words = line.split('#', 1)[0].split()
+            if not words:
+                continue
+            where = '%s:%d' % (path, n)
+            name = words[0]
+            if len(name) > NAME_LEN or not name.isascii():
+                sys.exit('%s: %s is not a parameter name' % (where, name))
+            if name in params:
+                sys.exit('%s: %s is listed twice' % (where, name))
+            if words[1:] == ['readonly']:
+                params[name] = ('PARAM_RULE_READONLY', 0.0, 0.0)
+            elif len(words) == 4 and words[1] == 'range':
+                try:
+                    lo, hi = float(words[2]), float(words[3])
+                except ValueError:
+                    sys.exit('%s: range bounds must be numbers' % where)
+                if not (math.isfinite(lo) and math.isfinite(hi)):
+                    sys.exit('%s: range bounds must be finite' % where)
+                if lo > hi:
+                    sys.exit('%s: empty range' % where)
+                params[name] = ('PARAM_RULE_RANGE', lo, hi)
+            else:
+                sys.exit('%s: expected "readonly" or "range MIN MAX"' % where)
+    if not params:
+        sys.exit('%s: no parameters' % path)
+    return params
+
+
+def pow2(n):
+    p = 1
+    while p < n:
+        p <<= 1
+    return p
+
+
+def build(names):
+    nbuckets = pow2(max(1, len(names) // 4))
+    nslots = pow2(len(names) + len(names) // 4 + 1)
+
+    buckets = [[] for _ in range(nbuckets)]
+    for name in names:
+        buckets[fnv1a(name) & (nbuckets - 1)].append(name)
+
+    seeds = [0] * nbuckets
+    slots = [None] * nslots
+    # the largest buckets first, while most slots are free
+    for b in sorted(range(nbuckets), key=lambda b: -len(buckets[b])):
+        if not buckets[b]:
+            continue
+        for seed in range(1, MAX_SEED):
+            taken = [mix(fnv1a(name), seed) & (nslots - 1)
+                     for name in buckets[b]]
+            if len(set(taken)) == len(taken) \
+                    and all(slots[s] is None for s in taken):
+                break
+        else:
+            sys.exit('no perfect hash found, change the hash')
+        seeds[b] = seed
+        for name, s in zip(buckets[b], taken):
+            slots[s] = name
+    return seeds, slots
+
+
+def emit(path, params, seeds, slots, out):
+    lines = [
+        '/* generated by tools/gen_param_index.py from %s, do not edit */'
+        % os.path.basename(path),
+        '#ifndef _PROTECTED_PARAMS_H_',
+        '#define _PROTECTED_PARAMS_H_',
+        '',
+        '#define PROTECTED_PARAMS_COUNT   %d' % len(params),
+        '#define PROTECTED_PARAMS_BUCKETS %d' % len(seeds),
+        '#define PROTECTED_PARAMS_SLOTS   %d' % len(slots),
+        '',
+        '/* seed of every bucket */',
+        '#define PROTECTED_PARAMS_SEEDS { \\',
+    ]
+    for i in range(0, len(seeds), 16):
+        lines.append('    ' + ', '.join('%d' % s for s in seeds[i:i + 16])
+                     + ', \\')
+    lines += ['}', '', '/* { name, rule, min, max } by slot */',
+              '#define PROTECTED_PARAMS { \\']
+    for name in slots:
+        if name is None:
+            lines.append('    { "", PARAM_RULE_NONE, 0.0f, 0.0f }, \\')
+        else:
+            rule, lo, hi = params[name]
+            lines.append('    { "%s", %s, %rf, %rf }, \\'
+                         % (name, rule, lo, hi))
+    lines += ['}', '', '#endif /* _PROTECTED_PARAMS_H_ */', '']
+
+    tmp = out + '.tmp'
+    with open(tmp, 'w') as f:
+        f.write('\n'.join(lines))
+    os.replace(tmp, out)
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+    path, out = sys.argv[1], sys.argv[2]
+    params = parse(path)
+    seeds, slots = build(sorted(params))
+    os.makedirs(os.path.dirname(os.path.abspath(out)), exist_ok=True)
+    emit(path, params, seeds, slots, out)
+
+
+if __name__ == '__main__':
+    main()